@@ -0,0 +1,197 @@
+// Cost of the date helpers built on civil_date.h against the std::get_time / mktime /
+// strftime versions they replaced, in nanoseconds per call.
+//
+// The old versions are copied here without their logging. Each case runs both
+// over the same dates, every day from 1900 to 2100 by default, and compares the results;
+// a mismatch fails the run. The old julianToCalendarString rounded the seconds without
+// carrying, so it could print "12:34:60"; those are counted and reported, not failed.
+//
+//     bench_civil_date [first year, default 1900] [last year, default 2100] [repeats, default 3]
+
+#include "civil_date.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static double legacyJulianDayFromDate(const std::string& date) {
+    std::tm tm = {};
+    std::istringstream ss(date);
+    ss >> std::get_time(&tm, "%Y-%m-%d");
+    if (ss.fail())
+        return 0.0;
+    int year = tm.tm_year + 1900;
+    int month = tm.tm_mon + 1;
+    int day = tm.tm_mday;
+    if (month <= 2) {
+        year--;
+        month += 12;
+    }
+    int A = year / 100;
+    int B = 2 - A + (A / 4);
+    return std::floor(365.25 * (year + 4716)) + std::floor(30.6001 * (month + 1)) + day + B - 1524.5;
+}
+
+static std::string legacyShiftDate(const std::string& date, int days) {
+    std::tm tm = {};
+    std::istringstream ss(date);
+    ss >> std::get_time(&tm, "%Y-%m-%d");
+    if (ss.fail())
+        return date;
+    tm.tm_mday += days;
+    mktime(&tm);
+    char buf[11];
+    strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+    return std::string(buf);
+}
+
+static std::string legacyJulianToCalendarString(double JD) {
+    double J = JD + 0.5;
+    int Z = static_cast<int>(std::floor(J));
+    double F = J - Z;
+    int A;
+    if (Z < 2299161) {
+        A = Z;
+    } else {
+        int alpha = static_cast<int>(std::floor((Z - 1867216.25) / 36524.25));
+        A = Z + 1 + alpha - static_cast<int>(std::floor(alpha / 4.0));
+    }
+    int B = A + 1524;
+    int C = static_cast<int>(std::floor((B - 122.1) / 365.25));
+    int D = static_cast<int>(std::floor(365.25 * C));
+    int E = static_cast<int>(std::floor((B - D) / 30.6001));
+    double dayDecimal = B - D - std::floor(30.6001 * E) + F;
+    int day = static_cast<int>(dayDecimal);
+    double dayFraction = dayDecimal - day;
+    int month = E < 14 ? E - 1 : E - 13;
+    int year = month > 2 ? C - 4716 : C - 4715;
+    double totalSeconds = dayFraction * 86400.0;
+    int hour = static_cast<int>(totalSeconds / 3600);
+    totalSeconds -= hour * 3600;
+    int minute = static_cast<int>(totalSeconds / 60);
+    totalSeconds -= minute * 60;
+    int second = static_cast<int>(totalSeconds + 0.5);
+    char buf[80];
+    std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d", year, month, day, hour, minute, second);
+    return std::string(buf);
+}
+
+static double newJulianDayFromDate(const std::string& date) {
+    CivilDate parsed;
+    return CivilDate::parse(date, parsed) ? parsed.julian() : 0.0;
+}
+
+static std::string newShiftDate(const std::string& date, int days) {
+    CivilDate parsed;
+    if (!CivilDate::parse(date, parsed))
+        return date;
+    char buf[CivilDate::kFormattedSize];
+    parsed.addDays(days).format(buf);
+    return std::string(buf);
+}
+
+static std::string newJulianToCalendarString(double JD) {
+    char buf[Timestamp::kFormattedSize];
+    Timestamp::fromJulian(JD).format(buf);
+    return std::string(buf);
+}
+
+// Best of 'repeats' passes over count items, in nanoseconds per item. The sink keeps the
+// calls from being optimised away.
+template <typename Pass>
+static double measure(size_t count, int repeats, Pass pass) {
+    double best = 0.0;
+    for (int run = 0; run < repeats; run++) {
+        auto started = std::chrono::steady_clock::now();
+        pass();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        double perItem = seconds * 1e9 / static_cast<double>(count);
+        if (run == 0 || perItem < best)
+            best = perItem;
+    }
+    return best;
+}
+
+static volatile size_t g_sink = 0;
+
+int main(int argc, char** argv) {
+    int firstYear = argc > 1 ? std::atoi(argv[1]) : 1900;
+    int lastYear = argc > 2 ? std::atoi(argv[2]) : 2100;
+    int repeats = argc > 3 ? std::atoi(argv[3]) : 3;
+    if (firstYear < 1583 || lastYear > 9998 || lastYear < firstYear || repeats < 1) {
+        std::fprintf(stderr, "usage: bench_civil_date [first year >= 1583] [last year <= 9998] [repeats]\n");
+        return 2;
+    }
+
+    // Every date in the range as "YYYY-MM-DD", and a timestamp on each day at a whole
+    // second that walks through the day.
+    std::vector<std::string> dates;
+    std::vector<double> stamps;
+    int firstDay = CivilDate{firstYear, 1, 1}.dayNumber();
+    int lastDay = CivilDate{lastYear, 12, 31}.dayNumber();
+    for (int day = firstDay; day <= lastDay; day++) {
+        char buf[CivilDate::kFormattedSize];
+        CivilDate::fromDayNumber(day).format(buf);
+        dates.emplace_back(buf);
+        int second = static_cast<int>((static_cast<long long>(day - firstDay) * 7919) % 86400);
+        stamps.push_back(Timestamp::fromCivil(CivilDate::fromDayNumber(day), second / 3600,
+                                              second / 60 % 60, second % 60).julian());
+    }
+
+    size_t mismatches = 0;
+    size_t legacySixty = 0;
+    for (size_t i = 0; i < dates.size(); i++) {
+        std::string legacyText = legacyJulianToCalendarString(stamps[i]);
+        bool textMatches = legacyText == newJulianToCalendarString(stamps[i]);
+        if (!textMatches && legacyText.compare(16, 3, ":60") == 0) {
+            legacySixty++;
+            textMatches = true;
+        }
+        if (legacyJulianDayFromDate(dates[i]) != newJulianDayFromDate(dates[i]) ||
+            legacyShiftDate(dates[i], 1) != newShiftDate(dates[i], 1) ||
+            legacyShiftDate(dates[i], -1) != newShiftDate(dates[i], -1) || !textMatches) {
+            if (mismatches++ < 5)
+                std::fprintf(stderr, "mismatch at %s\n", dates[i].c_str());
+        }
+    }
+
+    struct Case {
+        const char* name;
+        double legacy;
+        double current;
+    };
+    std::vector<Case> cases;
+    size_t n = dates.size();
+    cases.push_back({"date to julian",
+                     measure(n, repeats, [&] { for (const auto& d : dates) g_sink = g_sink + static_cast<size_t>(legacyJulianDayFromDate(d)); }),
+                     measure(n, repeats, [&] { for (const auto& d : dates) g_sink = g_sink + static_cast<size_t>(newJulianDayFromDate(d)); })});
+    cases.push_back({"next date",
+                     measure(n, repeats, [&] { for (const auto& d : dates) g_sink = g_sink + legacyShiftDate(d, 1).size(); }),
+                     measure(n, repeats, [&] { for (const auto& d : dates) g_sink = g_sink + newShiftDate(d, 1).size(); })});
+    cases.push_back({"previous date",
+                     measure(n, repeats, [&] { for (const auto& d : dates) g_sink = g_sink + legacyShiftDate(d, -1).size(); }),
+                     measure(n, repeats, [&] { for (const auto& d : dates) g_sink = g_sink + newShiftDate(d, -1).size(); })});
+    cases.push_back({"julian to text",
+                     measure(n, repeats, [&] { for (double s : stamps) g_sink = g_sink + legacyJulianToCalendarString(s).size(); }),
+                     measure(n, repeats, [&] { for (double s : stamps) g_sink = g_sink + newJulianToCalendarString(s).size(); })});
+
+    std::printf("%zu dates, %d-%d, best of %d; the tm version printed second 60 for %zu\n\n", n,
+                firstYear, lastYear, repeats, legacySixty);
+    std::printf("%-16s %14s %14s %9s\n", "case", "tm ns/call", "civil ns/call", "speedup");
+    for (const Case& c : cases)
+        std::printf("%-16s %14.1f %14.1f %8.1fx\n", c.name, c.legacy, c.current,
+                    c.current > 0.0 ? c.legacy / c.current : 0.0);
+
+    if (mismatches != 0) {
+        std::fprintf(stderr, "%zu dates disagree with the tm versions\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Throughput of the interval-to-bucket kernel (interval_buckets.h) for the hour,
+// quarter-hour and minute layouts of a day, in sessions per second.
+//
+// Sessions are random intervals around one day, from a few seconds to a few hours long,
+// some reaching past either end of the day. Each layout runs the dispatched kernel and the
+// scalar reference over the same sessions and compares the buckets; a mismatch fails the run.
+//
+//     bench_interval_buckets [sessions, default 1000000] [repeats, default 5]
+
+#include "interval_buckets.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using Kernel = void (*)(const BucketGrid&, const double*, const double*, size_t, double, double*);
+
+// Best of 'repeats' runs, in sessions per second; buckets hold the last run's result.
+static double measure(Kernel kernel, const BucketGrid& grid, const std::vector<double>& starts,
+                      const std::vector<double>& ends, int repeats, std::vector<double>& buckets) {
+    double best = 0.0;
+    for (int run = 0; run < repeats; run++) {
+        std::fill(buckets.begin(), buckets.end(), 0.0);
+        auto started = std::chrono::steady_clock::now();
+        kernel(grid, starts.data(), ends.data(), starts.size(), 86400.0, buckets.data());
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (seconds > 0.0)
+            best = std::max(best, starts.size() / seconds);
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t sessions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    int repeats = argc > 2 ? std::atoi(argv[2]) : 5;
+    if (sessions == 0)
+        sessions = 1000000;
+    repeats = std::max(repeats, 1);
+
+    const double dayStart = 2460000.5;
+    std::mt19937_64 generator(42);
+    std::uniform_real_distribution<double> offset(-0.05, 1.05);
+    std::exponential_distribution<double> length(1.0 / 0.01);  // Mean about 15 minutes.
+    std::vector<double> starts(sessions), ends(sessions);
+    for (size_t i = 0; i < sessions; i++) {
+        starts[i] = dayStart + offset(generator);
+        ends[i] = starts[i] + std::min(length(generator), 0.25) + 1.0 / 86400.0;
+    }
+
+    std::printf("kernel: %s, %zu sessions, best of %d\n", getBucketKernelName(), sessions, repeats);
+    std::printf("%8s %18s %18s %8s %12s\n", "buckets", "kernel sessions/s", "scalar sessions/s", "speedup", "max diff s");
+    bool ok = true;
+    for (int bucketsPerDay : {kHourBuckets, kQuarterHourBuckets, kMinuteBuckets}) {
+        BucketGrid grid = makeDayBucketGrid(dayStart, bucketsPerDay);
+        std::vector<double> vector(grid.count()), scalar(grid.count());
+        double kernelRate = measure(accumulateIntervals, grid, starts, ends, repeats, vector);
+        double scalarRate = measure(accumulateIntervalsScalar, grid, starts, ends, repeats, scalar);
+
+        // Both sum the same overlaps in the same order per bucket, up to rounding.
+        double maxDiff = 0.0;
+        for (size_t k = 0; k < grid.count(); k++) {
+            double diff = std::fabs(vector[k] - scalar[k]);
+            maxDiff = std::max(maxDiff, diff);
+            if (diff > 1e-6 * std::max(1.0, std::fabs(scalar[k])))
+                ok = false;
+        }
+        std::printf("%8d %18.0f %18.0f %7.2fx %12.3g\n", bucketsPerDay, kernelRate, scalarRate,
+                    scalarRate > 0.0 ? kernelRate / scalarRate : 0.0, maxDiff);
+    }
+    if (!ok) {
+        std::printf("MISMATCH: the vector kernel disagrees with the scalar reference.\n");
+        return 1;
+    }
+    return 0;
+}
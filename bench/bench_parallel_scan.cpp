@@ -0,0 +1,150 @@
+// Thread-count sweep for parallel_scan.h: all-time per-process totals over a generated
+// history, in milliseconds per aggregateUsage call and sessions per second.
+//
+// The history is a fresh database of 'days' days with 'per day' closed sessions each, spread
+// over 40 processes, plus one open session. Every thread count must produce the same totals
+// as the single-threaded pass, to a millisecond; a mismatch fails the run.
+//
+//     bench_parallel_scan [days, default 1095] [sessions per day, default 300] [repeats, default 5]
+//
+// The database is written to bench_parallel_scan.db in the working directory and removed
+// afterwards.
+
+#include "database.h"
+#include "functions.h"
+#include "parallel_scan.h"
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+static const char* kDbPath = "bench_parallel_scan.db";
+static const double kFirstDay = 2460000.5;  // A local midnight; the history runs forwards from here.
+static double g_now = 0.0;
+
+// The bench does not link functions.cpp; "now" is fixed just after the last generated day.
+double getCurrentJulianDay() {
+    return g_now;
+}
+
+static void removeDatabaseFiles() {
+    std::remove(kDbPath);
+    std::remove((std::string(kDbPath) + "-wal").c_str());
+    std::remove((std::string(kDbPath) + "-shm").c_str());
+}
+
+static bool generateHistory(int days, int perDay) {
+    sqlite3* dbHandle = getDatabase();
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "INSERT INTO ActivitySession (processName, windowTitle, startTime, endTime) VALUES (?, ?, ?, ?);";
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::fprintf(stderr, "prepare failed: %s\n", sqlite3_errmsg(dbHandle));
+        return false;
+    }
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> process(0, 39);
+    std::uniform_real_distribution<double> offset(0.0, 0.99);
+    std::exponential_distribution<double> length(1.0 / 120.0);  // Seconds, two minutes on average.
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    for (int day = 0; day < days; day++) {
+        for (int i = 0; i < perDay; i++) {
+            double start = kFirstDay + day + offset(rng);
+            double end = start + std::min(length(rng), 3600.0) / 86400.0;
+            std::string name = "process" + std::to_string(process(rng)) + ".exe";
+            sqlite3_reset(stmt);
+            sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, "window", -1, SQLITE_STATIC);
+            sqlite3_bind_double(stmt, 3, start);
+            sqlite3_bind_double(stmt, 4, end);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::fprintf(stderr, "insert failed: %s\n", sqlite3_errmsg(dbHandle));
+                sqlite3_finalize(stmt);
+                return false;
+            }
+        }
+    }
+    // One open session, counted up to "now".
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, "process0.exe", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, "window", -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 3, g_now - 0.01);
+    sqlite3_bind_null(stmt, 4);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    return true;
+}
+
+static bool sameTotals(const UsageTotals& a, const UsageTotals& b) {
+    if (a.processSeconds.size() != b.processSeconds.size() || std::fabs(a.totalSeconds - b.totalSeconds) > 1e-3)
+        return false;
+    for (const auto& entry : a.processSeconds) {
+        auto found = b.processSeconds.find(entry.first);
+        if (found == b.processSeconds.end() || std::fabs(found->second - entry.second) > 1e-3)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int days = argc > 1 ? std::atoi(argv[1]) : 1095;
+    int perDay = argc > 2 ? std::atoi(argv[2]) : 300;
+    int repeats = argc > 3 ? std::atoi(argv[3]) : 5;
+    if (days < 1 || perDay < 1 || repeats < 1) {
+        std::fprintf(stderr, "usage: bench_parallel_scan [days] [sessions per day] [repeats]\n");
+        return 2;
+    }
+    g_now = kFirstDay + days + 0.5;
+
+    removeDatabaseFiles();
+    if (!initDatabase(kDbPath) || !generateHistory(days, perDay)) {
+        closeDatabase();
+        removeDatabaseFiles();
+        return 1;
+    }
+    size_t sessions = static_cast<size_t>(days) * perDay + 1;
+    std::printf("%zu sessions over %d days, %u hardware threads, best of %d\n\n", sessions, days,
+                std::thread::hardware_concurrency(), repeats);
+    std::printf("%8s %12s %16s %8s\n", "threads", "ms/scan", "sessions/s", "speedup");
+
+    bool mismatch = false;
+    UsageTotals reference;
+    double single = 0.0;
+    for (int threads : {1, 2, 4, 8}) {
+        setParallelScanThreads(threads);
+        double best = 0.0;
+        UsageTotals totals;
+        for (int run = 0; run < repeats; run++) {
+            auto started = std::chrono::steady_clock::now();
+            bool ok = aggregateUsage(0.0, 0.0, false, totals);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            if (!ok) {
+                std::fprintf(stderr, "aggregateUsage failed with %d threads\n", threads);
+                mismatch = true;
+                break;
+            }
+            if (run == 0 || seconds < best)
+                best = seconds;
+        }
+        if (threads == 1) {
+            reference = totals;
+            single = best;
+        } else if (!sameTotals(reference, totals)) {
+            std::fprintf(stderr, "%d threads disagree with the single-threaded totals\n", threads);
+            mismatch = true;
+        }
+        std::printf("%8d %12.2f %16.0f %7.2fx\n", threads, best * 1000.0, best > 0.0 ? sessions / best : 0.0,
+                    best > 0.0 ? single / best : 0.0);
+    }
+
+    stopParallelScan();
+    closeDatabase();
+    removeDatabaseFiles();
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+// Reader contention microbenchmark for rcu.h.
+//
+// Readers repeatedly look up a published aggregate and sum it while one writer publishes a
+// new one every millisecond. The same workload runs against RcuCell and against a
+// shared_ptr guarded by a mutex, for 1 to 32 reader threads.
+//
+//     bench_rcu [seconds per run, default 1]
+
+#include "rcu.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Aggregate {
+    std::vector<double> hours = std::vector<double>(24, 1.0);
+};
+
+struct RcuSource {
+    RcuCell<Aggregate> cell;
+
+    void publish() { cell.publish(std::make_unique<Aggregate>()); }
+    double read() {
+        RcuReadGuard guard;
+        const Aggregate* current = cell.read();
+        return current ? current->hours[7] : 0.0;
+    }
+};
+
+struct MutexSource {
+    std::mutex mutex;
+    std::shared_ptr<const Aggregate> current;
+
+    void publish() {
+        auto next = std::make_shared<const Aggregate>();
+        std::lock_guard<std::mutex> lock(mutex);
+        current = std::move(next);
+    }
+    double read() {
+        std::shared_ptr<const Aggregate> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            snapshot = current;
+        }
+        return snapshot ? snapshot->hours[7] : 0.0;
+    }
+};
+
+// Returns reads per second across all readers.
+template <typename Source>
+static double run(int readers, double seconds) {
+    Source source;
+    source.publish();
+    std::atomic<bool> stop{false};
+    std::atomic<long long> reads{0};
+    std::atomic<long long> sink{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&] {
+            long long count = 0;
+            double sum = 0.0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                sum += source.read();
+                count++;
+            }
+            reads += count;
+            sink += static_cast<long long>(sum);
+        });
+    }
+    std::thread writer([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            source.publish();
+            rcuReclaim();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    writer.join();
+    rcuReclaim();
+    return reads / seconds;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+    if (seconds <= 0.0)
+        seconds = 1.0;
+    std::printf("%8s %16s %16s %8s\n", "readers", "rcu reads/s", "mutex reads/s", "ratio");
+    for (int readers : {1, 2, 4, 8, 16, 32}) {
+        double rcu = run<RcuSource>(readers, seconds);
+        double locked = run<MutexSource>(readers, seconds);
+        std::printf("%8d %16.0f %16.0f %7.1fx\n", readers, rcu, locked, locked > 0.0 ? rcu / locked : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include "categories.h"
+
+#include "daily_usage.h"
+#include "database.h"
+#include "functions.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+static std::vector<CategoryInfo> g_categories;
+static int g_otherCategory = 0;
+
+// Guards the slot tables, which the snapshot worker reads while building timelines.
+static std::mutex g_slotMutex;
+static std::unordered_map<std::string, int> g_processSlots;
+static std::vector<int> g_slotCategories;
+static std::vector<bool> g_slotAssigned;
+
+// Bumped when an assignment changes, invalidating the cached grouped query.
+static unsigned long long g_assignmentVersion = 1;
+
+struct CachedCategoryQuery {
+    int firstDay = 0;
+    int lastDay = -1;
+    unsigned long long assignmentVersion = 0;
+    unsigned long long usageRevision = 0;
+    std::vector<double> seconds;  // Per category index.
+};
+static CachedCategoryQuery g_cachedQuery;
+
+// Caller holds g_slotMutex.
+static int slotLocked(const std::string& processName) {
+    auto found = g_processSlots.find(processName);
+    if (found != g_processSlots.end())
+        return found->second;
+    int slot = static_cast<int>(g_slotCategories.size());
+    g_processSlots.emplace(processName, slot);
+    g_slotCategories.push_back(g_otherCategory);
+    g_slotAssigned.push_back(false);
+    return slot;
+}
+
+static int categoryIndexForId(int id) {
+    for (size_t i = 0; i < g_categories.size(); i++) {
+        if (g_categories[i].id == id)
+            return static_cast<int>(i);
+    }
+    return g_otherCategory;
+}
+
+void initCategories() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    g_categories.clear();
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT id, name, color FROM Category ORDER BY id;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read categories: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        CategoryInfo category;
+        category.id = sqlite3_column_int(stmt, 0);
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        category.name = name ? reinterpret_cast<const char*>(name) : "";
+        category.color = static_cast<ImU32>(sqlite3_column_int64(stmt, 2));
+        if (category.name == "Other")
+            g_otherCategory = static_cast<int>(g_categories.size());
+        g_categories.push_back(category);
+    }
+    sqlite3_finalize(stmt);
+
+    const char* assignedSql = R"(
+        SELECT Process.name, ProcessCategory.categoryId FROM ProcessCategory
+        JOIN Process ON Process.id = ProcessCategory.processId;
+    )";
+    if (sqlite3_prepare_v2(dbHandle, assignedSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read process categories: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_slotMutex);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* name = sqlite3_column_text(stmt, 0);
+        int slot = slotLocked(name ? reinterpret_cast<const char*>(name) : "");
+        g_slotCategories[slot] = categoryIndexForId(sqlite3_column_int(stmt, 1));
+        g_slotAssigned[slot] = true;
+    }
+    sqlite3_finalize(stmt);
+}
+
+const std::vector<CategoryInfo>& getCategories() {
+    return g_categories;
+}
+
+int getOtherCategory() {
+    return g_otherCategory;
+}
+
+int getProcessSlot(const std::string& processName) {
+    std::lock_guard<std::mutex> lock(g_slotMutex);
+    return slotLocked(processName);
+}
+
+std::vector<int> getSlotCategories() {
+    std::lock_guard<std::mutex> lock(g_slotMutex);
+    return g_slotCategories;
+}
+
+int getProcessCategory(const std::string& processName) {
+    std::lock_guard<std::mutex> lock(g_slotMutex);
+    return g_slotCategories[slotLocked(processName)];
+}
+
+bool hasAssignedCategory(const std::string& processName) {
+    std::lock_guard<std::mutex> lock(g_slotMutex);
+    return g_slotAssigned[slotLocked(processName)];
+}
+
+bool setProcessCategory(const std::string& processName, int category) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || category < 0 || category >= static_cast<int>(g_categories.size()))
+        return false;
+    const char* statements[] = {
+        "INSERT OR IGNORE INTO Process (name) VALUES (?1);",
+        "INSERT OR REPLACE INTO ProcessCategory (processId, categoryId) SELECT id, ?2 FROM Process WHERE name = ?1;",
+    };
+    bool ok = sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr) == SQLITE_OK;
+    for (const char* sql : statements) {
+        sqlite3_stmt* stmt = nullptr;
+        ok = ok && sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK;
+        if (ok) {
+            sqlite3_bind_text(stmt, 1, processName.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_bind_parameter_count(stmt) >= 2)
+                sqlite3_bind_int(stmt, 2, g_categories[category].id);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (!ok) {
+        std::cerr << "Failed to set process category: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+
+    std::lock_guard<std::mutex> lock(g_slotMutex);
+    int slot = slotLocked(processName);
+    g_slotCategories[slot] = category;
+    g_slotAssigned[slot] = true;
+    g_assignmentVersion++;
+    return true;
+}
+
+unsigned long long getCategoryAssignmentVersion() {
+    return g_assignmentVersion;
+}
+
+// Seconds per category over indexed days [firstDay, lastDay], grouped in SQL.
+static bool queryIndexedCategories(sqlite3* dbHandle, int firstDay, int lastDay, std::vector<double>& seconds) {
+    const char* sql = R"(
+        SELECT ProcessCategory.categoryId, SUM(DailyUsage.totalTime) FROM DailyUsage
+        LEFT JOIN Process ON Process.name = DailyUsage.processName
+        LEFT JOIN ProcessCategory ON ProcessCategory.processId = Process.id
+        WHERE DailyUsage.day BETWEEN ? AND ?
+        GROUP BY ProcessCategory.categoryId;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare category usage query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, firstDay);
+    sqlite3_bind_int(stmt, 2, lastDay);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int category = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? g_otherCategory
+                                                                   : categoryIndexForId(sqlite3_column_int(stmt, 0));
+        seconds[category] += sqlite3_column_double(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+std::vector<CategoryUsage> getCategoryUsage(int firstDay, int lastDay) {
+    std::vector<double> seconds(g_categories.size(), 0.0);
+    std::vector<CategoryUsage> results;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || g_categories.empty())
+        return results;
+
+    // Indexed days: one grouped query, reused until assignments or DailyUsage change.
+    int indexedLast = std::min(lastDay, getIndexedThroughDay());
+    if (firstDay <= indexedLast) {
+        CachedCategoryQuery& cached = g_cachedQuery;
+        if (cached.firstDay != firstDay || cached.lastDay != indexedLast ||
+            cached.assignmentVersion != g_assignmentVersion || cached.usageRevision != getDailyUsageRevision()) {
+            cached.seconds.assign(g_categories.size(), 0.0);
+            if (!queryIndexedCategories(dbHandle, firstDay, indexedLast, cached.seconds))
+                return results;
+            cached.firstDay = firstDay;
+            cached.lastDay = indexedLast;
+            cached.assignmentVersion = g_assignmentVersion;
+            cached.usageRevision = getDailyUsageRevision();
+        }
+        seconds = cached.seconds;
+    }
+
+    // Later days (a few at most, plus today) are small enough to group here.
+    int rest = std::max(firstDay, getIndexedThroughDay() + 1);
+    if (rest <= lastDay) {
+        RangeUsage usage = getRangeUsage(rest, lastDay);
+        for (const auto& app : usage.processes)
+            seconds[getProcessCategory(app.processName)] += app.totalTime;
+    }
+
+    for (size_t i = 0; i < seconds.size(); i++) {
+        if (seconds[i] > 0.0)
+            results.push_back(CategoryUsage{static_cast<int>(i), seconds[i]});
+    }
+    std::sort(results.begin(), results.end(), [](const CategoryUsage& a, const CategoryUsage& b) {
+        return a.totalTime > b.totalTime;
+    });
+    return results;
+}
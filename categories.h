@@ -0,0 +1,51 @@
+#ifndef CATEGORIES_H
+#define CATEGORIES_H
+
+#include <imgui.h>
+#include <string>
+#include <vector>
+
+// App categories, stored as Process -> ProcessCategory -> Category.
+//
+// Each process name gets a small in-memory slot the first time it is seen, so views that
+// are redrawn every frame (the category timeline, app colors) resolve a category with an
+// array index instead of a string search. Processes without a category count as "Other".
+// Slots and categories may be read from any thread; assignments are made on the UI thread.
+
+struct CategoryInfo {
+    int id = 0;  // Category.id
+    std::string name;
+    ImU32 color = 0;
+};
+
+struct CategoryUsage {
+    int category = 0;  // Index into getCategories().
+    double totalTime = 0.0;
+};
+
+// Loads categories and assignments. Call after initDatabase.
+void initCategories();
+
+// Categories in id order. The list is fixed after initCategories.
+const std::vector<CategoryInfo>& getCategories();
+int getOtherCategory();
+
+// Slot of a process name, created on first use. Thread-safe.
+int getProcessSlot(const std::string& processName);
+// Category index of every slot, indexed by slot. Thread-safe copy.
+std::vector<int> getSlotCategories();
+int getProcessCategory(const std::string& processName);
+// True if the user assigned the process a category (as opposed to the "Other" default).
+bool hasAssignedCategory(const std::string& processName);
+
+// Stores the assignment; false if the write failed.
+bool setProcessCategory(const std::string& processName, int category);
+// Changes whenever an assignment does, for callers caching per-category results.
+unsigned long long getCategoryAssignmentVersion();
+
+// Time per category over days [firstDay, lastDay], largest first. Indexed days are one
+// grouped query over DailyUsage, cached until an assignment or the index changes; the
+// remaining days and today come from getRangeUsage.
+std::vector<CategoryUsage> getCategoryUsage(int firstDay, int lastDay);
+
+#endif // CATEGORIES_H
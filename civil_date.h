@@ -0,0 +1,180 @@
+#ifndef CIVIL_DATE_H
+#define CIVIL_DATE_H
+
+#include <cstddef>
+#include <string_view>
+
+// Proleptic Gregorian dates and local timestamps as plain values.
+// Everything is constexpr and allocation-free: parsing reads a string_view, formatting
+// writes into a caller's fixed buffer, and day arithmetic is integer arithmetic on
+// day numbers (see julianToDayNumber; local midnight of day N is julian N - 0.5).
+
+struct CivilDate {
+    int year = 1970;
+    int month = 1;  // 1-12
+    int day = 1;    // 1-31
+
+    // Julian day number of 1970-01-01, the epoch the conversions below count from.
+    static constexpr int kUnixEpochDayNumber = 2440588;
+    // "YYYY-MM-DD" plus the terminator.
+    static constexpr size_t kFormattedSize = 11;
+
+    static constexpr bool isLeapYear(int year) {
+        return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    }
+
+    static constexpr int daysInMonth(int year, int month) {
+        if (month == 2)
+            return isLeapYear(year) ? 29 : 28;
+        return (month == 4 || month == 6 || month == 9 || month == 11) ? 30 : 31;
+    }
+
+    // Days from civil (H. Hinnant), shifted from the Unix epoch to julian day numbers.
+    constexpr int dayNumber() const {
+        int y = year - (month <= 2 ? 1 : 0);
+        int era = (y >= 0 ? y : y - 399) / 400;
+        int yearOfEra = y - era * 400;
+        int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468 + kUnixEpochDayNumber;
+    }
+
+    static constexpr CivilDate fromDayNumber(int dayNumber) {
+        int z = dayNumber - kUnixEpochDayNumber + 719468;
+        int era = (z >= 0 ? z : z - 146096) / 146097;
+        int dayOfEra = z - era * 146097;
+        int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int mp = (5 * dayOfYear + 2) / 153;
+        CivilDate date;
+        date.day = dayOfYear - (153 * mp + 2) / 5 + 1;
+        date.month = mp < 10 ? mp + 3 : mp - 9;
+        date.year = yearOfEra + era * 400 + (date.month <= 2 ? 1 : 0);
+        return date;
+    }
+
+    // Julian timestamp of local midnight at the start of the date.
+    constexpr double julian() const { return dayNumber() - 0.5; }
+    constexpr CivilDate addDays(int days) const { return fromDayNumber(dayNumber() + days); }
+    // Sunday = 0 ... Saturday = 6. Day numbers divisible by 7 are Mondays.
+    constexpr int weekday() const { return (dayNumber() + 1) % 7; }
+    constexpr bool valid() const {
+        return month >= 1 && month <= 12 && day >= 1 && day <= daysInMonth(year, month);
+    }
+    constexpr bool operator==(const CivilDate& other) const {
+        return year == other.year && month == other.month && day == other.day;
+    }
+
+    // Parses a leading "YYYY-MM-DD" (month and day may have one digit). Like std::get_time,
+    // anything after the date is ignored. False, with out untouched, for an impossible date.
+    static constexpr bool parse(std::string_view text, CivilDate& out) {
+        int fields[3] = {0, 0, 0};
+        constexpr size_t maxDigits[3] = {4, 2, 2};
+        size_t pos = 0;
+        for (int f = 0; f < 3; f++) {
+            if (f > 0) {
+                if (pos >= text.size() || text[pos] != '-')
+                    return false;
+                pos++;
+            }
+            size_t digits = 0;
+            while (pos < text.size() && digits < maxDigits[f] && text[pos] >= '0' && text[pos] <= '9') {
+                fields[f] = fields[f] * 10 + (text[pos] - '0');
+                pos++;
+                digits++;
+            }
+            if (digits == 0 || (f == 0 && digits != 4))
+                return false;
+        }
+        CivilDate date;
+        date.year = fields[0];
+        date.month = fields[1];
+        date.day = fields[2];
+        if (!date.valid())
+            return false;
+        out = date;
+        return true;
+    }
+
+    // Writes "YYYY-MM-DD" and a terminator; years outside 0-9999 are clamped.
+    constexpr void format(char* buffer) const {
+        int y = year < 0 ? 0 : (year > 9999 ? 9999 : year);
+        writeDigits(buffer, y, 4);
+        buffer[4] = '-';
+        writeDigits(buffer + 5, month, 2);
+        buffer[7] = '-';
+        writeDigits(buffer + 8, day, 2);
+        buffer[10] = '\0';
+    }
+
+    static constexpr void writeDigits(char* buffer, int value, int width) {
+        for (int i = width - 1; i >= 0; i--) {
+            buffer[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+};
+
+// A local date and time of day, to the millisecond.
+struct Timestamp {
+    CivilDate date;
+    int millisecond = 0;  // Since local midnight, 0 - 86399999.
+
+    // "YYYY-MM-DD HH:MM:SS" plus the terminator.
+    static constexpr size_t kFormattedSize = 20;
+
+    static constexpr Timestamp fromCivil(const CivilDate& date, int hour, int minute, int second, int millis = 0) {
+        Timestamp stamp;
+        stamp.date = date;
+        stamp.millisecond = ((hour * 60 + minute) * 60 + second) * 1000 + millis;
+        return stamp;
+    }
+
+    // Rounds to the nearest millisecond, carrying into the next day when needed.
+    static constexpr Timestamp fromJulian(double julian) {
+        double shifted = julian + 0.5;
+        long long whole = static_cast<long long>(shifted);
+        if (static_cast<double>(whole) > shifted)
+            whole--;  // floor for negative values
+        long long millis = static_cast<long long>((shifted - static_cast<double>(whole)) * 86400000.0 + 0.5);
+        if (millis >= 86400000) {
+            whole++;
+            millis -= 86400000;
+        }
+        Timestamp stamp;
+        stamp.date = CivilDate::fromDayNumber(static_cast<int>(whole));
+        stamp.millisecond = static_cast<int>(millis);
+        return stamp;
+    }
+
+    constexpr double julian() const { return date.julian() + millisecond / 86400000.0; }
+    constexpr int hour() const { return millisecond / 3600000; }
+    constexpr int minute() const { return millisecond / 60000 % 60; }
+    constexpr int second() const { return millisecond / 1000 % 60; }
+
+    // Writes "YYYY-MM-DD HH:MM:SS" and a terminator, rounding to the nearest second.
+    constexpr void format(char* buffer) const {
+        Timestamp rounded = *this;
+        rounded.millisecond = (millisecond + 500) / 1000 * 1000;
+        if (rounded.millisecond >= 86400000) {
+            rounded.date = date.addDays(1);
+            rounded.millisecond -= 86400000;
+        }
+        rounded.date.format(buffer);
+        buffer[10] = ' ';
+        CivilDate::writeDigits(buffer + 11, rounded.hour(), 2);
+        buffer[13] = ':';
+        CivilDate::writeDigits(buffer + 14, rounded.minute(), 2);
+        buffer[16] = ':';
+        CivilDate::writeDigits(buffer + 17, rounded.second(), 2);
+        buffer[19] = '\0';
+    }
+};
+
+static_assert(CivilDate{1970, 1, 1}.dayNumber() == CivilDate::kUnixEpochDayNumber);
+static_assert(CivilDate{2000, 1, 1}.julian() == 2451544.5);
+static_assert(CivilDate::fromDayNumber(CivilDate{2024, 2, 29}.dayNumber() + 1) == CivilDate{2024, 3, 1});
+static_assert(CivilDate{2025, 2, 24}.weekday() == 1);  // A Monday.
+static_assert([] { CivilDate d; return CivilDate::parse("2025-3-9", d) && d == CivilDate{2025, 3, 9}; }());
+
+#endif // CIVIL_DATE_H
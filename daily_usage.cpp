@@ -0,0 +1,325 @@
+#include "daily_usage.h"
+
+#include "database.h"
+#include "history_edit.h"
+#include "live_usage.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Days [g_firstDay, g_indexedThrough] are in DailyUsage and the prefix arrays.
+// prefix[i] is the sum of the first i indexed days, so every array has one more
+// entry than there are indexed days.
+static int g_firstDay = 1;
+static int g_indexedThrough = 0;
+static std::vector<double> g_totalPrefix{0.0};
+static std::unordered_map<std::string, std::vector<double>> g_processPrefix;
+
+// Days rewritten since the last maintenance pass.
+static int g_repairFirstDay = 0;
+static int g_repairLastDay = -1;
+static std::chrono::steady_clock::time_point g_lastAppendCheck;
+static bool g_initialized = false;
+static unsigned long long g_revision = 0;
+
+static const char* kIndexedThroughKey = "daily.indexedThrough";
+
+// Re-aggregates days [firstDay, lastDay] of closed sessions into DailyUsage.
+static bool indexDays(sqlite3* dbHandle, int firstDay, int lastDay) {
+    if (lastDay < firstDay)
+        return true;
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* stmt = nullptr;
+    bool ok = sqlite3_prepare_v2(dbHandle, "DELETE FROM DailyUsage WHERE day BETWEEN ? AND ?;", -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_int(stmt, 1, firstDay);
+        sqlite3_bind_int(stmt, 2, lastDay);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+
+    const char* insertSql = R"(
+        INSERT INTO DailyUsage (day, processName, totalTime)
+        SELECT CAST(startTime + 0.5 AS INTEGER) AS day, COALESCE(processName, ''),
+               SUM((endTime - startTime) * 86400.0)
+        FROM SessionHistory
+        WHERE endTime IS NOT NULL AND startTime >= ? AND startTime < ?
+        GROUP BY day, COALESCE(processName, '');
+    )";
+    stmt = nullptr;
+    if (ok && sqlite3_prepare_v2(dbHandle, insertSql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, dayNumberToJulian(firstDay));
+        sqlite3_bind_double(stmt, 2, dayNumberToJulian(lastDay + 1));
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    } else {
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!ok) {
+        std::cerr << "Failed to index daily usage: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    return true;
+}
+
+// Reads DailyUsage rows for days [firstDay, lastDay] into per-day offsets from firstDay.
+static void readDays(sqlite3* dbHandle, int firstDay, int lastDay,
+                     std::vector<double>& dayTotals,
+                     std::unordered_map<std::string, std::vector<double>>& processDays) {
+    int days = std::max(0, lastDay - firstDay + 1);
+    dayTotals.assign(days, 0.0);
+    processDays.clear();
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT day, processName, totalTime FROM DailyUsage WHERE day BETWEEN ? AND ?;",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read daily usage: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_int(stmt, 1, firstDay);
+    sqlite3_bind_int(stmt, 2, lastDay);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int offset = sqlite3_column_int(stmt, 0) - firstDay;
+        const unsigned char* procName = sqlite3_column_text(stmt, 1);
+        double seconds = sqlite3_column_double(stmt, 2);
+        auto& values = processDays[procName ? reinterpret_cast<const char*>(procName) : ""];
+        values.resize(days, 0.0);
+        values[offset] += seconds;
+        dayTotals[offset] += seconds;
+    }
+    sqlite3_finalize(stmt);
+}
+
+// Appends per-day values for the days after g_indexedThrough to the prefix arrays.
+static void extendPrefixSums(const std::vector<double>& dayTotals,
+                             const std::unordered_map<std::string, std::vector<double>>& processDays) {
+    size_t oldSize = g_totalPrefix.size();
+    for (const auto& entry : processDays) {
+        if (!g_processPrefix.count(entry.first))
+            g_processPrefix[entry.first].assign(oldSize, 0.0);
+    }
+    for (size_t day = 0; day < dayTotals.size(); day++) {
+        g_totalPrefix.push_back(g_totalPrefix.back() + dayTotals[day]);
+        for (auto& entry : g_processPrefix) {
+            auto found = processDays.find(entry.first);
+            double seconds = (found != processDays.end()) ? found->second[day] : 0.0;
+            entry.second.push_back(entry.second.back() + seconds);
+        }
+    }
+    g_indexedThrough += static_cast<int>(dayTotals.size());
+    g_revision++;
+}
+
+// Rebuilds the prefix arrays from DailyUsage.
+static void loadPrefixSums(sqlite3* dbHandle) {
+    g_firstDay = g_indexedThrough + 1;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT MIN(day) FROM DailyUsage;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            g_firstDay = std::min(g_firstDay, sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    std::vector<double> dayTotals;
+    std::unordered_map<std::string, std::vector<double>> processDays;
+    readDays(dbHandle, g_firstDay, g_indexedThrough, dayTotals, processDays);
+    g_totalPrefix.assign(1, 0.0);
+    g_processPrefix.clear();
+    g_indexedThrough = g_firstDay - 1;
+    extendPrefixSums(dayTotals, processDays);
+}
+
+// The newest day whose sessions are all closed: before today, and before the start
+// of any local session still open (one that runs across midnight).
+static int closedThroughDay(sqlite3* dbHandle) {
+    int lastDay = julianToDayNumber(getCurrentJulianDay()) - 1;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT MIN(startTime) FROM ActivitySession WHERE endTime IS NULL AND machineId IS NULL;",
+                           -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            lastDay = std::min(lastDay, julianToDayNumber(sqlite3_column_double(stmt, 0)) - 1);
+    }
+    sqlite3_finalize(stmt);
+    return lastDay;
+}
+
+static void onHistoryDaysChanged(int firstDay, int lastDay) {
+    if (g_repairLastDay < g_repairFirstDay) {
+        g_repairFirstDay = firstDay;
+        g_repairLastDay = lastDay;
+    } else {
+        g_repairFirstDay = std::min(g_repairFirstDay, firstDay);
+        g_repairLastDay = std::max(g_repairLastDay, lastDay);
+    }
+}
+
+void initDailyUsage() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    registerDayRepairHandler(onHistoryDaysChanged);
+
+    std::string stored = getMetaValue(kIndexedThroughKey);
+    if (!stored.empty()) {
+        g_indexedThrough = std::stoi(stored);
+        loadPrefixSums(dbHandle);
+        g_initialized = true;
+        return;
+    }
+
+    // First run: index everything that is already closed.
+    int firstDay = julianToDayNumber(getCurrentJulianDay());
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT MIN(startTime) FROM SessionHistory;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            firstDay = julianToDayNumber(sqlite3_column_double(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    int lastDay = closedThroughDay(dbHandle);
+    if (!indexDays(dbHandle, firstDay, lastDay))
+        return;
+    g_indexedThrough = std::max(lastDay, firstDay - 1);
+    setMetaValue(kIndexedThroughKey, std::to_string(g_indexedThrough));
+    loadPrefixSums(dbHandle);
+    g_initialized = true;
+}
+
+void runDailyUsageMaintenance() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+
+    if (g_repairLastDay >= g_repairFirstDay) {
+        int lastDay = std::min(g_repairLastDay, g_indexedThrough);
+        if (indexDays(dbHandle, g_repairFirstDay, lastDay))
+            loadPrefixSums(dbHandle);
+        g_repairFirstDay = 0;
+        g_repairLastDay = -1;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - g_lastAppendCheck < std::chrono::minutes(1))
+        return;
+    g_lastAppendCheck = now;
+    int lastDay = closedThroughDay(dbHandle);
+    if (lastDay <= g_indexedThrough)
+        return;
+    int firstDay = g_indexedThrough + 1;
+    if (!indexDays(dbHandle, firstDay, lastDay))
+        return;
+    std::vector<double> dayTotals;
+    std::unordered_map<std::string, std::vector<double>> processDays;
+    readDays(dbHandle, firstDay, lastDay, dayTotals, processDays);
+    extendPrefixSums(dayTotals, processDays);
+    setMetaValue(kIndexedThroughKey, std::to_string(g_indexedThrough));
+}
+
+// Adds sessions started in days [firstDay, lastDay] straight from SessionHistory.
+// Only used for the few closed days the index has not caught up with yet.
+static void addUnindexedDays(sqlite3* dbHandle, int firstDay, int lastDay,
+                             std::unordered_map<std::string, double>& totals, double& totalTime) {
+    const char* sql = R"(
+        SELECT processName, SUM((COALESCE(endTime, ?3) - startTime) * 86400.0)
+        FROM SessionHistory
+        WHERE startTime >= ?1 AND startTime < ?2
+        GROUP BY processName;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare unindexed day query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_double(stmt, 1, dayNumberToJulian(firstDay));
+    sqlite3_bind_double(stmt, 2, dayNumberToJulian(lastDay + 1));
+    sqlite3_bind_double(stmt, 3, getCurrentJulianDay());
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
+        double seconds = sqlite3_column_double(stmt, 1);
+        totals[procName ? reinterpret_cast<const char*>(procName) : ""] += seconds;
+        totalTime += seconds;
+    }
+    sqlite3_finalize(stmt);
+}
+
+std::vector<RangeUsage> getRangeUsages(const std::vector<DayRange>& ranges) {
+    std::vector<RangeUsage> results(ranges.size());
+    std::vector<std::unordered_map<std::string, double>> totals(ranges.size());
+
+    // Indexed days: each range is a pair of offsets into the prefix arrays, so one pass
+    // over the processes serves every range.
+    std::vector<std::pair<size_t, size_t>> spans(ranges.size(), {0, 0});
+    for (size_t i = 0; i < ranges.size(); i++) {
+        int from = std::max(ranges[i].firstDay, g_firstDay);
+        int to = std::min(ranges[i].lastDay, g_indexedThrough);
+        if (from > to)
+            continue;
+        spans[i] = {static_cast<size_t>(from - g_firstDay), static_cast<size_t>(to - g_firstDay + 1)};
+        results[i].totalTime += g_totalPrefix[spans[i].second] - g_totalPrefix[spans[i].first];
+    }
+    for (const auto& entry : g_processPrefix) {
+        for (size_t i = 0; i < ranges.size(); i++) {
+            if (spans[i].first == spans[i].second)
+                continue;
+            double seconds = entry.second[spans[i].second] - entry.second[spans[i].first];
+            if (seconds > 0.0)
+                totals[i][entry.first] += seconds;
+        }
+    }
+
+    // Closed days the index has not reached yet, then today from the live aggregator.
+    int today = julianToDayNumber(getCurrentJulianDay());
+    sqlite3* dbHandle = getDatabase();
+    for (size_t i = 0; i < ranges.size(); i++) {
+        int from = std::max(ranges[i].firstDay, g_indexedThrough + 1);
+        int to = std::min(ranges[i].lastDay, today - 1);
+        if (from <= to && dbHandle)
+            addUnindexedDays(dbHandle, from, to, totals[i], results[i].totalTime);
+        if (ranges[i].firstDay <= today && today <= ranges[i].lastDay) {
+            results[i].totalTime += getLiveTotalTime(true);
+            for (const auto& app : getLiveProcessUsage(true))
+                totals[i][app.processName] += app.totalTime;
+        }
+
+        for (const auto& entry : totals[i]) {
+            ApplicationData app;
+            app.processName = entry.first;
+            app.totalTime = entry.second;
+            results[i].processes.push_back(app);
+        }
+        std::sort(results[i].processes.begin(), results[i].processes.end(),
+                  [](const ApplicationData& a, const ApplicationData& b) { return a.totalTime > b.totalTime; });
+    }
+    return results;
+}
+
+RangeUsage getRangeUsage(int firstDay, int lastDay) {
+    return getRangeUsages({DayRange{firstDay, lastDay}}).front();
+}
+
+double getIndexedRangeTotal(int firstDay, int lastDay) {
+    int from = std::max(firstDay, g_firstDay);
+    int to = std::min(lastDay, g_indexedThrough);
+    if (from > to)
+        return 0.0;
+    return g_totalPrefix[static_cast<size_t>(to - g_firstDay + 1)] - g_totalPrefix[static_cast<size_t>(from - g_firstDay)];
+}
+
+int getIndexedThroughDay() {
+    return g_indexedThrough;
+}
+
+size_t getIndexedProcessCount() {
+    return g_processPrefix.size();
+}
+
+unsigned long long getDailyUsageRevision() {
+    return g_revision;
+}
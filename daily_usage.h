@@ -0,0 +1,47 @@
+#ifndef DAILY_USAGE_H
+#define DAILY_USAGE_H
+
+#include <vector>
+
+#include "functions.h"
+
+// Per-day prefix sums over the DailyUsage table, so the total of any calendar range
+// is two array lookups (and two per process for the per-process totals).
+//
+// Closed days are indexed once their sessions are complete and the arrays are extended
+// incrementally as days close. Days that are not indexed yet (today, and a day whose
+// session is still open across midnight) are filled in from the live aggregator and a
+// small SQL query. Rewritten days reported through registerDayRepairHandler are re-indexed.
+// A day is the julianToDayNumber of a session's start, like every other day total.
+
+struct RangeUsage {
+    double totalTime = 0.0;
+    std::vector<ApplicationData> processes;  // Largest first.
+};
+
+// Loads the prefix sums, building DailyUsage on first run. Call after initDatabase.
+void initDailyUsage();
+
+struct DayRange {
+    int firstDay = 0;
+    int lastDay = -1;  // Inclusive.
+};
+
+// Total and per-process time for days [firstDay, lastDay] (inclusive day numbers).
+RangeUsage getRangeUsage(int firstDay, int lastDay);
+// getRangeUsage for several ranges in one pass over the prefix arrays.
+std::vector<RangeUsage> getRangeUsages(const std::vector<DayRange>& ranges);
+
+// Total time of the indexed days in [firstDay, lastDay], two array lookups.
+// Days after getIndexedThroughDay() are not included.
+double getIndexedRangeTotal(int firstDay, int lastDay);
+int getIndexedThroughDay();
+// Processes with a prefix array; a per-process range read touches each of them once.
+size_t getIndexedProcessCount();
+// Changes whenever indexed days are added or rewritten, for callers caching derived results.
+unsigned long long getDailyUsageRevision();
+
+// Called once per frame from the main loop; indexes newly closed days and applies repairs.
+void runDailyUsageMaintenance();
+
+#endif // DAILY_USAGE_H
@@ -1,10 +1,17 @@
 #include "database.h"
 #include <sqlite3.h>
+#include <atomic>
 #include <iostream>
 #include <string>
 
 // Global pointer for SQLite database.
 static sqlite3* db = nullptr;
+// Bumped after every write to session history (see getWriteGeneration).
+static std::atomic<unsigned long long> g_writeGeneration{1};
+// Path the database was opened from, used to open extra read connections.
+static std::string g_databasePath;
+
+static bool ensureColumn(const char* table, const char* column, const char* type);
 
 // Returns the current database handle.
 sqlite3* getDatabase() {
@@ -17,8 +24,14 @@ bool initDatabase(const std::string& dbPath) {
         std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
         return false;
     }
+    g_databasePath = dbPath;
+
+    // WAL lets background readers (see snapshot.cpp) scan history while the tracker writes.
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+    sqlite3_busy_timeout(db, 1000);
 
-    // Create the ActivitySession table if it doesn't exist.
+    // Create the ActivitySession table (plus the retention rollup table and the
+    // SessionHistory view over both) if they don't exist.
     // Instead of storing a DATETIME string, we store the timestamp as a REAL (julian day number)
     // using local time. This avoids timezone issues.
     std::string sql = R"(
@@ -29,6 +42,124 @@ bool initDatabase(const std::string& dbPath) {
             startTime REAL DEFAULT (julianday('now','localtime')),
             endTime REAL
         );
+        CREATE INDEX IF NOT EXISTS idx_session_start ON ActivitySession(startTime);
+
+        -- Downsampled history written by the retention engine (see retention.cpp).
+        -- Each row holds the seconds a process was focused inside one fixed-width bucket.
+        CREATE TABLE IF NOT EXISTS ActivityRollup (
+            processName TEXT NOT NULL,
+            bucketSeconds INTEGER NOT NULL,
+            bucketKey INTEGER NOT NULL,
+            startTime REAL NOT NULL,
+            totalTime REAL NOT NULL DEFAULT 0,
+            PRIMARY KEY (processName, bucketSeconds, bucketKey)
+        );
+        CREATE INDEX IF NOT EXISTS idx_rollup_start ON ActivityRollup(startTime);
+
+        -- Problems found and repaired by the background integrity scanner (see integrity.cpp).
+        CREATE TABLE IF NOT EXISTS IntegrityFinding (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            sessionId INTEGER,
+            kind TEXT,
+            detail TEXT,
+            foundAt REAL DEFAULT (julianday('now','localtime'))
+        );
+
+        -- Project tags. TagTime holds each tag's compressed bitmap of tagged seconds.
+        CREATE TABLE IF NOT EXISTS Tag (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            name TEXT UNIQUE NOT NULL
+        );
+        CREATE TABLE IF NOT EXISTS TagTime (
+            tagId INTEGER PRIMARY KEY,
+            spans BLOB
+        );
+
+        -- Small key/value store for settings and cursors (machine id, merge cursors, ...).
+        CREATE TABLE IF NOT EXISTS TrackerMeta (
+            key TEXT PRIMARY KEY,
+            value TEXT
+        );
+
+        -- Per-day, per-process totals of closed days, the base of the range prefix sums
+        -- (see daily_usage.cpp). Days are julianToDayNumber of the session start.
+        CREATE TABLE IF NOT EXISTS DailyUsage (
+            day INTEGER NOT NULL,
+            processName TEXT NOT NULL,
+            totalTime REAL NOT NULL,
+            PRIMARY KEY (day, processName)
+        );
+
+        -- App categories (see categories.cpp). Colors are packed ImU32 values (ABGR).
+        CREATE TABLE IF NOT EXISTS Process (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            name TEXT UNIQUE NOT NULL
+        );
+        CREATE TABLE IF NOT EXISTS Category (
+            id INTEGER PRIMARY KEY,
+            name TEXT UNIQUE NOT NULL,
+            color INTEGER NOT NULL
+        );
+        CREATE TABLE IF NOT EXISTS ProcessCategory (
+            processId INTEGER PRIMARY KEY,
+            categoryId INTEGER NOT NULL
+        );
+        INSERT OR IGNORE INTO Category (id, name, color) VALUES
+            (1, 'Productivity', 4292236888),
+            (2, 'Entertainment', 4292651572),
+            (3, 'Social', 4294625370),
+            (4, 'Communication', 4278228479),
+            (5, 'Reading', 4284267864),
+            (6, 'Creativity', 4283772415),
+            (7, 'Other', 4287860366);
+
+        -- Per-day HyperLogLog registers for distinct window and app counts
+        -- (see distinct_counts.cpp).
+        CREATE TABLE IF NOT EXISTS DaySketch (
+            day INTEGER PRIMARY KEY,
+            windows BLOB NOT NULL,
+            apps BLOB NOT NULL
+        );
+
+        -- Per-day, per-process session length histograms of stored closed days
+        -- (see session_lengths.cpp).
+        CREATE TABLE IF NOT EXISTS SessionLengthHistogram (
+            day INTEGER NOT NULL,
+            processName TEXT NOT NULL,
+            buckets BLOB NOT NULL,
+            PRIMARY KEY (day, processName)
+        );
+
+        -- Per-day app transition counts and per-hour switch counts of stored closed days
+        -- (see transitions.cpp).
+        CREATE TABLE IF NOT EXISTS DayTransition (
+            day INTEGER NOT NULL,
+            fromProcess TEXT NOT NULL,
+            toProcess TEXT NOT NULL,
+            count INTEGER NOT NULL,
+            PRIMARY KEY (day, fromProcess, toProcess)
+        );
+        CREATE TABLE IF NOT EXISTS HourSwitch (
+            day INTEGER NOT NULL,
+            hour INTEGER NOT NULL,
+            count INTEGER NOT NULL,
+            PRIMARY KEY (day, hour)
+        );
+
+        -- Detected deep work blocks (see focus_blocks.cpp).
+        CREATE TABLE IF NOT EXISTS FocusBlock (
+            startTime REAL PRIMARY KEY,
+            endTime REAL NOT NULL,
+            focusSeconds REAL NOT NULL
+        );
+
+        -- Every aggregate query reads from this view so that totals stay correct
+        -- across retention tiers. A bucket is exposed as a pseudo-session that
+        -- starts at the bucket boundary and lasts for the bucket's total time.
+        CREATE VIEW IF NOT EXISTS SessionHistory AS
+            SELECT processName, windowTitle, startTime, endTime FROM ActivitySession
+            UNION ALL
+            SELECT processName, NULL, startTime, startTime + totalTime / 86400.0 FROM ActivityRollup;
     )";
 
     char* errMsg = nullptr;
@@ -39,9 +170,107 @@ bool initDatabase(const std::string& dbPath) {
         return false;
     }
 
+    // Sessions merged from other machines (see sync.cpp) keep the id they had on their
+    // source machine. Local sessions leave both columns NULL.
+    if (!ensureColumn("ActivitySession", "machineId", "TEXT") ||
+        !ensureColumn("ActivitySession", "originId", "INTEGER")) {
+        return false;
+    }
+    const char* indexSql = R"(
+        CREATE UNIQUE INDEX IF NOT EXISTS idx_session_origin
+            ON ActivitySession(machineId, originId) WHERE machineId IS NOT NULL;
+
+        -- Rows another machine merged in itself, by that machine's id for them. Its later
+        -- updates name a row only by that id; this leads them to the same row here.
+        CREATE TABLE IF NOT EXISTS SyncAlias (
+            machineId TEXT NOT NULL,
+            remoteId INTEGER NOT NULL,
+            ownerId TEXT NOT NULL,
+            originId INTEGER NOT NULL,
+            PRIMARY KEY (machineId, remoteId)
+        );
+    )";
+    rc = sqlite3_exec(db, indexSql, nullptr, nullptr, &errMsg);
+    if (rc != SQLITE_OK) {
+        std::cerr << "SQL error: " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+
     return true;
 }
 
+// Adds a column to an existing table if an older database was created without it.
+static bool ensureColumn(const char* table, const char* column, const char* type) {
+    std::string pragma = std::string("PRAGMA table_info(") + table + ");";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, pragma.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read schema of " << table << ": " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    bool found = false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        if (name && std::string(reinterpret_cast<const char*>(name)) == column)
+            found = true;
+    }
+    sqlite3_finalize(stmt);
+    if (found)
+        return true;
+
+    std::string alter = std::string("ALTER TABLE ") + table + " ADD COLUMN " + column + " " + type + ";";
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, alter.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Failed to add column " << column << ": " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+std::string getMetaValue(const std::string& key, const std::string& defaultValue) {
+    return getMetaValue(db, key, defaultValue);
+}
+
+bool setMetaValue(const std::string& key, const std::string& value) {
+    return setMetaValue(db, key, value);
+}
+
+std::string getMetaValue(sqlite3* connection, const std::string& key, const std::string& defaultValue) {
+    if (!connection)
+        return defaultValue;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(connection, "SELECT value FROM TrackerMeta WHERE key = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare meta query: " << sqlite3_errmsg(connection) << std::endl;
+        return defaultValue;
+    }
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    std::string value = defaultValue;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* text = sqlite3_column_text(stmt, 0);
+        value = text ? reinterpret_cast<const char*>(text) : "";
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+bool setMetaValue(sqlite3* connection, const std::string& key, const std::string& value) {
+    if (!connection)
+        return false;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(connection, "INSERT OR REPLACE INTO TrackerMeta (key, value) VALUES (?, ?);", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare meta update: " << sqlite3_errmsg(connection) << std::endl;
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok)
+        std::cerr << "Failed to store meta value " << key << ": " << sqlite3_errmsg(connection) << std::endl;
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
 bool startSession(const std::string& processName, const std::string& windowTitle, int & sessionId) {
     // When a new session is started, we insert processName and windowTitle.
     // The startTime is automatically set by the DEFAULT clause.
@@ -68,6 +297,7 @@ bool startSession(const std::string& processName, const std::string& windowTitle
     sqlite3_finalize(stmt);
     // Retrieve the last inserted row id as the session id.
     sessionId = static_cast<int>(sqlite3_last_insert_rowid(db));
+    bumpWriteGeneration();
     return true;
 }
 
@@ -93,9 +323,44 @@ bool endSession(int sessionId) {
     }
 
     sqlite3_finalize(stmt);
+    bumpWriteGeneration();
     return true;
 }
 
+sqlite3* openReadConnection() {
+    if (g_databasePath.empty())
+        return nullptr;
+    sqlite3* reader = nullptr;
+    if (sqlite3_open_v2(g_databasePath.c_str(), &reader, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Cannot open read connection: " << sqlite3_errmsg(reader) << std::endl;
+        sqlite3_close(reader);
+        return nullptr;
+    }
+    sqlite3_busy_timeout(reader, 1000);
+    return reader;
+}
+
+sqlite3* openWriteConnection() {
+    if (g_databasePath.empty())
+        return nullptr;
+    sqlite3* writer = nullptr;
+    if (sqlite3_open_v2(g_databasePath.c_str(), &writer, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        std::cerr << "Cannot open write connection: " << sqlite3_errmsg(writer) << std::endl;
+        sqlite3_close(writer);
+        return nullptr;
+    }
+    sqlite3_busy_timeout(writer, 1000);
+    return writer;
+}
+
+unsigned long long getWriteGeneration() {
+    return g_writeGeneration.load(std::memory_order_acquire);
+}
+
+void bumpWriteGeneration() {
+    g_writeGeneration.fetch_add(1, std::memory_order_acq_rel);
+}
+
 void closeDatabase() {
     if (db) {
         sqlite3_close(db);
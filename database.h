@@ -4,7 +4,8 @@
 #include <sqlite3.h>
 #include <string>
 
-// Initializes the SQLite database and creates the ActivitySession table.
+// Initializes the SQLite database and creates the ActivitySession table,
+// the supporting tables (rollups, integrity findings, tags, meta) and the SessionHistory view.
 bool initDatabase(const std::string& dbPath);
 
 // Starts a new session and returns the session id via 'sessionId'.
@@ -13,9 +14,28 @@ bool startSession(const std::string& processName, const std::string& windowTitle
 // Ends an existing session by updating its end time.
 bool endSession(int sessionId);
 
+// Monotonic counter bumped by every write to session history. Cached results
+// computed at an older generation are stale.
+unsigned long long getWriteGeneration();
+void bumpWriteGeneration();
+
 // Closes the database connection.
 void closeDatabase();
 
 sqlite3* getDatabase();
 
+// Opens a separate read-only connection to the same database for use on another thread.
+// The caller closes it with sqlite3_close.
+sqlite3* openReadConnection();
+// Opens a separate read-write connection for background writers. WAL keeps their
+// transactions from blocking readers; writers still take turns. Close with sqlite3_close.
+sqlite3* openWriteConnection();
+
+// Reads and writes entries of the TrackerMeta key/value table.
+std::string getMetaValue(const std::string& key, const std::string& defaultValue = "");
+bool setMetaValue(const std::string& key, const std::string& value);
+// The same, on a connection opened with openReadConnection or openWriteConnection.
+std::string getMetaValue(sqlite3* connection, const std::string& key, const std::string& defaultValue = "");
+bool setMetaValue(sqlite3* connection, const std::string& key, const std::string& value);
+
 #endif
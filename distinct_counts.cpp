@@ -0,0 +1,282 @@
+#include "distinct_counts.h"
+
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include "retention.h"
+#include "hyperloglog.h"
+#include "tracker.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+// 4 KB per day for windows (about 1.6% error) and 1 KB for apps (about 3.3%, though a
+// day's handful of apps is counted almost exactly by the small-range correction).
+static const int kWindowPrecision = 12;
+static const int kAppPrecision = 10;
+
+struct DaySketches {
+    HyperLogLog windows{kWindowPrecision};
+    HyperLogLog apps{kAppPrecision};
+};
+
+static std::map<int, DaySketches> g_days;
+static std::set<int> g_unsavedDays;
+// Days rewritten since the last maintenance pass.
+static int g_repairFirstDay = 0;
+static int g_repairLastDay = -1;
+static std::chrono::steady_clock::time_point g_lastSave;
+static bool g_initialized = false;
+
+// Bumped whenever a sketch changes, so repeated range queries can reuse their results.
+static unsigned long long g_version = 0;
+static unsigned long long g_cachedVersion = 0;
+static std::map<std::pair<int, int>, DistinctCounts> g_cachedCounts;
+
+// Sessions started on or after this day are added again at startup, covering any
+// that were added in memory after the last save. Adding a session twice is harmless.
+static const char* kRefoldFromKey = "distinct.refoldFrom";
+static int g_savedRefoldDay = 0;
+
+static void addSession(const char* processName, const char* windowTitle, double startTime) {
+    int day = julianToDayNumber(startTime);
+    DaySketches& sketches = g_days[day];
+    std::string_view process = processName ? processName : "";
+    sketches.apps.add(hashSketchValue(process));
+    // Rollup rows have no title.
+    if (windowTitle)
+        sketches.windows.add(hashSketchValue(process, windowTitle));
+    g_unsavedDays.insert(day);
+    g_version++;
+}
+
+// Adds every session started in [fromJD, toJD).
+static bool addHistory(sqlite3* dbHandle, double fromJD, double toJD) {
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT processName, windowTitle, startTime FROM SessionHistory WHERE startTime >= ? AND startTime < ?;";
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare distinct count query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, fromJD);
+    sqlite3_bind_double(stmt, 2, toJD);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        addSession(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                   reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                   sqlite3_column_double(stmt, 2));
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+static void onHistoryDaysChanged(int firstDay, int lastDay) {
+    if (isRawDerivedDayFrozen(firstDay))
+        firstDay = getCompactedThroughDay() + 1;
+    if (lastDay < firstDay)
+        return;
+    if (g_repairLastDay < g_repairFirstDay) {
+        g_repairFirstDay = firstDay;
+        g_repairLastDay = lastDay;
+    } else {
+        g_repairFirstDay = std::min(g_repairFirstDay, firstDay);
+        g_repairLastDay = std::max(g_repairLastDay, lastDay);
+    }
+}
+
+// Applies a bulk edit to the sketches of frozen days, rebuilding their app sketches from
+// SessionHistory. Rollups have no titles, so a rename keeps the window sketch, and a
+// delete rebuilds it with one window per remaining app.
+static void onFrozenDaysEdited(const BulkEditRequest& request, int firstDay, int lastDay) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle)
+        return;
+    bool rebuildWindows = request.kind == BulkEditRequest::Delete;
+    for (auto day = g_days.lower_bound(firstDay); day != g_days.end() && day->first <= lastDay; ++day) {
+        day->second.apps = HyperLogLog(kAppPrecision);
+        if (rebuildWindows)
+            day->second.windows = HyperLogLog(kWindowPrecision);
+        g_unsavedDays.insert(day->first);
+    }
+    g_version++;
+
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT processName, windowTitle, startTime FROM SessionHistory WHERE startTime >= ? AND startTime < ?;";
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare distinct count query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_double(stmt, 1, dayNumberToJulian(firstDay));
+    sqlite3_bind_double(stmt, 2, dayNumberToJulian(lastDay + 1));
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto day = g_days.find(julianToDayNumber(sqlite3_column_double(stmt, 2)));
+        if (day == g_days.end())
+            continue;
+        const char* processName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* windowTitle = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        std::string_view process = processName ? processName : "";
+        day->second.apps.add(hashSketchValue(process));
+        if (rebuildWindows)
+            day->second.windows.add(hashSketchValue(process, windowTitle ? windowTitle : ""));
+    }
+    sqlite3_finalize(stmt);
+}
+
+static void loadSketches(sqlite3* dbHandle) {
+    g_days.clear();
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT day, windows, apps FROM DaySketch;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read distinct count sketches: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        DaySketches sketches;
+        if (!sketches.windows.loadRegisters(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1)) ||
+            !sketches.apps.loadRegisters(sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2))) {
+            // Written with another precision; rebuild the day from history.
+            onHistoryDaysChanged(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 0));
+            continue;
+        }
+        g_days[sqlite3_column_int(stmt, 0)] = std::move(sketches);
+    }
+    sqlite3_finalize(stmt);
+}
+
+// Writes the days changed since the last save, and the day to refold from at startup.
+static bool saveSketches(sqlite3* dbHandle) {
+    int refoldDay = julianToDayNumber(getCurrentJulianDay());
+    if (g_unsavedDays.empty() && refoldDay == g_savedRefoldDay)
+        return true;
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* upsert = nullptr;
+    sqlite3_stmt* remove = nullptr;
+    bool ok = sqlite3_prepare_v2(dbHandle, "INSERT OR REPLACE INTO DaySketch (day, windows, apps) VALUES (?, ?, ?);",
+                                 -1, &upsert, nullptr) == SQLITE_OK &&
+              sqlite3_prepare_v2(dbHandle, "DELETE FROM DaySketch WHERE day = ?;", -1, &remove, nullptr) == SQLITE_OK;
+    for (auto day = g_unsavedDays.begin(); ok && day != g_unsavedDays.end(); ++day) {
+        auto found = g_days.find(*day);
+        if (found == g_days.end()) {
+            sqlite3_bind_int(remove, 1, *day);
+            ok = sqlite3_step(remove) == SQLITE_DONE;
+            sqlite3_reset(remove);
+            continue;
+        }
+        const auto& windows = found->second.windows.registers();
+        const auto& apps = found->second.apps.registers();
+        sqlite3_bind_int(upsert, 1, *day);
+        sqlite3_bind_blob(upsert, 2, windows.data(), static_cast<int>(windows.size()), SQLITE_STATIC);
+        sqlite3_bind_blob(upsert, 3, apps.data(), static_cast<int>(apps.size()), SQLITE_STATIC);
+        ok = sqlite3_step(upsert) == SQLITE_DONE;
+        sqlite3_reset(upsert);
+    }
+    sqlite3_finalize(upsert);
+    sqlite3_finalize(remove);
+    if (!ok) {
+        std::cerr << "Failed to save distinct count sketches: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    g_unsavedDays.clear();
+    if (setMetaValue(kRefoldFromKey, std::to_string(refoldDay)))
+        g_savedRefoldDay = refoldDay;
+    return true;
+}
+
+// The window title is fixed for the life of a session, so it is counted when it opens.
+static void onSessionOpened(const SessionEvent& event) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT processName, windowTitle, startTime FROM ActivitySession WHERE id = ?;",
+                           -1, &stmt, nullptr) != SQLITE_OK)
+        return;
+    sqlite3_bind_int(stmt, 1, event.sessionId);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        addSession(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                   reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                   sqlite3_column_double(stmt, 2));
+    }
+    sqlite3_finalize(stmt);
+}
+
+void initDistinctCounts() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    registerDayRepairHandler(onHistoryDaysChanged);
+    registerFrozenDayEditHandler(onFrozenDaysEdited);
+    addSessionOpenListener(onSessionOpened);
+
+    // First run: every day of history. Later: the sessions since the last save.
+    double fromJD = 0.0;
+    std::string stored = getMetaValue(kRefoldFromKey);
+    if (!stored.empty()) {
+        loadSketches(dbHandle);
+        g_savedRefoldDay = std::stoi(stored);
+        fromJD = dayNumberToJulian(g_savedRefoldDay);
+    }
+    if (!addHistory(dbHandle, fromJD, getCurrentJulianDay() + 1.0))
+        return;
+    saveSketches(dbHandle);
+    g_lastSave = std::chrono::steady_clock::now();
+    g_initialized = true;
+}
+
+void runDistinctCountMaintenance() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+
+    if (g_repairLastDay >= g_repairFirstDay) {
+        auto first = g_days.lower_bound(g_repairFirstDay);
+        auto last = g_days.upper_bound(g_repairLastDay);
+        for (auto it = first; it != last; ++it)
+            g_unsavedDays.insert(it->first);
+        g_days.erase(first, last);
+        g_version++;
+        addHistory(dbHandle, dayNumberToJulian(g_repairFirstDay), dayNumberToJulian(g_repairLastDay + 1));
+        g_repairFirstDay = 0;
+        g_repairLastDay = -1;
+        saveSketches(dbHandle);
+        g_lastSave = std::chrono::steady_clock::now();
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - g_lastSave < std::chrono::minutes(1))
+        return;
+    g_lastSave = now;
+    saveSketches(dbHandle);
+}
+
+DistinctCounts getDistinctCounts(int firstDay, int lastDay) {
+    if (g_cachedVersion != g_version) {
+        g_cachedCounts.clear();
+        g_cachedVersion = g_version;
+    }
+    auto cached = g_cachedCounts.find({firstDay, lastDay});
+    if (cached != g_cachedCounts.end())
+        return cached->second;
+
+    HyperLogLog windows(kWindowPrecision);
+    HyperLogLog apps(kAppPrecision);
+    for (auto it = g_days.lower_bound(firstDay); it != g_days.end() && it->first <= lastDay; ++it) {
+        windows.merge(it->second.windows);
+        apps.merge(it->second.apps);
+    }
+    DistinctCounts counts;
+    counts.windows = windows.estimate();
+    counts.apps = apps.estimate();
+    counts.windowError = windows.relativeError();
+    counts.appError = apps.relativeError();
+
+    g_cachedCounts[{firstDay, lastDay}] = counts;
+    return counts;
+}
@@ -0,0 +1,33 @@
+#ifndef DISTINCT_COUNTS_H
+#define DISTINCT_COUNTS_H
+
+// Approximate distinct windows and apps per day, kept as HyperLogLog sketches.
+//
+// Every day has one sketch of (process, window title) pairs and one of process names,
+// stored in DaySketch. Sessions are added as the tracker opens them, so today is always
+// current; a range is the merge of its days, O(days) with no scan of SessionHistory.
+// Days rewritten through registerDayRepairHandler are rebuilt from SessionHistory.
+// Retention rollups carry no window title, so sketches built before a day was rolled up
+// keep counting its windows. Those days are never rebuilt from rollups by a repair
+// (see isRawDerivedDayFrozen); a bulk edit of one rebuilds its app sketch, and after a
+// delete its window sketch holds one window per remaining app.
+// A day is the julianToDayNumber of a session's start, like every other day total.
+
+struct DistinctCounts {
+    double windows = 0.0;      // Distinct (process, window title) pairs.
+    double apps = 0.0;         // Distinct process names.
+    double windowError = 0.0;  // Relative standard error of each estimate.
+    double appError = 0.0;
+};
+
+// Loads the sketches, building DaySketch on first run, and subscribes to tracker events.
+// Call after initDatabase.
+void initDistinctCounts();
+
+// Estimates for days [firstDay, lastDay] (inclusive day numbers).
+DistinctCounts getDistinctCounts(int firstDay, int lastDay);
+
+// Called once per frame from the main loop; rebuilds repaired days and saves changed ones.
+void runDistinctCountMaintenance();
+
+#endif // DISTINCT_COUNTS_H
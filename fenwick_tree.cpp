@@ -0,0 +1,32 @@
+#include "fenwick_tree.h"
+
+#include <algorithm>
+
+FenwickTree FenwickTree::fromValues(const std::vector<double>& values) {
+    FenwickTree result(values.size());
+    for (size_t i = 1; i <= values.size(); i++) {
+        result.tree_[i] += values[i - 1];
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= values.size())
+            result.tree_[parent] += result.tree_[i];
+    }
+    return result;
+}
+
+void FenwickTree::add(size_t index, double value) {
+    for (size_t i = index + 1; i < tree_.size(); i += i & (~i + 1))
+        tree_[i] += value;
+}
+
+double FenwickTree::prefixSum(size_t end) const {
+    double sum = 0.0;
+    for (size_t i = std::min(end, size()); i > 0; i -= i & (~i + 1))
+        sum += tree_[i];
+    return sum;
+}
+
+double FenwickTree::rangeSum(size_t begin, size_t end) const {
+    if (end <= begin)
+        return 0.0;
+    return prefixSum(end) - prefixSum(begin);
+}
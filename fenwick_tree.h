@@ -0,0 +1,26 @@
+#ifndef FENWICK_TREE_H
+#define FENWICK_TREE_H
+
+#include <cstddef>
+#include <vector>
+
+// Binary indexed tree over a fixed number of slots.
+// Point updates and prefix/range sums are O(log n); building from values is O(n).
+class FenwickTree {
+public:
+    FenwickTree() = default;
+    explicit FenwickTree(size_t size) : tree_(size + 1, 0.0) {}
+    static FenwickTree fromValues(const std::vector<double>& values);
+
+    size_t size() const { return tree_.empty() ? 0 : tree_.size() - 1; }
+    void add(size_t index, double value);
+    // Sum of slots [0, end).
+    double prefixSum(size_t end) const;
+    // Sum of slots [begin, end).
+    double rangeSum(size_t begin, size_t end) const;
+
+private:
+    std::vector<double> tree_;  // 1-based; tree_[0] is unused.
+};
+
+#endif // FENWICK_TREE_H
@@ -0,0 +1,414 @@
+#include "focus_blocks.h"
+
+#include "categories.h"
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include "retention.h"
+#include "tracker.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+static const double kMaxInterruptionSeconds = 5 * 60.0;
+static const double kMinBlockSeconds = 25 * 60.0;
+static const double kMinFocusShare = 0.8;
+
+// Streaming block detector. Sessions must arrive in start order; each one is O(1).
+class FocusDetector {
+public:
+    // idleSince: the detector has seen nothing productive before this time.
+    explicit FocusDetector(double idleSince = 0.0) : lastEnd_(idleSince) {}
+
+    // Consumes the next session. Returns true and fills finished when a block ends.
+    bool consume(double startTime, double endTime, bool productive, FocusBlock& finished) {
+        lastEnd_ = std::max(lastEnd_, endTime);
+        bool closed = false;
+        // A gap before this session (idle time, or missing sessions) is an interruption too.
+        if (active_ && (startTime - productiveEnd_) * 86400.0 > kMaxInterruptionSeconds)
+            closed = finish(finished);
+        if (productive) {
+            if (!active_) {
+                active_ = true;
+                blockStart_ = startTime;
+                focusSeconds_ = 0.0;
+            }
+            focusSeconds_ += std::max(0.0, endTime - startTime) * 86400.0;
+            productiveEnd_ = std::max(productiveEnd_, endTime);
+        } else if (active_ && (endTime - productiveEnd_) * 86400.0 > kMaxInterruptionSeconds) {
+            closed = finish(finished);
+        }
+        return closed;
+    }
+
+    // The block in progress, if it already qualifies.
+    bool current(FocusBlock& block) const {
+        if (!active_ || !qualifies())
+            return false;
+        block = FocusBlock{blockStart_, productiveEnd_, focusSeconds_};
+        return true;
+    }
+
+    // Sessions starting at or after this time are all that can still change the output:
+    // the detector is idle before it.
+    double resumePoint() const { return active_ ? blockStart_ : lastEnd_; }
+
+private:
+    bool qualifies() const {
+        double seconds = (productiveEnd_ - blockStart_) * 86400.0;
+        return seconds >= kMinBlockSeconds && focusSeconds_ >= kMinFocusShare * seconds;
+    }
+
+    bool finish(FocusBlock& finished) {
+        active_ = false;
+        if (!qualifies())
+            return false;
+        finished = FocusBlock{blockStart_, productiveEnd_, focusSeconds_};
+        return true;
+    }
+
+    bool active_ = false;
+    double blockStart_ = 0.0;
+    double productiveEnd_ = 0.0;
+    double focusSeconds_ = 0.0;
+    double lastEnd_ = 0.0;
+};
+
+struct FocusOpenSession {
+    int sessionId;  // ActivitySession row id.
+    std::string processName;
+    double startTime;
+};
+
+static FocusDetector g_detector;
+static std::vector<FocusOpenSession> g_openSessions;
+static int g_focusCategory = -1;
+static unsigned long long g_seenGeneration = 0;
+static bool g_initialized = false;
+static bool g_dirty = false;
+// Earliest time rewritten since the last maintenance pass; negative if none.
+static double g_repairFrom = -1.0;
+static double g_savedResume = -1.0;
+static std::chrono::steady_clock::time_point g_lastDetect;
+static std::chrono::steady_clock::time_point g_lastSaveCheck;
+
+// Stored blocks of the last range asked for, reloaded when blocks change.
+static unsigned long long g_version = 1;
+static unsigned long long g_cachedVersion = 0;
+static double g_cachedStart = 0.0;
+static double g_cachedEnd = 0.0;
+static std::vector<FocusBlock> g_cachedBlocks;
+static std::vector<FocusBlock> g_blocks;
+
+static const char* kResumeFromKey = "focus.resumeFrom";
+
+static bool isProductive(const std::string& processName) {
+    return g_focusCategory >= 0 && getProcessCategory(processName) == g_focusCategory;
+}
+
+static bool insertBlock(sqlite3* dbHandle, const FocusBlock& block) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "INSERT OR REPLACE INTO FocusBlock (startTime, endTime, focusSeconds) VALUES (?, ?, ?);",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare focus block insert: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, block.startTime);
+    sqlite3_bind_double(stmt, 2, block.endTime);
+    sqlite3_bind_double(stmt, 3, block.focusSeconds);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    if (!ok)
+        std::cerr << "Failed to store focus block: " << sqlite3_errmsg(dbHandle) << std::endl;
+    g_version++;
+    return ok;
+}
+
+static void saveResumePoint() {
+    double resume = g_detector.resumePoint();
+    if (resume == g_savedResume)
+        return;
+    // Full precision, since the resume point is compared against session start times.
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", resume);
+    if (setMetaValue(kResumeFromKey, buffer))
+        g_savedResume = resume;
+}
+
+// Replaces the blocks from fromTime on by running a fresh detector over the sessions
+// from there, in one ordered pass. Moves fromTime back to the start of a block crossing it.
+static bool detectFrom(sqlite3* dbHandle, double fromTime) {
+    g_seenGeneration = getWriteGeneration();
+    g_lastDetect = std::chrono::steady_clock::now();
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT MIN(startTime) FROM FocusBlock WHERE endTime > ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, fromTime);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            fromTime = std::min(fromTime, sqlite3_column_double(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    stmt = nullptr;
+    bool ok = sqlite3_prepare_v2(dbHandle, "DELETE FROM FocusBlock WHERE startTime >= ?;", -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_double(stmt, 1, fromTime);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+
+    FocusDetector detector(fromTime);
+    const char* sql = R"(
+        SELECT COALESCE(processName, ''), startTime, endTime FROM ActivitySession
+        WHERE machineId IS NULL AND endTime IS NOT NULL AND startTime >= ?
+        ORDER BY startTime;
+    )";
+    stmt = nullptr;
+    if (ok && sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, fromTime);
+        FocusBlock finished;
+        while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string processName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            if (detector.consume(sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2),
+                                 isProductive(processName), finished))
+                ok = insertBlock(dbHandle, finished);
+        }
+    } else {
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!ok) {
+        std::cerr << "Failed to detect focus blocks: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    g_detector = detector;
+    g_version++;
+
+    g_openSessions.clear();
+    const char* openSql = R"(
+        SELECT id, COALESCE(processName, ''), startTime FROM ActivitySession
+        WHERE endTime IS NULL AND machineId IS NULL;
+    )";
+    stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, openSql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            g_openSessions.push_back(FocusOpenSession{sqlite3_column_int(stmt, 0),
+                                                      reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                                                      sqlite3_column_double(stmt, 2)});
+        }
+    }
+    sqlite3_finalize(stmt);
+    g_dirty = false;
+    saveResumePoint();
+    return true;
+}
+
+// True when the event's write is the only one since the detector was last brought up to date.
+static bool claimEventWrite() {
+    unsigned long long generation = getWriteGeneration();
+    if (!g_initialized || generation != g_seenGeneration + 1) {
+        g_dirty = true;
+        return false;
+    }
+    g_seenGeneration = generation;
+    return true;
+}
+
+static void onSessionOpened(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    g_openSessions.push_back(FocusOpenSession{event.sessionId, event.processName, event.time});
+}
+
+static void onSessionClosed(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    auto it = std::find_if(g_openSessions.begin(), g_openSessions.end(),
+                           [&](const FocusOpenSession& s) { return s.sessionId == event.sessionId; });
+    if (it == g_openSessions.end()) {
+        g_dirty = true;
+        return;
+    }
+    FocusBlock finished;
+    sqlite3* dbHandle = getDatabase();
+    if (g_detector.consume(it->startTime, event.time, isProductive(it->processName), finished) && dbHandle)
+        insertBlock(dbHandle, finished);
+    g_openSessions.erase(it);
+}
+
+// Start of the first day that is not frozen (see isRawDerivedDayFrozen).
+static double rebuildFloor() {
+    int compactedThrough = getCompactedThroughDay();
+    return compactedThrough == INT_MIN ? 0.0 : dayNumberToJulian(compactedThrough + 1);
+}
+
+static void onHistoryDaysChanged(int firstDay, int) {
+    double from = std::max(dayNumberToJulian(firstDay), rebuildFloor());
+    g_repairFrom = g_repairFrom < 0.0 ? from : std::min(g_repairFrom, from);
+}
+
+// Detects the blocks of frozen days [firstDay, lastDay] again after a bulk edit, from
+// their rollup buckets; those are all that is left of their sessions. A block running
+// past lastDay is cut off there.
+static void onFrozenDaysEdited(const BulkEditRequest&, int firstDay, int lastDay) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+    double fromTime = dayNumberToJulian(firstDay);
+    double toTime = dayNumberToJulian(lastDay + 1);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT MIN(startTime) FROM FocusBlock WHERE endTime > ? AND startTime < ?;",
+                           -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, fromTime);
+        sqlite3_bind_double(stmt, 2, toTime);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            fromTime = std::min(fromTime, sqlite3_column_double(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    stmt = nullptr;
+    bool ok = sqlite3_prepare_v2(dbHandle, "DELETE FROM FocusBlock WHERE startTime >= ? AND startTime < ?;",
+                                 -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_double(stmt, 1, fromTime);
+        sqlite3_bind_double(stmt, 2, toTime);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+
+    FocusDetector detector(fromTime);
+    const char* sql = R"(
+        SELECT COALESCE(processName, ''), startTime, endTime FROM SessionHistory
+        WHERE endTime IS NOT NULL AND startTime >= ? AND startTime < ?
+        ORDER BY startTime;
+    )";
+    stmt = nullptr;
+    if (ok && sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, fromTime);
+        sqlite3_bind_double(stmt, 2, toTime);
+        FocusBlock finished;
+        while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string processName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            if (detector.consume(sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2),
+                                 isProductive(processName), finished))
+                ok = insertBlock(dbHandle, finished);
+        }
+        if (ok && detector.current(finished))
+            ok = insertBlock(dbHandle, finished);
+    } else {
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!ok) {
+        std::cerr << "Failed to detect focus blocks: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    g_version++;
+}
+
+void initFocusBlocks() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    registerDayRepairHandler(onHistoryDaysChanged);
+    registerFrozenDayEditHandler(onFrozenDaysEdited);
+    addSessionOpenListener(onSessionOpened);
+    addSessionCloseListener(onSessionClosed);
+
+    const std::vector<CategoryInfo>& categories = getCategories();
+    for (size_t i = 0; i < categories.size(); i++) {
+        if (categories[i].name == "Productivity")
+            g_focusCategory = static_cast<int>(i);
+    }
+
+    // First run: the whole history, in one pass.
+    std::string stored = getMetaValue(kResumeFromKey);
+    g_savedResume = stored.empty() ? -1.0 : std::stod(stored);
+    detectFrom(dbHandle, stored.empty() ? 0.0 : g_savedResume);
+    g_lastSaveCheck = std::chrono::steady_clock::now();
+    g_initialized = true;
+}
+
+void rebuildFocusBlocks() {
+    sqlite3* dbHandle = getDatabase();
+    if (dbHandle && g_initialized)
+        detectFrom(dbHandle, rebuildFloor());
+}
+
+void runFocusBlockMaintenance() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+
+    if (getWriteGeneration() != g_seenGeneration)
+        g_dirty = true;
+    auto now = std::chrono::steady_clock::now();
+    // A repair is also a write the events missed. Imports and repairs arrive in bursts,
+    // so detect again at most every few seconds.
+    if (g_dirty && now - g_lastDetect >= std::chrono::seconds(5)) {
+        double from = g_detector.resumePoint();
+        if (g_repairFrom >= 0.0)
+            from = std::min(from, g_repairFrom);
+        g_repairFrom = -1.0;
+        detectFrom(dbHandle, from);
+    }
+
+    if (now - g_lastSaveCheck < std::chrono::minutes(1))
+        return;
+    g_lastSaveCheck = now;
+    saveResumePoint();
+}
+
+const std::vector<FocusBlock>& getFocusBlocks(double startTime, double endTime) {
+    sqlite3* dbHandle = getDatabase();
+    if (dbHandle && (g_cachedVersion != g_version || g_cachedStart != startTime || g_cachedEnd != endTime)) {
+        g_cachedBlocks.clear();
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql = R"(
+            SELECT startTime, endTime, focusSeconds FROM FocusBlock
+            WHERE startTime < ? AND endTime > ? ORDER BY startTime;
+        )";
+        if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_double(stmt, 1, endTime);
+            sqlite3_bind_double(stmt, 2, startTime);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                g_cachedBlocks.push_back(FocusBlock{sqlite3_column_double(stmt, 0), sqlite3_column_double(stmt, 1),
+                                                    sqlite3_column_double(stmt, 2)});
+            }
+        } else {
+            std::cerr << "Failed to read focus blocks: " << sqlite3_errmsg(dbHandle) << std::endl;
+        }
+        sqlite3_finalize(stmt);
+        g_cachedVersion = g_version;
+        g_cachedStart = startTime;
+        g_cachedEnd = endTime;
+    }
+
+    // The block in progress, as if the open session closed now.
+    g_blocks = g_cachedBlocks;
+    FocusDetector detector = g_detector;
+    FocusBlock block;
+    bool found = false;
+    if (!g_openSessions.empty()) {
+        const FocusOpenSession& open = g_openSessions.back();
+        found = detector.consume(open.startTime, getCurrentJulianDay(), isProductive(open.processName), block);
+    }
+    if (!found)
+        found = detector.current(block);
+    if (found && block.startTime < endTime && block.endTime > startTime)
+        g_blocks.push_back(block);
+    return g_blocks;
+}
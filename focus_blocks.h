@@ -0,0 +1,37 @@
+#ifndef FOCUS_BLOCKS_H
+#define FOCUS_BLOCKS_H
+
+#include <vector>
+
+// "Deep work" blocks: spans of this machine's sessions dominated by Productivity apps.
+//
+// A streaming detector consumes sessions in start order. A block starts at a productive
+// session and ends once more than five minutes pass without one (idle time or other apps).
+// It is kept if it lasts at least 25 minutes and productive apps had 80% of it.
+// The live detector is fed by tracker close events with O(1) work per event. History is
+// recomputed in one ordered pass from the last point the detector was idle, after a
+// repair, or when a write was missed. Blocks are stored in FocusBlock. Blocks are not
+// recomputed when categories change; use rebuildFocusBlocks for that.
+
+struct FocusBlock {
+    double startTime = 0.0;     // Julian day (localtime).
+    double endTime = 0.0;
+    double focusSeconds = 0.0;  // Time in productive apps inside the block.
+};
+
+// Loads the detector state, detecting blocks in history not seen yet, and subscribes to
+// tracker events. Call after initCategories.
+void initFocusBlocks();
+
+// Blocks overlapping [startTime, endTime), including one in progress, in start order.
+const std::vector<FocusBlock>& getFocusBlocks(double startTime, double endTime);
+
+// Runs the detector over history again, from the first day that is not frozen (see
+// isRawDerivedDayFrozen); blocks on frozen days are kept. A bulk edit of frozen days
+// detects their blocks again from the rollup buckets.
+void rebuildFocusBlocks();
+
+// Called once per frame from the main loop; applies repairs and missed writes.
+void runFocusBlockMaintenance();
+
+#endif // FOCUS_BLOCKS_H
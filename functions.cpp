@@ -1,6 +1,7 @@
 #include "functions.h"
 
 #include <algorithm>
+#include <chrono>
 
 #include "database.h"      // Provides getDatabase() and ensures the DB is initialized.
 #include <sqlite3.h>
@@ -10,14 +11,16 @@
 #include <cstdio>
 #include <cmath>
 #include <imgui.h>
-#include <iomanip>
 #include <unordered_map>
 #include <vector>
 
+#include "civil_date.h"
 #include "heatmap.h"
+#include "live_usage.h"
+#include "parallel_scan.h"
 
 // Implementation of getCurrentTrackedApplication:
-// It queries the ActivitySession table for the active session (where endTime is NULL).
+// It queries the ActivitySession table for the active local session (where endTime is NULL).
 bool getCurrentTrackedApplication(ApplicationData &appData) {
     // Get the database handle from the database module.
     sqlite3* dbHandle = getDatabase();
@@ -26,7 +29,7 @@ bool getCurrentTrackedApplication(ApplicationData &appData) {
         return false;
     }
     // SQL query to retrieve the current active session.
-    const char* sql = "SELECT processName, windowTitle, startTime FROM ActivitySession WHERE endTime IS NULL ORDER BY id DESC LIMIT 1;";
+    const char* sql = "SELECT processName, windowTitle, startTime FROM ActivitySession WHERE endTime IS NULL AND machineId IS NULL ORDER BY id DESC LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
 
     // Prepare the SQL statement.
@@ -55,135 +58,53 @@ bool getCurrentTrackedApplication(ApplicationData &appData) {
 }
 
 std::string julianToCalendarString(double JD) {
-    // Adjust JD so that the day starts at midnight.
-    double J = JD + 0.5;
-    int Z = static_cast<int>(std::floor(J));
-    double F = J - Z;
-
-    int A;
-    if (Z < 2299161) {
-        A = Z;
-    } else {
-        int alpha = static_cast<int>(std::floor((Z - 1867216.25) / 36524.25));
-        A = Z + 1 + alpha - static_cast<int>(std::floor(alpha / 4.0));
-    }
-
-    int B = A + 1524;
-    int C = static_cast<int>(std::floor((B - 122.1) / 365.25));
-    int D = static_cast<int>(std::floor(365.25 * C));
-    int E = static_cast<int>(std::floor((B - D) / 30.6001));
-
-    double dayDecimal = B - D - std::floor(30.6001 * E) + F;
-    int day = static_cast<int>(dayDecimal);
-    double dayFraction = dayDecimal - day;
-
-    int month;
-    if (E < 14)
-        month = E - 1;
-    else
-        month = E - 13;
-
-    int year;
-    if (month > 2)
-        year = C - 4716;
-    else
-        year = C - 4715;
-
-    // Convert the fractional part of the day into hours, minutes, and seconds.
-    double totalSeconds = dayFraction * 86400.0;  // 86400 seconds in a day
-    int hour = static_cast<int>(totalSeconds / 3600);
-    totalSeconds -= hour * 3600;
-    int minute = static_cast<int>(totalSeconds / 60);
-    totalSeconds -= minute * 60;
-    int second = static_cast<int>(totalSeconds + 0.5);  // Round to nearest second
-
     // Format into "YYYY-MM-DD HH:MM:SS"
-    char buf[32];
-    std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d",
-                  year, month, day, hour, minute, second);
-    // printf(std::string(buf).c_str());
+    char buf[Timestamp::kFormattedSize];
+    Timestamp::fromJulian(JD).format(buf);
     return std::string(buf);
 }
 
-double getCurrentJulianDay() {
-    std::time_t now = std::time(nullptr);
+// Current local time; seconds only when withMillis is false.
+static Timestamp localNow(bool withMillis) {
+    auto nowPoint = std::chrono::system_clock::now();
+    std::time_t now = std::chrono::system_clock::to_time_t(nowPoint);
+    int millis = withMillis ? static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  nowPoint.time_since_epoch()).count() % 1000)
+                            : 0;
     std::tm *lt = std::localtime(&now);
-    int year = lt->tm_year + 1900;
-    int month = lt->tm_mon + 1;
-    int day = lt->tm_mday;
-    int hour = lt->tm_hour;
-    int minute = lt->tm_min;
-    int second = lt->tm_sec;
-    if (month <= 2) {
-        year--;
-        month += 12;
-    }
-    int A = year / 100;
-    int B = 2 - A + (A / 4);
-    double dayFraction = (hour + (minute / 60.0) + (second / 3600.0)) / 24.0;
-    return std::floor(365.25 * (year + 4716))
-          + std::floor(30.6001 * (month + 1))
-          + day + dayFraction + B - 1524.5;
+    CivilDate date{lt->tm_year + 1900, lt->tm_mon + 1, lt->tm_mday};
+    return Timestamp::fromCivil(date, lt->tm_hour, lt->tm_min, lt->tm_sec, millis);
 }
-std::string getCurrentJulianDayStr() {
-    // Get current time in local time.
-    std::time_t now = std::time(nullptr);
-    std::tm *lt = std::localtime(&now);
-    int year = lt->tm_year + 1900;
-    int month = lt->tm_mon + 1;
-    int day = lt->tm_mday;
-    int hour = lt->tm_hour;
-    int minute = lt->tm_min;
-    int second = lt->tm_sec;
-
-    // Adjust months so that January and February are counted as months 13 and 14 of the previous year.
-    if (month <= 2) {
-        year -= 1;
-        month += 12;
-    }
-
-    // Calculate the terms needed for the Julian day formula.
-    int A = year / 100;
-    int B = 2 - A + (A / 4);
 
-    // Compute the fractional day.
-    double dayFraction = (hour + (minute / 60.0) + (second / 3600.0)) / 24.0;
-
-    // Compute the Julian day number.
-    double JD = std::floor(365.25 * (year + 4716))
-              + std::floor(30.6001 * (month + 1))
-              + day + dayFraction + B - 1524.5;
+double getCurrentJulianDay() {
+    // Millisecond resolution, matching julianday('now','localtime') in SQL.
+    return localNow(true).julian();
+}
 
-    // Format the result into a string.
+std::string getCurrentJulianDayStr() {
     char buf[32];
-    std::snprintf(buf, sizeof(buf), "%.10f", JD);
+    std::snprintf(buf, sizeof(buf), "%.10f", localNow(false).julian());
     return std::string(buf);
 }
 
 double getJulianDayFromDate(const std::string &date)
 {
-    std::tm tm = {};
-    std::istringstream ss(date);
-    ss >> std::get_time(&tm, "%Y-%m-%d");
-    if (ss.fail()) {
+    CivilDate parsed;
+    if (!CivilDate::parse(date, parsed)) {
         std::cerr << "Failed to parse date: " << date << std::endl;
         return 0.0;
     }
-    int year = tm.tm_year + 1900;
-    int month = tm.tm_mon + 1;
-    int day = tm.tm_mday;
-    if (month <= 2) {
-        year--;
-        month += 12;
-    }
-    int A = year / 100;
-    int B = 2 - A + (A / 4);
-    double JD = std::floor(365.25 * (year + 4716))
-              + std::floor(30.6001 * (month + 1))
-              + day + B - 1524.5;
-    return JD;
+    return parsed.julian();
 }
 
+int julianToDayNumber(double JD) {
+    // Julian days begin at noon, so local midnight sits at N - 0.5.
+    return static_cast<int>(std::floor(JD + 0.5));
+}
+
+double dayNumberToJulian(int day) {
+    return day - 0.5;
+}
 
 // std::string getCurrentTimestamp() {
 //     std::time_t now = std::time(nullptr);
@@ -193,78 +114,38 @@ double getJulianDayFromDate(const std::string &date)
 // }
 std::vector<ApplicationData> getAllProcessUsage(const std::string &startDate , const std::string &endDate ) {
     std::vector<ApplicationData> results;
-    sqlite3* dbHandle = getDatabase();
-    if (!dbHandle) {
-        std::cerr << "Database not initialized.\n";
-        return results;
-    }
 
-    // SQL for ALL-TIME (no date filter) without LIMIT.
-    const char* sqlAllTime = R"(
-        SELECT processName, COALESCE(SUM(
-            CASE
-                WHEN endTime IS NOT NULL THEN (julianday(endTime) - julianday(startTime))
-                ELSE (julianday('now','localtime') - julianday(startTime))
-            END
-        ), 0) as total_time
-        FROM ActivitySession
-        GROUP BY processName
-        ORDER BY total_time DESC;
-    )";
-
-    // SQL for a specific date range (startDate inclusive, endDate exclusive) without LIMIT.
-    const char* sqlDateRange = R"(
-        SELECT processName, COALESCE(SUM(
-            CASE
-                WHEN endTime IS NOT NULL THEN (julianday(endTime) - julianday(startTime))
-                ELSE (julianday('now','localtime') - julianday(startTime))
-            END
-        ), 0) as total_time
-        FROM ActivitySession
-        WHERE julianday(startTime) >= julianday(?)
-          AND julianday(startTime) < julianday(?)
-        GROUP BY processName
-        ORDER BY total_time DESC;
-    )";
-
-    sqlite3_stmt* stmt = nullptr;
-    int rc;
-    if (endDate.empty()) {
-        // Use all-time query.
-        rc = sqlite3_prepare_v2(dbHandle, sqlAllTime, -1, &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "Failed to prepare all-time query in getAllProcessUsage: "
-                      << sqlite3_errmsg(dbHandle) << std::endl;
-            return results;
-        }
-    } else {
-        // Use date-range query. Bind startDate and endDate.
-        rc = sqlite3_prepare_v2(dbHandle, sqlDateRange, -1, &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "Failed to prepare date range query in getAllProcessUsage: "
-                      << sqlite3_errmsg(dbHandle) << std::endl;
+    // All-time when no end date is given, else [startDate, endDate).
+    double startJD = 0.0, endJD = 0.0;
+    if (!endDate.empty()) {
+        startJD = getJulianDayFromDate(startDate);
+        endJD = getJulianDayFromDate(endDate);
+        if (startJD == 0.0 || endJD == 0.0)
             return results;
-        }
-        sqlite3_bind_text(stmt, 1, startDate.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, endDate.c_str(), -1, SQLITE_TRANSIENT);
     }
 
-    // Process each row in the result.
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    // Long ranges are split across the scan pool's reader threads.
+    UsageTotals totals;
+    if (!aggregateUsage(startJD, endJD, false, totals))
+        return results;
+    for (const auto& entry : totals.processSeconds) {
         ApplicationData app;
-        const unsigned char* procName = sqlite3_column_text(stmt, 0);
-        double totalDays = sqlite3_column_double(stmt, 1);
-        app.processName = procName ? reinterpret_cast<const char*>(procName) : "";
-        // Convert days to seconds.
-        app.totalTime = totalDays * 86400.0;
+        app.processName = entry.first;
+        app.totalTime = entry.second;
         results.push_back(app);
     }
-    sqlite3_finalize(stmt);
+    std::sort(results.begin(), results.end(), [](const ApplicationData& a, const ApplicationData& b) {
+        return a.totalTime > b.totalTime;
+    });
     return results;
 }
 
 // Retrieve the top 10 applications (by processName) since programStartTime.
 std::vector<ApplicationData> getTopApplications(const std::string &startDate, const std::string &endDate) {
+    // All-time totals are maintained in memory by the live aggregator.
+    if (endDate.empty())
+        return getLiveProcessUsage(false, 10);
+
     std::vector<ApplicationData> results;
     sqlite3* dbHandle = getDatabase();
     if (!dbHandle) {
@@ -272,20 +153,6 @@ std::vector<ApplicationData> getTopApplications(const std::string &startDate, co
         return results;
     }
 
-    // SQL for ALL-TIME (no date filter)
-    const char* sqlAllTime = R"(
-        SELECT processName, COALESCE(SUM(
-            CASE
-                WHEN endTime IS NOT NULL THEN (julianday(endTime) - julianday(startTime))
-                ELSE (julianday('now','localtime') - julianday(startTime))
-            END
-        ), 0) as total_time
-        FROM ActivitySession
-        GROUP BY processName
-        ORDER BY total_time DESC
-        LIMIT 10;
-    )";
-
     // SQL for a specific date range
     const char* sqlDateRange = R"(
         SELECT processName, COALESCE(SUM(
@@ -294,7 +161,7 @@ std::vector<ApplicationData> getTopApplications(const std::string &startDate, co
                 ELSE (julianday('now','localtime') - julianday(startTime))
             END
         ), 0) as total_time
-        FROM ActivitySession
+        FROM SessionHistory
         WHERE julianday(startTime) >= julianday(?)
           AND julianday(startTime) < julianday(?)
         GROUP BY processName
@@ -303,26 +170,14 @@ std::vector<ApplicationData> getTopApplications(const std::string &startDate, co
     )";
 
     sqlite3_stmt* stmt = nullptr;
-    int rc;
-    if (endDate.empty()) {
-        // Use all-time query.
-        rc = sqlite3_prepare_v2(dbHandle, sqlAllTime, -1, &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "Failed to prepare top applications query: "
-                      << sqlite3_errmsg(dbHandle) << std::endl;
-            return results;
-        }
-    } else {
-        // Use date-range query. Bind both startDate and endDate.
-        rc = sqlite3_prepare_v2(dbHandle, sqlDateRange, -1, &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "Failed to prepare top applications date range query: "
-                      << sqlite3_errmsg(dbHandle) << std::endl;
-            return results;
-        }
-        sqlite3_bind_text(stmt, 1, startDate.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, endDate.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_prepare_v2(dbHandle, sqlDateRange, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        std::cerr << "Failed to prepare top applications date range query: "
+                  << sqlite3_errmsg(dbHandle) << std::endl;
+        return results;
     }
+    sqlite3_bind_text(stmt, 1, startDate.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, endDate.c_str(), -1, SQLITE_TRANSIENT);
 
     // Process each row in the result.
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
@@ -355,7 +210,7 @@ double getTotalTimeTrackedCurrentRun(const std::string &startDate, const std::st
                 ELSE (julianday('now','localtime') - julianday(startTime))
             END
         ), 0) as total_time
-        FROM ActivitySession;
+        FROM SessionHistory;
     )";
 
     // SQL for a specific date range
@@ -366,7 +221,7 @@ double getTotalTimeTrackedCurrentRun(const std::string &startDate, const std::st
                 ELSE (julianday('now','localtime') - julianday(startTime))
             END
         ), 0) as total_time
-        FROM ActivitySession
+        FROM SessionHistory
         WHERE julianday(startTime) >= julianday(?)
           AND julianday(startTime) < julianday(?);
     )";
@@ -403,35 +258,22 @@ double getTotalTimeTrackedCurrentRun(const std::string &startDate, const std::st
     return totalDays * 86400.0; // Convert days to seconds.
 }
 
-std::string getNextDate(const std::string &date) {
-    std::tm tm = {};
-    std::istringstream ss(date);
-    ss >> std::get_time(&tm, "%Y-%m-%d");
-    if (ss.fail()) {
-        // If parsing fails, return the original string.
+// Shifts a "YYYY-MM-DD" date by a number of days; returns the input if it does not parse.
+static std::string shiftDate(const std::string &date, int days) {
+    CivilDate parsed;
+    if (!CivilDate::parse(date, parsed))
         return date;
-    }
-    tm.tm_mday += 1;
-    // Normalize the tm structure.
-    mktime(&tm);
-    char buf[11];
-    strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+    char buf[CivilDate::kFormattedSize];
+    parsed.addDays(days).format(buf);
     return std::string(buf);
 }
 
+std::string getNextDate(const std::string &date) {
+    return shiftDate(date, 1);
+}
+
 std::string getPreviousDate(const std::string &date) {
-    std::tm tm = {};
-    std::istringstream ss(date);
-    ss >> std::get_time(&tm, "%Y-%m-%d");
-    if (ss.fail()) {
-        return date; // fallback if parsing fails
-    }
-    tm.tm_mday -= 1;
-    // Normalize the tm structure.
-    mktime(&tm);
-    char buf[11];
-    strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
-    return std::string(buf);
+    return shiftDate(date, -1);
 }
 
 
@@ -441,13 +283,14 @@ void endActiveSessions() {
         std::cerr << "Database not initialized.\n";
         return;
     }
-    const char* sql = "UPDATE ActivitySession SET endTime = julianday('now','localtime') WHERE endTime IS NULL;";
+    const char* sql = "UPDATE ActivitySession SET endTime = julianday('now','localtime') WHERE endTime IS NULL AND machineId IS NULL;";
     char* errMsg = nullptr;
     int rc = sqlite3_exec(dbHandle, sql, nullptr, nullptr, &errMsg);
     if (rc != SQLITE_OK) {
         std::cerr << "Error ending active sessions: " << errMsg << std::endl;
         sqlite3_free(errMsg);
     }
+    bumpWriteGeneration();
 }
 
 // Compute the number of days tracked by the application.
@@ -459,7 +302,7 @@ double getDaysTracked() {
     }
     const char* sql = R"(
         SELECT MIN(julianday(startTime)), MAX(COALESCE(endTime, julianday('now','localtime')))
-        FROM ActivitySession;
+        FROM SessionHistory;
     )";
     sqlite3_stmt* stmt = nullptr;
     int rc = sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr);
@@ -494,8 +337,9 @@ void checkActiveSessionIntegrity() {
         return;
     }
 
-    // Query sessions with a NULL endTime ordered by startTime (earliest first).
-    const char* sql = "SELECT id FROM ActivitySession WHERE endTime IS NULL ORDER BY startTime ASC;";
+    // Query local sessions with a NULL endTime ordered by startTime (earliest first).
+    // Open sessions merged from other machines belong to those machines' trackers.
+    const char* sql = "SELECT id FROM ActivitySession WHERE endTime IS NULL AND machineId IS NULL ORDER BY startTime ASC;";
     sqlite3_stmt* stmt = nullptr;
     int rc = sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr);
     if (rc != SQLITE_OK) {
@@ -536,6 +380,7 @@ void checkActiveSessionIntegrity() {
         } else {
             std::cout << "Fixed error: Session with id " << earliestSessionId
                       << " has been closed (endTime set to now)." << std::endl;
+            bumpWriteGeneration();
         }
         sqlite3_finalize(updateStmt);
     }
@@ -21,6 +21,10 @@ std::vector<ApplicationData> getTopApplications(const std::string &startDate, co
 std::string getCurrentTimestamp();
 
 double getJulianDayFromDate(const std::string &date);
+// Integer day number for a julian timestamp (the julian day number of its local date).
+int julianToDayNumber(double JD);
+// Julian timestamp of local midnight at the start of a day number.
+double dayNumberToJulian(int day);
 std::string julianToCalendarString(double JD);
 void endActiveSessions();
 double getDaysTracked();
@@ -7,120 +7,83 @@
 #include <vector>
 #include <iomanip>
 
+#include "categories.h"
+#include "focus_blocks.h"
 #include "functions.h"
 #include "database.h"
+#include "interval_buckets.h"
 #include <sqlite3.h>
 #include <imgui.h>
 #include <iostream>
 #include <unordered_map>
 
 
-static std::unordered_map<std::string, std::string> g_processCategoryMapping;
+// Hour range selected in the Activity Timeline (used by the Tags pane).
+// Click selects a single hour, shift-click extends the selection from the anchor.
+static int g_selectionAnchor = -1;
+static int g_selectionFirst = -1;
+static int g_selectionLast = -1;
+static std::string g_selectionDate;
 
-static const std::vector<std::string> availableCategories = {
-    "Productivity", "Entertainment", "Social", "Communication", "Reading", "Creativity", "Other"
-};
-
-
-std::vector<ApplicationData> getTopApplicationsTimeRange(double queryStart, double queryEnd) {
-    std::vector<ApplicationData> results;
-    sqlite3* db = getDatabase();
-    if (!db)
-        return results;
-
-    // SQL query: select sessions that overlap with the given time range.
-    std::string sql =
-        "SELECT processName, startTime, endTime "
-        "FROM ActivitySession "
-        "WHERE startTime < ? AND (endTime > ? OR endTime IS NULL);";
+bool getTimelineSelection(int& firstHour, int& lastHour) {
+    if (g_selectionFirst < 0)
+        return false;
+    firstHour = g_selectionFirst;
+    lastHour = g_selectionLast;
+    return true;
+}
 
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement in getTopApplicationsTimeRange: "
-                  << sqlite3_errmsg(db) << std::endl;
-        return results;
+void addSessionToHourMatrix(HourProcessMatrix& matrix, const BucketGrid& hours, const std::string& processName,
+                            double sessionStart, double sessionEnd) {
+    auto it = matrix.rows.find(processName);
+    if (it == matrix.rows.end()) {
+        it = matrix.rows.emplace(processName, matrix.processes.size()).first;
+        matrix.processes.push_back(processName);
+        matrix.seconds.resize(matrix.processes.size() * 24, 0.0);
+        matrix.slots.push_back(getProcessSlot(processName));
     }
+    accumulateIntervals(hours, &sessionStart, &sessionEnd, 1, 86400.0, matrix.seconds.data() + it->second * 24);
+}
 
-    // Bind parameters:
-    // Parameter 1: queryEnd (session must have started before the end of our range)
-    // Parameter 2: queryStart (session must end after the start of our range)
-    sqlite3_bind_double(stmt, 1, queryEnd);
-    sqlite3_bind_double(stmt, 2, queryStart);
-
-    // Use an unordered_map to accumulate usage per process.
-    std::unordered_map<std::string, double> usageMap;
-    double currentJulian = getCurrentJulianDay(); // For sessions still active
-
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        // Column 0: processName, Column 1: startTime, Column 2: endTime.
-        const unsigned char* text = sqlite3_column_text(stmt, 0);
-        std::string processName = text ? reinterpret_cast<const char*>(text) : "";
-        double sessionStart = sqlite3_column_double(stmt, 1);
-        double sessionEnd = (sqlite3_column_type(stmt, 2) == SQLITE_NULL)
-                            ? currentJulian
-                            : sqlite3_column_double(stmt, 2);
-
-        // Compute effective overlap with the query range.
-        double effectiveStart = std::max(sessionStart, queryStart);
-        double effectiveEnd = std::min(sessionEnd, queryEnd);
-
-        if (effectiveEnd > effectiveStart) {
-            // Convert the fractional days difference to seconds.
-            double overlapSeconds = (effectiveEnd - effectiveStart) * 86400.0;
-            usageMap[processName] += overlapSeconds;
+std::array<HourlyUsageData, 24> hourlyUsageFromMatrix(const HourProcessMatrix& matrix) {
+    std::array<HourlyUsageData, 24> usage{};
+    // One copy of the slot table per call; rows then map to categories by index.
+    std::vector<int> slotCategories = getSlotCategories();
+    size_t categoryCount = getCategories().size();
+    for (int hour = 0; hour < 24; hour++) {
+        double hourSeconds = 0.0;
+        usage[hour].categorySeconds.assign(categoryCount, 0.0);
+        for (size_t row = 0; row < matrix.processes.size(); row++) {
+            double seconds = matrix.seconds[row * 24 + hour];
+            if (seconds <= 0.0)
+                continue;
+            if (categoryCount > 0)
+                usage[hour].categorySeconds[slotCategories[matrix.slots[row]]] += seconds;
+            ApplicationData app;
+            app.processName = matrix.processes[row];
+            app.totalTime = seconds;
+            usage[hour].apps.push_back(app);
+            hourSeconds += seconds;
         }
+        std::sort(usage[hour].apps.begin(), usage[hour].apps.end(),
+                  [](const ApplicationData& a, const ApplicationData& b) { return a.totalTime > b.totalTime; });
+        // Cap usage at 1.0 (100% of hour)
+        usage[hour].totalUsage = std::min(1.0, hourSeconds / 3600.0);
     }
-    sqlite3_finalize(stmt);
-
-    // Convert the map to a vector of ApplicationData.
-    for (const auto& entry : usageMap) {
-        ApplicationData appData;
-        appData.processName = entry.first;
-        appData.totalTime = entry.second;
-        results.push_back(appData);
-    }
-
-    // Optionally sort by totalTime (largest usage first)
-    std::sort(results.begin(), results.end(), [](const ApplicationData& a, const ApplicationData& b) {
-        return a.totalTime > b.totalTime;
-    });
-
-    return results;
-}
-
-// Get the application data for a specific hour
-std::vector<ApplicationData> getHourlyApplicationData(const std::string& selectedDate, int hour) {
-    // Convert hour to Julian day time range
-    double dayStart = getJulianDayFromDate(selectedDate);
-    double hourStart = dayStart + (hour / 24.0);
-    double hourEnd = dayStart + ((hour + 1) / 24.0);
-
-    // Get applications used in this hour
-    // Implementation would be similar to getTopApplications but with time constraints
-    // This is a placeholder - you'll need to implement this based on your database schema
-    return getTopApplicationsTimeRange(hourStart, hourEnd);
+    return usage;
 }
 
 // Compute hourly usage with app category information
-
-
 std::array<HourlyUsageData, 24> computeDetailedHourlyUsage(const std::string& selectedDate) {
     std::array<HourlyUsageData, 24> usage{};
 
-    // Initialize array
-    for (int hour = 0; hour < 24; hour++) {
-        usage[hour].totalUsage = 0.0;
-    }
-
     // Determine the start and end (Julian day) of the selected date
     double dayStart = getJulianDayFromDate(selectedDate);
-    std::string nextDate = getNextDate(selectedDate);
-    double dayEnd = getJulianDayFromDate(nextDate);
+    double dayEnd = dayStart + 1.0;
 
     // SQL: Get sessions overlapping the selected day
     std::string sql =
-        "SELECT startTime, endTime FROM ActivitySession "
+        "SELECT processName, startTime, endTime FROM SessionHistory "
         "WHERE startTime < ? AND (endTime > ? OR endTime IS NULL);";
 
     sqlite3* db = getDatabase();
@@ -141,87 +104,44 @@ std::array<HourlyUsageData, 24> computeDetailedHourlyUsage(const std::string& se
     // Get current time in Julian day (for sessions still active)
     double currentJulian = getCurrentJulianDay();
 
-    // Process each session that overlaps the selected day
+    // One pass over the day's sessions fills both the hour totals and the per-hour app breakdown
+    BucketGrid hours = makeDayBucketGrid(dayStart, kHourBuckets);
+    HourProcessMatrix matrix;
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        double sessionStart = sqlite3_column_double(stmt, 0);
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
         // If endTime is NULL, use currentJulian
-        double sessionEnd = sqlite3_column_type(stmt, 1) == SQLITE_NULL
+        double sessionEnd = sqlite3_column_type(stmt, 2) == SQLITE_NULL
                             ? currentJulian
-                            : sqlite3_column_double(stmt, 1);
-
-        // Clip session times to the selected day
-        double effectiveStart = std::max(sessionStart, dayStart);
-        double effectiveEnd = std::min(sessionEnd, dayEnd);
-        if (effectiveEnd <= effectiveStart)
-            continue; // No overlap with the selected day
-
-        // For each hour slot (0 to 23), compute overlap
-        for (int hour = 0; hour < 24; hour++) {
-            double hourStart = dayStart + (hour / 24.0);
-            double hourEnd = dayStart + ((hour + 1) / 24.0);
-            double overlapStart = std::max(effectiveStart, hourStart);
-            double overlapEnd = std::min(effectiveEnd, hourEnd);
-            if (overlapEnd > overlapStart) {
-                // Convert fractional days to seconds (1 day = 86400 seconds)
-                double overlapSeconds = (overlapEnd - overlapStart) * 86400.0;
-                usage[hour].totalUsage += overlapSeconds / 3600.0; // Convert to fraction of hour
-            }
-        }
+                            : sqlite3_column_double(stmt, 2);
+        addSessionToHourMatrix(matrix, hours, procName ? reinterpret_cast<const char*>(procName) : "",
+                               sqlite3_column_double(stmt, 1), sessionEnd);
     }
     sqlite3_finalize(stmt);
 
-    // Cap usage at 1.0 (100% of hour)
-    for (int hour = 0; hour < 24; hour++) {
-        usage[hour].totalUsage = std::min(1.0, usage[hour].totalUsage);
-        // Fetch detailed app usage for each hour (placeholder)
-        // In a real implementation, you'd query the database for this
-        if (usage[hour].totalUsage > 0) {
-            usage[hour].apps = getHourlyApplicationData(selectedDate, hour);
-        }
-    }
-
-    return usage;
+    return hourlyUsageFromMatrix(matrix);
 }
 
-// Color palette for different app categories
-// These are more subtle, Apple-like colors
-struct CategoryColor {
-    const char* category;
-    ImU32 color;
-};
-
-const std::array<CategoryColor, 7> categoryColors = {{
-    {"Productivity", IM_COL32(88, 86, 214, 255)},     // Purple
-    {"Entertainment", IM_COL32(52, 170, 220, 255)},   // Blue
-    {"Social", IM_COL32(90, 200, 250, 255)},          // Light Blue
-    {"Communication", IM_COL32(255, 149, 0, 255)},    // Orange
-    {"Reading", IM_COL32(88, 189, 92, 255)},          // Green
-    {"Creativity", IM_COL32(255, 45, 85, 255)},       // Red
-    {"Other", IM_COL32(142, 142, 147, 255)}           // Gray
-}};
-
 // Get color for a specific app (based on category)
 ImU32 getAppColor(const std::string& appName) {
+    const std::vector<CategoryInfo>& categories = getCategories();
+    if (categories.empty())
+        return IM_COL32(142, 142, 147, 255);
     // Check if the user has assigned a category.
-    auto it = g_processCategoryMapping.find(appName);
-    if (it != g_processCategoryMapping.end()) {
-        // Find the category in our categoryColors array.
-        for (const auto& category : categoryColors) {
-            if (it->second == category.category)
-                return category.color;
-        }
-    }
+    if (hasAssignedCategory(appName))
+        return categories[getProcessCategory(appName)].color;
     // Fallback: use hash-based default.
     size_t hash = std::hash<std::string>{}(appName);
-    return categoryColors[hash % categoryColors.size()].color;
+    return categories[hash % categories.size()].color;
 }
 
 // Modernized heat map that resembles Apple's Screen Time
-void DrawHeatMap(const std::string& selectedDate) {
+void DrawHeatMap(const std::string& selectedDate, const std::array<HourlyUsageData, 24>& hourlyData, bool stale) {
     ImGui::Begin("Activity Timeline");
 
-    // Get data for the selected date
-    auto hourlyData = computeDetailedHourlyUsage(selectedDate);
+    // Category stacks come precomputed with the hourly data, so no per-segment lookups.
+    static bool stackByCategory = false;
+    ImGui::Checkbox("Stack by category", &stackByCategory);
+    const std::vector<CategoryInfo>& categories = getCategories();
 
     // Use a fixed maximum of 1.0 (i.e. 60 minutes) for scaling
     const double maxUsage = 1.0;
@@ -244,6 +164,8 @@ void DrawHeatMap(const std::string& selectedDate) {
     // Draw title
     {
         std::string title = "Screen Time · " + selectedDate;
+        if (stale)
+            title += " (updating...)";
         ImVec2 titleSize = ImGui::CalcTextSize(title.c_str());
         float titleX = chartStart.x + (kTimelineWidth - titleSize.x) * 0.5f;
         draw_list->AddText(ImVec2(titleX, pos.y), IM_COL32(60, 60, 60, 255), title.c_str());
@@ -294,8 +216,34 @@ void DrawHeatMap(const std::string& selectedDate) {
             IM_COL32(200, 200, 200, 100), 1.0f);
     }
 
+    // Focus blocks as a strip above the bars; hours map to x continuously.
+    double dayStart = getJulianDayFromDate(selectedDate);
+    const std::vector<FocusBlock>& focusBlocks = getFocusBlocks(dayStart, dayStart + 1.0);
+    double focusTotal = 0.0;
+    for (const FocusBlock& block : focusBlocks) {
+        float startHours = static_cast<float>(std::max(0.0, block.startTime - dayStart) * 24.0);
+        float endHours = static_cast<float>(std::min(1.0, block.endTime - dayStart) * 24.0);
+        ImVec2 stripMin(chartStart.x + startHours * (kBarWidth + kBarSpacing), chartStart.y - 12.0f);
+        ImVec2 stripMax(std::min(chartEnd.x, chartStart.x + endHours * (kBarWidth + kBarSpacing)), chartStart.y - 5.0f);
+        draw_list->AddRectFilled(stripMin, stripMax, IM_COL32(88, 86, 214, 255), 2.0f);
+        if (ImGui::IsMouseHoveringRect(stripMin, stripMax)) {
+            double seconds = (block.endTime - block.startTime) * 86400.0;
+            ImGui::SetTooltip("Focus %s - %s\n%s, %.0f%% in productive apps",
+                              julianToCalendarString(block.startTime).substr(11, 5).c_str(),
+                              julianToCalendarString(block.endTime).substr(11, 5).c_str(),
+                              formatTime(seconds).c_str(), seconds > 0.0 ? block.focusSeconds / seconds * 100.0 : 0.0);
+        }
+        focusTotal += (std::min(block.endTime, dayStart + 1.0) - std::max(block.startTime, dayStart)) * 86400.0;
+    }
+
     // Static variable to "lock" the breakdown display
     static int lockedHour = -1;
+    // A new date starts with no selection.
+    if (g_selectionDate != selectedDate) {
+        g_selectionDate = selectedDate;
+        g_selectionAnchor = g_selectionFirst = g_selectionLast = -1;
+        lockedHour = -1;
+    }
     // Track if any hour is hovered (temporary state)
     int hoveredHour = -1;
 
@@ -317,14 +265,28 @@ void DrawHeatMap(const std::string& selectedDate) {
             hoveredHour = hour;
             // On click, toggle the locked hour (using left mouse button)
             if (ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
-                if (lockedHour == hour) {
+                if (ImGui::GetIO().KeyShift && g_selectionAnchor != -1) {
+                    // Extend the selection from the anchor hour.
+                    g_selectionFirst = std::min(g_selectionAnchor, hour);
+                    g_selectionLast = std::max(g_selectionAnchor, hour);
+                } else if (lockedHour == hour) {
                     lockedHour = -1; // unlock if already locked
+                    g_selectionAnchor = g_selectionFirst = g_selectionLast = -1;
                 } else {
                     lockedHour = hour; // lock this hour
+                    g_selectionAnchor = g_selectionFirst = g_selectionLast = hour;
                 }
             }
         }
 
+        // Highlight hours in the current selection
+        if (hour >= g_selectionFirst && hour <= g_selectionLast) {
+            draw_list->AddRectFilled(
+                ImVec2(x - kBarSpacing * 0.5f, chartStart.y - 4),
+                ImVec2(x + kBarWidth + kBarSpacing * 0.5f, chartStart.y + kBarHeight + 4),
+                IM_COL32(200, 158, 130, 80));
+        }
+
         // Background of the bar (subtle gray)
         draw_list->AddRectFilled(
             ImVec2(x, chartStart.y),
@@ -335,7 +297,25 @@ void DrawHeatMap(const std::string& selectedDate) {
         // Draw activity segments (apps used in this hour)
         if (barHeight > 0) {
             const auto& apps = hourlyData[hour].apps;
-            if (!apps.empty()) {
+            const auto& categorySeconds = hourlyData[hour].categorySeconds;
+            if (stackByCategory && !apps.empty() && categorySeconds.size() == categories.size()) {
+                float totalTime = 0;
+                for (double seconds : categorySeconds)
+                    totalTime += seconds;
+
+                float currentHeight = 0;
+                for (size_t category = 0; category < categorySeconds.size(); category++) {
+                    if (categorySeconds[category] <= 0.0)
+                        continue;
+                    float categoryHeight = barHeight * (categorySeconds[category] / totalTime);
+                    draw_list->AddRectFilled(
+                        ImVec2(x, chartStart.y + kBarHeight - currentHeight - categoryHeight),
+                        ImVec2(x + kBarWidth, chartStart.y + kBarHeight - currentHeight),
+                        categories[category].color,
+                        isHovered ? 0.0f : 3.0f);
+                    currentHeight += categoryHeight;
+                }
+            } else if (!apps.empty()) {
                 // Calculate proportional heights
                 float totalTime = 0;
                 for (const auto& app : apps) {
@@ -411,6 +391,12 @@ void DrawHeatMap(const std::string& selectedDate) {
     // Reserve space for the chart in ImGui layout
     ImGui::Dummy(ImVec2(kTimelineWidth + kAxisPadding, kBarHeight + kAxisPadding + 20));
 
+    ImGui::Text("Focus blocks: %zu (%s)", focusBlocks.size(), formatTime(focusTotal).c_str());
+    ImGui::SameLine();
+    // Blocks keep the categories they were detected with until recomputed.
+    if (ImGui::SmallButton("Recompute"))
+        rebuildFocusBlocks();
+
     // Display details for the selected hour (either locked or hovered)
     if (displayHour >= 0) {
         ImGui::Separator();
@@ -481,7 +467,7 @@ void DrawHeatMap(const std::string& selectedDate) {
     itemsPerRow = std::max(1, itemsPerRow);
 
     int col = 0;
-    for (const auto& category : categoryColors) {
+    for (const auto& category : categories) {
         ImVec2 cursorPos = ImGui::GetCursorScreenPos();
 
         // Color indicator
@@ -492,7 +478,7 @@ void DrawHeatMap(const std::string& selectedDate) {
             3.0f);
 
         ImGui::SetCursorScreenPos(ImVec2(cursorPos.x + 20, cursorPos.y));
-        ImGui::Text("%s", category.category);
+        ImGui::Text("%s", category.name.c_str());
 
         // Handle columns
         col++;
@@ -508,12 +494,9 @@ void DrawHeatMap(const std::string& selectedDate) {
 }
 
 // Draws a pane for the user to assign categories to processes.
-void DrawAppCategoryPane() {
+void DrawAppCategoryPane(const std::vector<ApplicationData>& processList) {
     ImGui::Begin("App Category Assignment");
 
-    // Fetch all processes (aggregated usage across all time).
-    auto processList = getAllProcessUsage();
-
     if (ImGui::BeginTable("ProcessTable", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         ImGui::TableSetupColumn("Application", ImGuiTableColumnFlags_WidthStretch);
         ImGui::TableSetupColumn("Time");
@@ -533,20 +516,20 @@ void DrawAppCategoryPane() {
 
             // Category Column with a Combo Box.
             ImGui::TableSetColumnIndex(2);
-            // Get current category for this process; default to "Other" if none.
-            std::string currentCategory = "Other";
-            auto it = g_processCategoryMapping.find(app.processName);
-            if (it != g_processCategoryMapping.end())
-                currentCategory = it->second;
+            // Get current category for this process; "Other" if none was assigned.
+            const std::vector<CategoryInfo>& categories = getCategories();
+            int currentCategory = getProcessCategory(app.processName);
+            const char* currentName = currentCategory < static_cast<int>(categories.size())
+                                      ? categories[currentCategory].name.c_str() : "Other";
 
             // Create a unique ID for each combo box.
             std::string comboId = "##" + app.processName;
-            if (ImGui::BeginCombo(comboId.c_str(), currentCategory.c_str())) {
-                for (const auto& category : availableCategories) {
-                    bool isSelected = (currentCategory == category);
-                    if (ImGui::Selectable(category.c_str(), isSelected)) {
-                        // Update the mapping when the user selects a category.
-                        g_processCategoryMapping[app.processName] = category;
+            if (ImGui::BeginCombo(comboId.c_str(), currentName)) {
+                for (size_t category = 0; category < categories.size(); category++) {
+                    bool isSelected = currentCategory == static_cast<int>(category);
+                    if (ImGui::Selectable(categories[category].name.c_str(), isSelected)) {
+                        // Persist the assignment when the user selects a category.
+                        setProcessCategory(app.processName, static_cast<int>(category));
                     }
                     if (isSelected)
                         ImGui::SetItemDefaultFocus();
@@ -5,24 +5,44 @@
 #ifndef HEATMAP_H
 #define HEATMAP_H
 #include <imgui.h>
+#include <array>
 #include <string>
+#include <unordered_map>
 
 #include "functions.h"
+#include "interval_buckets.h"
 
 
 struct HourlyUsageData {
     double totalUsage;                    // Total usage as fraction of hour (0.0-1.0)
     std::vector<ApplicationData> apps;    // Top apps used in this hour
+    std::vector<double> categorySeconds;  // Seconds per category, indexed like getCategories()
 };
 
+// Seconds each process spent in each hour of one day, filled in a single pass over the
+// day's sessions. Rows are dense and process-major, so a session is added straight into its row.
+struct HourProcessMatrix {
+    std::vector<std::string> processes;
+    std::unordered_map<std::string, size_t> rows;  // Process name -> index into processes.
+    std::vector<double> seconds;                   // seconds[row * 24 + hour]
+    std::vector<int> slots;                        // getProcessSlot of each row.
+};
+
+// Adds the part of [sessionStart, sessionEnd) that falls on the grid's day (see makeDayBucketGrid).
+void addSessionToHourMatrix(HourProcessMatrix& matrix, const BucketGrid& hours, const std::string& processName,
+                            double sessionStart, double sessionEnd);
+// Per-hour totals, per-hour app lists (largest first) and category totals for the Activity Timeline.
+std::array<HourlyUsageData, 24> hourlyUsageFromMatrix(const HourProcessMatrix& matrix);
+
 ImVec4 getHeatMapColor(double percent);
-void DrawHeatMap(const std::string& selectedDate);
+// stale marks data that is older than the latest write while a refresh is pending.
+void DrawHeatMap(const std::string& selectedDate, const std::array<HourlyUsageData, 24>& hourlyData, bool stale = false);
 std::array<double, 24> computeHourlyUsage(const std::string& selectedDate);
-std::vector<ApplicationData> getTopApplicationsTimeRange(double queryStart, double queryEnd);
-std::vector<ApplicationData> getHourlyApplicationData(const std::string& selectedDate, int hour);
 std::array<HourlyUsageData, 24> computeDetailedHourlyUsage(const std::string& selectedDate);
 ImU32 getAppColor(const std::string& appName);
-void DrawAppCategoryPane();
+void DrawAppCategoryPane(const std::vector<ApplicationData>& processList);
+// Hours selected in the Activity Timeline for the current date; false if nothing is selected.
+bool getTimelineSelection(int& firstHour, int& lastHour);
 
 
 #endif //HEATMAP_H
@@ -0,0 +1,391 @@
+#include "history_edit.h"
+
+#include "civil_date.h"
+#include "database.h"
+#include "functions.h"
+#include "retention.h"
+#include <sqlite3.h>
+#include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Open bounds used when a request leaves hasStart/hasEnd unset.
+static const double kMinJulian = -1.0e9;
+static const double kMaxJulian = 1.0e9;
+
+// Which table the running job is currently working through.
+enum class BulkEditPhase { Sessions, Rollups, Done };
+
+struct BulkEditJob {
+    BulkEditStatus status;
+    BulkEditPhase phase = BulkEditPhase::Done;
+    long long cursor = 0;          // Last id / rowid visited in the current phase.
+    long long maxRollupRowId = 0;  // Rollup rows created by this job itself are never revisited.
+    std::chrono::steady_clock::time_point startedAt;
+};
+
+static BulkEditJob g_job;
+static std::vector<DayRepairHandler> g_dayRepairHandlers;
+static std::vector<FrozenDayEditHandler> g_frozenDayEditHandlers;
+
+void registerDayRepairHandler(DayRepairHandler handler) {
+    g_dayRepairHandlers.push_back(std::move(handler));
+}
+
+void registerFrozenDayEditHandler(FrozenDayEditHandler handler) {
+    g_frozenDayEditHandlers.push_back(std::move(handler));
+}
+
+void notifyHistoryDaysChanged(int firstDay, int lastDay) {
+    if (lastDay < firstDay)
+        return;
+    for (const auto& handler : g_dayRepairHandlers)
+        handler(firstDay, lastDay);
+}
+
+BulkEditStatus getBulkEditStatus() {
+    return g_job.status;
+}
+
+static void touchDay(double startTime) {
+    int day = julianToDayNumber(startTime);
+    BulkEditStatus& status = g_job.status;
+    if (status.rowsTouched == 0) {
+        status.firstDay = status.lastDay = day;
+    } else {
+        status.firstDay = std::min(status.firstDay, day);
+        status.lastDay = std::max(status.lastDay, day);
+    }
+    status.rowsTouched++;
+}
+
+bool startBulkEdit(const BulkEditRequest& request) {
+    if (g_job.status.running)
+        return false;
+    if (request.kind == BulkEditRequest::Reassign && request.newProcessName.empty())
+        return false;
+    if (request.hasStart && request.hasEnd && request.endJD <= request.startJD)
+        return false;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return false;
+    }
+
+    g_job = BulkEditJob{};
+    g_job.status.running = true;
+    g_job.status.request = request;
+    if (g_job.status.request.batchSize <= 0)
+        g_job.status.request.batchSize = 500;
+    g_job.phase = BulkEditPhase::Sessions;
+    g_job.startedAt = std::chrono::steady_clock::now();
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT COALESCE(MAX(rowid), 0) FROM ActivityRollup;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            g_job.maxRollupRowId = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return true;
+}
+
+// Binds the shared filter parameters (?2 process, ?3/?4 range, ?5 excluded name, ?6 limit).
+static void bindFilter(sqlite3_stmt* stmt, const BulkEditRequest& request) {
+    sqlite3_bind_int64(stmt, 1, g_job.cursor);
+    sqlite3_bind_text(stmt, 2, request.processName.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(stmt, 3, request.hasStart ? request.startJD : kMinJulian);
+    sqlite3_bind_double(stmt, 4, request.hasEnd ? request.endJD : kMaxJulian);
+    sqlite3_bind_text(stmt, 5, request.kind == BulkEditRequest::Reassign ? request.newProcessName.c_str() : "",
+                      -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 6, request.batchSize);
+}
+
+// Processes one batch of raw sessions. Returns the number of rows changed, or -1 on error.
+static int editSessionBatch(sqlite3* dbHandle, const BulkEditRequest& request) {
+    const char* selectSql = R"(
+        SELECT id, startTime FROM ActivitySession
+        WHERE id > ?1
+          AND (?2 = '' OR processName = ?2)
+          AND startTime >= ?3 AND startTime < ?4
+          AND (?5 = '' OR processName IS NOT ?5)
+        ORDER BY id
+        LIMIT ?6;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, selectSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare bulk edit session query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return -1;
+    }
+    bindFilter(stmt, request);
+    std::vector<std::pair<long long, double>> rows;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        rows.push_back({sqlite3_column_int64(stmt, 0), sqlite3_column_double(stmt, 1)});
+    sqlite3_finalize(stmt);
+    if (rows.empty())
+        return 0;
+
+    const char* editSql = (request.kind == BulkEditRequest::Delete)
+        ? "DELETE FROM ActivitySession WHERE id = ?1;"
+        : "UPDATE ActivitySession SET processName = ?2 WHERE id = ?1;";
+    if (sqlite3_prepare_v2(dbHandle, editSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare bulk edit statement: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return -1;
+    }
+    for (const auto& row : rows) {
+        sqlite3_bind_int64(stmt, 1, row.first);
+        if (request.kind == BulkEditRequest::Reassign)
+            sqlite3_bind_text(stmt, 2, request.newProcessName.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Failed to edit session " << row.first << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+        sqlite3_reset(stmt);
+        touchDay(row.second);
+        g_job.cursor = row.first;
+    }
+    sqlite3_finalize(stmt);
+    return static_cast<int>(rows.size());
+}
+
+// Processes one batch of retention buckets. Reassigned buckets are merged into the
+// target process's bucket. Returns the number of rows changed, or -1 on error.
+static int editRollupBatch(sqlite3* dbHandle, const BulkEditRequest& request) {
+    const char* selectSql = R"(
+        SELECT rowid, bucketSeconds, bucketKey, startTime, totalTime FROM ActivityRollup
+        WHERE rowid > ?1
+          AND (?2 = '' OR processName = ?2)
+          AND startTime >= ?3 AND startTime < ?4
+          AND (?5 = '' OR processName IS NOT ?5)
+          AND rowid <= ?7
+        ORDER BY rowid
+        LIMIT ?6;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, selectSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare bulk edit rollup query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return -1;
+    }
+    bindFilter(stmt, request);
+    sqlite3_bind_int64(stmt, 7, g_job.maxRollupRowId);
+    struct RollupRow {
+        long long rowId;
+        int bucketSeconds;
+        long long bucketKey;
+        double startTime;
+        double totalTime;
+    };
+    std::vector<RollupRow> rows;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        rows.push_back({sqlite3_column_int64(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int64(stmt, 2),
+                        sqlite3_column_double(stmt, 3), sqlite3_column_double(stmt, 4)});
+    }
+    sqlite3_finalize(stmt);
+    if (rows.empty())
+        return 0;
+
+    sqlite3_stmt* mergeStmt = nullptr;
+    if (request.kind == BulkEditRequest::Reassign) {
+        const char* mergeSql = R"(
+            INSERT INTO ActivityRollup (processName, bucketSeconds, bucketKey, startTime, totalTime)
+            VALUES (?, ?, ?, ?, ?)
+            ON CONFLICT(processName, bucketSeconds, bucketKey)
+            DO UPDATE SET totalTime = totalTime + excluded.totalTime;
+        )";
+        if (sqlite3_prepare_v2(dbHandle, mergeSql, -1, &mergeStmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to prepare rollup merge: " << sqlite3_errmsg(dbHandle) << std::endl;
+            return -1;
+        }
+    }
+    if (sqlite3_prepare_v2(dbHandle, "DELETE FROM ActivityRollup WHERE rowid = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare rollup delete: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_finalize(mergeStmt);
+        return -1;
+    }
+    bool ok = true;
+    for (const auto& row : rows) {
+        if (mergeStmt) {
+            sqlite3_bind_text(mergeStmt, 1, request.newProcessName.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(mergeStmt, 2, row.bucketSeconds);
+            sqlite3_bind_int64(mergeStmt, 3, row.bucketKey);
+            sqlite3_bind_double(mergeStmt, 4, row.startTime);
+            sqlite3_bind_double(mergeStmt, 5, row.totalTime);
+            ok = sqlite3_step(mergeStmt) == SQLITE_DONE;
+            sqlite3_reset(mergeStmt);
+        }
+        sqlite3_bind_int64(stmt, 1, row.rowId);
+        ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+        if (!ok) {
+            std::cerr << "Failed to edit rollup bucket: " << sqlite3_errmsg(dbHandle) << std::endl;
+            break;
+        }
+        touchDay(row.startTime);
+        g_job.cursor = row.rowId;
+    }
+    sqlite3_finalize(mergeStmt);
+    sqlite3_finalize(stmt);
+    return ok ? static_cast<int>(rows.size()) : -1;
+}
+
+void runBulkEditStep() {
+    BulkEditStatus& status = g_job.status;
+    if (!status.running)
+        return;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle)
+        return;
+
+    auto batchStart = std::chrono::steady_clock::now();
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    int changed = (g_job.phase == BulkEditPhase::Sessions)
+        ? editSessionBatch(dbHandle, status.request)
+        : editRollupBatch(dbHandle, status.request);
+    if (changed < 0) {
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        std::cerr << "Bulk edit aborted." << std::endl;
+        g_job.phase = BulkEditPhase::Done;
+    } else {
+        sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+        if (changed > 0) {
+            status.batches++;
+            bumpWriteGeneration();
+        }
+        if (changed < status.request.batchSize) {
+            // This table is exhausted; move on to the next one.
+            g_job.cursor = 0;
+            g_job.phase = (g_job.phase == BulkEditPhase::Sessions) ? BulkEditPhase::Rollups : BulkEditPhase::Done;
+        }
+    }
+    auto now = std::chrono::steady_clock::now();
+    status.workMs += std::chrono::duration<double, std::milli>(now - batchStart).count();
+
+    if (g_job.phase == BulkEditPhase::Done) {
+        status.running = false;
+        status.finished = true;
+        status.wallMs = std::chrono::duration<double, std::milli>(now - g_job.startedAt).count();
+        std::cout << "Bulk edit touched " << status.rowsTouched << " rows in "
+                  << status.workMs << " ms." << std::endl;
+        if (status.rowsTouched > 0) {
+            if (isRawDerivedDayFrozen(status.firstDay)) {
+                int lastFrozen = std::min(status.lastDay, getCompactedThroughDay());
+                for (const auto& handler : g_frozenDayEditHandlers)
+                    handler(status.request, status.firstDay, lastFrozen);
+            }
+            notifyHistoryDaysChanged(status.firstDay, status.lastDay);
+        }
+    }
+}
+
+// Reads a "YYYY-MM-DD" date field. An empty field is an open bound; false for anything
+// that is not a valid date, so a typo never widens the range.
+static bool readDateInput(const char* text, bool& present, CivilDate& date) {
+    present = text[0] != '\0';
+    return !present || CivilDate::parse(text, date);
+}
+
+void DrawHistoryEditPane() {
+    ImGui::Begin("History Editor");
+
+    static char processName[128] = "";
+    static char newProcessName[128] = "";
+    static char fromDate[11] = "";
+    static char toDate[11] = "";
+    static BulkEditRequest pending;
+    static bool allProcessesConfirmed = false;
+
+    ImGui::InputTextWithHint("Process", "all processes", processName, sizeof(processName));
+    ImGui::InputTextWithHint("From", "YYYY-MM-DD (open)", fromDate, sizeof(fromDate));
+    ImGui::InputTextWithHint("To (inclusive)", "YYYY-MM-DD (open)", toDate, sizeof(toDate));
+    ImGui::InputTextWithHint("Reassign to", "new process name", newProcessName, sizeof(newProcessName));
+
+    BulkEditStatus status = getBulkEditStatus();
+    BulkEditRequest request;
+    request.processName = processName;
+    request.newProcessName = newProcessName;
+    CivilDate from, to;
+    const char* rangeError = nullptr;
+    if (!readDateInput(fromDate, request.hasStart, from) || !readDateInput(toDate, request.hasEnd, to))
+        rangeError = "Enter dates as YYYY-MM-DD, or leave them empty.";
+    else if (request.hasStart && request.hasEnd && to.dayNumber() < from.dayNumber())
+        rangeError = "The From date must not be after the To date.";
+    if (request.hasStart)
+        request.startJD = from.julian();
+    if (request.hasEnd)
+        request.endJD = to.addDays(1).julian();
+
+    // The range as the confirmation shows it.
+    char fromText[CivilDate::kFormattedSize];
+    char toText[CivilDate::kFormattedSize];
+    from.format(fromText);
+    to.format(toText);
+    char range[64];
+    std::snprintf(range, sizeof(range), "%s through %s", request.hasStart ? fromText : "the first day",
+                  request.hasEnd ? toText : "the latest day");
+
+    bool disabled = status.running || rangeError != nullptr;
+    if (disabled)
+        ImGui::BeginDisabled();
+    if (ImGui::Button("Delete")) {
+        pending = request;
+        pending.kind = BulkEditRequest::Delete;
+        allProcessesConfirmed = false;
+        ImGui::OpenPopup("Confirm Edit");
+    }
+    ImGui::SameLine();
+    if (newProcessName[0] == '\0')
+        ImGui::BeginDisabled();
+    if (ImGui::Button("Reassign")) {
+        pending = request;
+        pending.kind = BulkEditRequest::Reassign;
+        allProcessesConfirmed = false;
+        ImGui::OpenPopup("Confirm Edit");
+    }
+    if (newProcessName[0] == '\0')
+        ImGui::EndDisabled();
+    if (disabled)
+        ImGui::EndDisabled();
+    if (rangeError)
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", rangeError);
+
+    if (ImGui::BeginPopupModal("Confirm Edit", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        bool allProcesses = pending.processName.empty();
+        const char* who = allProcesses ? "ALL processes" : pending.processName.c_str();
+        if (pending.kind == BulkEditRequest::Delete)
+            ImGui::Text("Permanently delete history for %s?", who);
+        else
+            ImGui::Text("Rename history for %s to %s?", who, pending.newProcessName.c_str());
+        ImGui::Text("Sessions started on %s. This cannot be undone.", range);
+        // A blank Process field reaches every process, so it takes a second confirmation.
+        if (allProcesses)
+            ImGui::Checkbox("Yes, apply this to every process", &allProcessesConfirmed);
+        bool blocked = allProcesses && !allProcessesConfirmed;
+        if (blocked)
+            ImGui::BeginDisabled();
+        if (ImGui::Button(pending.kind == BulkEditRequest::Delete ? "Delete" : "Reassign")) {
+            startBulkEdit(pending);
+            ImGui::CloseCurrentPopup();
+        }
+        if (blocked)
+            ImGui::EndDisabled();
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel"))
+            ImGui::CloseCurrentPopup();
+        ImGui::EndPopup();
+    }
+
+    ImGui::Separator();
+    if (status.running) {
+        ImGui::Text("Running: %lld rows touched in %d batches", status.rowsTouched, status.batches);
+    } else if (status.finished) {
+        ImGui::Text("%s %lld rows across %d days in %.1f ms (%.1f ms wall)",
+                    status.request.kind == BulkEditRequest::Delete ? "Deleted" : "Reassigned",
+                    status.rowsTouched, status.rowsTouched > 0 ? status.lastDay - status.firstDay + 1 : 0,
+                    status.workMs, status.wallMs);
+    }
+    ImGui::End();
+}
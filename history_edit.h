@@ -0,0 +1,56 @@
+#ifndef HISTORY_EDIT_H
+#define HISTORY_EDIT_H
+
+#include <functional>
+#include <string>
+
+// Bulk edits of tracked history (privacy purges, reassigning a time range).
+// Edits run incrementally, one batch per frame, over both raw sessions and
+// retention rollup buckets. Once finished, only the affected days are handed to
+// the registered day repair handlers so derived aggregates can rebuild just those days.
+struct BulkEditRequest {
+    enum Kind { Delete, Reassign };
+    Kind kind = Delete;
+    std::string processName;      // Only rows for this process; empty matches every process.
+    std::string newProcessName;   // Target name for Reassign.
+    bool hasStart = false;        // Rows starting in [startJD, endJD); a bound without its
+    bool hasEnd = false;          // flag is open.
+    double startJD = 0.0;
+    double endJD = 0.0;
+    int batchSize = 500;          // Rows changed per batch (one transaction each).
+};
+
+struct BulkEditStatus {
+    bool running = false;
+    bool finished = false;
+    BulkEditRequest request;
+    long long rowsTouched = 0;
+    int batches = 0;
+    int firstDay = 0;             // Affected day numbers (see julianToDayNumber), inclusive.
+    int lastDay = 0;
+    double workMs = 0.0;          // Time spent inside batches.
+    double wallMs = 0.0;          // Time from start to finish.
+};
+
+// Starts a bulk edit. Returns false if one is already running or the request is invalid.
+bool startBulkEdit(const BulkEditRequest& request);
+// Runs one batch of the current bulk edit, if any. Called once per frame from the main loop.
+void runBulkEditStep();
+BulkEditStatus getBulkEditStatus();
+
+// Derived aggregates register here to be told which days of history changed.
+using DayRepairHandler = std::function<void(int firstDay, int lastDay)>;
+void registerDayRepairHandler(DayRepairHandler handler);
+// Notifies every registered handler that days [firstDay, lastDay] were rewritten.
+void notifyHistoryDaysChanged(int firstDay, int lastDay);
+
+// Aggregates that keep stored rows for days retention has compacted (see
+// isRawDerivedDayFrozen) register here to apply a finished edit to those rows themselves.
+// Only the frozen part of the edited days is passed on; the rest goes to the day repair
+// handlers as usual. Stored rows are per day, so an edit applies to the whole of each day.
+using FrozenDayEditHandler = std::function<void(const BulkEditRequest& request, int firstDay, int lastDay)>;
+void registerFrozenDayEditHandler(FrozenDayEditHandler handler);
+
+void DrawHistoryEditPane();
+
+#endif // HISTORY_EDIT_H
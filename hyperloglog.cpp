@@ -0,0 +1,87 @@
+#include "hyperloglog.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+HyperLogLog::HyperLogLog(int precision)
+    : precision_(std::clamp(precision, 4, 16)), registers_(size_t(1) << precision_, 0) {}
+
+void HyperLogLog::add(uint64_t hash) {
+    size_t index = static_cast<size_t>(hash >> (64 - precision_));
+    // Rank of the first set bit in the remaining bits, counting from 1.
+    // The guard bit caps the rank at 64 - precision + 1 when the rest is all zeros.
+    uint64_t rest = (hash << precision_) | (uint64_t(1) << (precision_ - 1));
+    uint8_t rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+    registers_[index] = std::max(registers_[index], rank);
+}
+
+bool HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision_ != precision_)
+        return false;
+    for (size_t i = 0; i < registers_.size(); i++)
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    return true;
+}
+
+double HyperLogLog::estimate() const {
+    double m = static_cast<double>(registers_.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t reg : registers_) {
+        sum += std::ldexp(1.0, -reg);
+        if (reg == 0)
+            zeros++;
+    }
+    double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+    double raw = alpha * m * m / sum;
+    // Small cardinalities are counted from the empty registers (linear counting).
+    if (raw <= 2.5 * m && zeros > 0)
+        return m * std::log(m / static_cast<double>(zeros));
+    return raw;
+}
+
+double HyperLogLog::relativeError() const {
+    return 1.04 / std::sqrt(static_cast<double>(registers_.size()));
+}
+
+bool HyperLogLog::empty() const {
+    return std::all_of(registers_.begin(), registers_.end(), [](uint8_t reg) { return reg == 0; });
+}
+
+bool HyperLogLog::loadRegisters(const void* data, size_t size) {
+    if (size != registers_.size() || !data)
+        return false;
+    std::memcpy(registers_.data(), data, size);
+    return true;
+}
+
+// FNV-1a over the bytes, then a splitmix64 finalizer so the top bits (the register
+// index) depend on every input byte.
+static uint64_t fnvAppend(uint64_t hash, std::string_view value) {
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t finalizeHash(uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+uint64_t hashSketchValue(std::string_view value) {
+    return finalizeHash(fnvAppend(14695981039346656037ULL, value));
+}
+
+uint64_t hashSketchValue(std::string_view first, std::string_view second) {
+    uint64_t hash = fnvAppend(14695981039346656037ULL, first);
+    hash = fnvAppend(hash, std::string_view("\0", 1));
+    return finalizeHash(fnvAppend(hash, second));
+}
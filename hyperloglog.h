@@ -0,0 +1,39 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Approximate distinct counting in a fixed 2^precision bytes (Flajolet et al.).
+// Adding a value twice is harmless and two sketches of the same precision merge by
+// taking the larger register, so per-day sketches combine into any range.
+// The standard error of the estimate is about 1.04 / sqrt(2^precision).
+class HyperLogLog {
+public:
+    explicit HyperLogLog(int precision = 12);
+
+    void add(uint64_t hash);
+    // False if the precisions differ.
+    bool merge(const HyperLogLog& other);
+    double estimate() const;
+    double relativeError() const;
+    bool empty() const;
+
+    int precision() const { return precision_; }
+    const std::vector<uint8_t>& registers() const { return registers_; }
+    // False, leaving the sketch unchanged, if size does not match the precision.
+    bool loadRegisters(const void* data, size_t size);
+
+private:
+    int precision_;
+    std::vector<uint8_t> registers_;
+};
+
+// 64-bit hash for sketch values. Parts are hashed as one string with separators, so
+// ("ab", "c") and ("a", "bc") differ.
+uint64_t hashSketchValue(std::string_view value);
+uint64_t hashSketchValue(std::string_view first, std::string_view second);
+
+#endif // HYPERLOGLOG_H
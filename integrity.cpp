@@ -0,0 +1,261 @@
+#include "integrity.h"
+
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// Overlaps shorter than this (in days, ~0.5s) are ordinary jitter between endSession and startSession.
+static const double kOverlapToleranceDays = 0.5 / 86400.0;
+
+static IntegrityScanConfig g_config;
+static IntegrityScanStats g_stats;
+
+// Position of the scan within the current pass.
+struct ScanCursor {
+    long long lastId = 0;           // Last id scanned.
+    long long prevClosedId = 0;     // Previous closed session (for overlap detection).
+    double prevClosedStart = 0.0;
+    double prevClosedEnd = 0.0;
+    long long pendingOpenId = 0;    // Open session seen earlier in the pass; orphaned if anything follows it.
+    double pendingOpenStart = 0.0;
+};
+static ScanCursor g_cursor;
+// Days whose sessions were repaired during the current chunk.
+static int g_repairFirstDay = 0;
+static int g_repairLastDay = -1;
+static std::chrono::steady_clock::time_point g_nextPass{};
+
+void setIntegrityScanConfig(const IntegrityScanConfig& config) {
+    g_config = config;
+    // Readers rely on no session outlasting kMaxSessionDays.
+    g_config.maxSessionHours = std::min(g_config.maxSessionHours, kMaxSessionDays * 24.0);
+}
+
+IntegrityScanStats getIntegrityScanStats() {
+    return g_stats;
+}
+
+static void recordFinding(sqlite3* dbHandle, long long sessionId, const char* kind, const std::string& detail) {
+    const char* sql = "INSERT INTO IntegrityFinding (sessionId, kind, detail) VALUES (?, ?, ?);";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare integrity finding insert: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_int64(stmt, 1, sessionId);
+    sqlite3_bind_text(stmt, 2, kind, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, detail.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+        std::cerr << "Failed to record integrity finding: " << sqlite3_errmsg(dbHandle) << std::endl;
+    sqlite3_finalize(stmt);
+    g_stats.findings++;
+}
+
+static void setEndTime(sqlite3* dbHandle, long long sessionId, double endTime) {
+    const char* sql = "UPDATE ActivitySession SET endTime = ? WHERE id = ?;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare integrity repair: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_double(stmt, 1, endTime);
+    sqlite3_bind_int64(stmt, 2, sessionId);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+        std::cerr << "Failed to repair session " << sessionId << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+    sqlite3_finalize(stmt);
+}
+
+// Closes a session only if it is still open. Returns true if a row was changed.
+static bool closeIfOpen(sqlite3* dbHandle, long long sessionId, double endTime) {
+    const char* sql = "UPDATE ActivitySession SET endTime = ? WHERE id = ? AND endTime IS NULL;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare integrity repair: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, endTime);
+    sqlite3_bind_int64(stmt, 2, sessionId);
+    bool changed = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(dbHandle) > 0;
+    sqlite3_finalize(stmt);
+    return changed;
+}
+
+static void deleteSession(sqlite3* dbHandle, long long sessionId) {
+    const char* sql = "DELETE FROM ActivitySession WHERE id = ?;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare integrity delete: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_int64(stmt, 1, sessionId);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+        std::cerr << "Failed to delete session " << sessionId << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+    sqlite3_finalize(stmt);
+}
+
+static void markRepairedDay(double startTime) {
+    int day = julianToDayNumber(startTime);
+    if (g_repairLastDay < g_repairFirstDay) {
+        g_repairFirstDay = g_repairLastDay = day;
+    } else {
+        g_repairFirstDay = std::min(g_repairFirstDay, day);
+        g_repairLastDay = std::max(g_repairLastDay, day);
+    }
+}
+
+// Checks one row against the cursor state, repairing and recording anything malformed.
+static void checkRow(sqlite3* dbHandle, long long id, bool hasStart, double startTime, bool hasEnd, double endTime) {
+    char detail[128];
+
+    if (!hasStart) {
+        deleteSession(dbHandle, id);
+        recordFinding(dbHandle, id, "missing_start", "row had no startTime and was deleted");
+        return;
+    }
+
+    // Anything following an open session means that session was never closed.
+    // It may have been closed normally since it was read (it was the live session
+    // at the end of the previous chunk), so only rows that are still open are repaired.
+    if (g_cursor.pendingOpenId != 0) {
+        double longestEnd = g_cursor.pendingOpenStart + g_config.maxSessionHours / 24.0;
+        double closeAt = std::max(g_cursor.pendingOpenStart, std::min(startTime, longestEnd));
+        if (closeIfOpen(dbHandle, g_cursor.pendingOpenId, closeAt)) {
+            if (closeAt < startTime)
+                std::snprintf(detail, sizeof(detail), "closed after %.1fh, before session %lld",
+                              g_config.maxSessionHours, id);
+            else
+                std::snprintf(detail, sizeof(detail), "closed at start of session %lld", id);
+            recordFinding(dbHandle, g_cursor.pendingOpenId, "orphaned_open", detail);
+            markRepairedDay(g_cursor.pendingOpenStart);
+        }
+        g_cursor.prevClosedId = g_cursor.pendingOpenId;
+        g_cursor.prevClosedStart = g_cursor.pendingOpenStart;
+        g_cursor.prevClosedEnd = closeAt;
+        g_cursor.pendingOpenId = 0;
+    }
+
+    if (!hasEnd) {
+        g_cursor.pendingOpenId = id;
+        g_cursor.pendingOpenStart = startTime;
+        return;
+    }
+
+    if (endTime < startTime) {
+        std::snprintf(detail, sizeof(detail), "duration %.0fs, endTime set to startTime",
+                      (endTime - startTime) * 86400.0);
+        endTime = startTime;
+        setEndTime(dbHandle, id, endTime);
+        recordFinding(dbHandle, id, "negative_duration", detail);
+        markRepairedDay(startTime);
+    } else if ((endTime - startTime) * 24.0 > g_config.maxSessionHours) {
+        std::snprintf(detail, sizeof(detail), "duration %.1fh clamped to %.1fh",
+                      (endTime - startTime) * 24.0, g_config.maxSessionHours);
+        endTime = startTime + g_config.maxSessionHours / 24.0;
+        setEndTime(dbHandle, id, endTime);
+        recordFinding(dbHandle, id, "absurd_duration", detail);
+        markRepairedDay(startTime);
+    }
+
+    if (g_cursor.prevClosedId != 0 && startTime < g_cursor.prevClosedEnd - kOverlapToleranceDays) {
+        double clampedEnd = std::max(g_cursor.prevClosedStart, startTime);
+        std::snprintf(detail, sizeof(detail), "overlapped session %lld by %.0fs",
+                      id, (g_cursor.prevClosedEnd - startTime) * 86400.0);
+        setEndTime(dbHandle, g_cursor.prevClosedId, clampedEnd);
+        recordFinding(dbHandle, g_cursor.prevClosedId, "overlap", detail);
+        markRepairedDay(g_cursor.prevClosedStart);
+    }
+
+    g_cursor.prevClosedId = id;
+    g_cursor.prevClosedStart = startTime;
+    g_cursor.prevClosedEnd = endTime;
+}
+
+bool runIntegrityScanChunk() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return true;
+    }
+    auto chunkStart = std::chrono::steady_clock::now();
+    auto deadline = chunkStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double, std::milli>(g_config.chunkBudgetMs));
+
+    const char* sql = "SELECT id, startTime, endTime FROM ActivitySession "
+                      "WHERE id > ? AND machineId IS NULL ORDER BY id LIMIT ?;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare integrity scan query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return true;
+    }
+    sqlite3_bind_int64(stmt, 1, g_cursor.lastId);
+    sqlite3_bind_int(stmt, 2, g_config.chunkRows);
+
+    char* errMsg = nullptr;
+    if (sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Failed to begin integrity scan chunk: " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        sqlite3_finalize(stmt);
+        return true;
+    }
+    // Restored if the chunk's repairs are rolled back, so the chunk is scanned again.
+    ScanCursor chunkCursor = g_cursor;
+    IntegrityScanStats chunkStats = g_stats;
+    int rows = 0;
+    bool outOfBudget = false;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        long long id = sqlite3_column_int64(stmt, 0);
+        bool hasStart = sqlite3_column_type(stmt, 1) != SQLITE_NULL;
+        bool hasEnd = sqlite3_column_type(stmt, 2) != SQLITE_NULL;
+        checkRow(dbHandle, id, hasStart, sqlite3_column_double(stmt, 1), hasEnd, sqlite3_column_double(stmt, 2));
+        g_cursor.lastId = id;
+        rows++;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            outOfBudget = true;
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Failed to commit integrity scan chunk: " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        g_cursor = chunkCursor;
+        g_stats = chunkStats;
+        g_repairFirstDay = 0;
+        g_repairLastDay = -1;
+        return true;
+    }
+    if (g_repairLastDay >= g_repairFirstDay) {
+        bumpWriteGeneration();
+        notifyHistoryDaysChanged(g_repairFirstDay, g_repairLastDay);
+        g_repairFirstDay = 0;
+        g_repairLastDay = -1;
+    }
+
+    g_stats.rowsScanned += rows;
+    g_stats.lastChunkMs = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - chunkStart).count();
+
+    bool reachedEnd = !outOfBudget && rows < g_config.chunkRows;
+    if (reachedEnd) {
+        // A trailing open session is the live one, not an orphan.
+        g_cursor = ScanCursor{};
+        g_stats.passesCompleted++;
+    }
+    return reachedEnd;
+}
+
+void runIntegrityScanMaintenance() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < g_nextPass)
+        return;
+    if (runIntegrityScanChunk())
+        g_nextPass = now + std::chrono::seconds(g_config.rescanIntervalSeconds);
+}
@@ -0,0 +1,45 @@
+#ifndef INTEGRITY_H
+#define INTEGRITY_H
+
+// Background integrity scanner for ActivitySession.
+// Walks the local rows of the table by id in bounded chunks, repairs malformed rows in
+// one small transaction per chunk and records what it found in IntegrityFinding.
+// Sessions merged from other machines legitimately overlap local ones and are skipped.
+//
+// Detected problems:
+//  - missing_start:     startTime is NULL (row is deleted).
+//  - negative_duration: endTime < startTime (endTime is set to startTime).
+//  - absurd_duration:   longer than maxSessionHours (endTime is clamped).
+//  - overlap:           starts before the previous session ended (previous endTime is clamped).
+//  - orphaned_open:     endTime is NULL but a later session exists (closed at the next start,
+//                       or after maxSessionHours if that comes first).
+
+// Longest session the history holds, in days. The scanner clamps longer sessions to it, so
+// readers look back this far on startTime for the sessions that reach into a window.
+static const int kMaxSessionDays = 1;
+
+struct IntegrityScanConfig {
+    int chunkRows = 200;              // Maximum rows read per chunk.
+    double chunkBudgetMs = 2.0;       // Hard time budget per chunk; the chunk stops early when exceeded.
+    double maxSessionHours = kMaxSessionDays * 24.0;  // Longer sessions are absurd; capped at kMaxSessionDays.
+    int rescanIntervalSeconds = 300;  // Pause between full passes over the table.
+};
+
+struct IntegrityScanStats {
+    long long rowsScanned = 0;
+    long long findings = 0;
+    int passesCompleted = 0;
+    double lastChunkMs = 0.0;
+};
+
+void setIntegrityScanConfig(const IntegrityScanConfig& config);
+IntegrityScanStats getIntegrityScanStats();
+
+// Scans and repairs one chunk. Returns true when the chunk reached the end of the table.
+bool runIntegrityScanChunk();
+
+// Called once per frame from the main loop. Runs at most one chunk per frame
+// while a pass is in progress, then waits rescanIntervalSeconds before the next pass.
+void runIntegrityScanMaintenance();
+
+#endif // INTEGRITY_H
@@ -0,0 +1,192 @@
+#include "interval_buckets.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BUCKETS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BUCKETS_TARGET_AVX2
+#else
+#define BUCKETS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+BucketGrid makeBucketGrid(double start, double width, size_t count) {
+    BucketGrid grid;
+    grid.start = start;
+    grid.width = width;
+    grid.edges.resize(count + 1);
+    for (size_t k = 0; k <= count; k++)
+        grid.edges[k] = start + k * width;
+    return grid;
+}
+
+BucketGrid makeDayBucketGrid(double dayStart, int bucketsPerDay) {
+    BucketGrid grid;
+    grid.start = dayStart;
+    grid.width = 1.0 / bucketsPerDay;
+    grid.edges.resize(bucketsPerDay + 1);
+    // Same arithmetic as dayStart + (hour / 24.0), so bucket edges match the old per-hour loops.
+    for (int k = 0; k <= bucketsPerDay; k++)
+        grid.edges[k] = dayStart + (static_cast<double>(k) / bucketsPerDay);
+    return grid;
+}
+
+// Clips an interval to the grid and finds the buckets it touches. False if it misses the grid.
+static bool clipToGrid(const BucketGrid& grid, double& start, double& end, size_t& first, size_t& last) {
+    size_t count = grid.count();
+    start = std::max(start, grid.edges[0]);
+    end = std::min(end, grid.edges[count]);
+    if (end <= start)
+        return false;
+    double from = std::floor((start - grid.start) / grid.width);
+    double to = std::floor((end - grid.start) / grid.width);
+    first = static_cast<size_t>(std::clamp(from, 0.0, static_cast<double>(count - 1)));
+    last = static_cast<size_t>(std::clamp(to, 0.0, static_cast<double>(count - 1)));
+    return true;
+}
+
+static void addOverlaps(const BucketGrid& grid, double start, double end, size_t first, size_t last,
+                        double scale, double* buckets) {
+    for (size_t k = first; k <= last; k++) {
+        double overlap = std::min(end, grid.edges[k + 1]) - std::max(start, grid.edges[k]);
+        if (overlap > 0.0)
+            buckets[k] += overlap * scale;
+    }
+}
+
+static void accumulateScalar(const BucketGrid& grid, const double* starts, const double* ends,
+                             size_t intervalCount, double scale, double* buckets) {
+    if (grid.count() == 0)
+        return;
+    for (size_t i = 0; i < intervalCount; i++) {
+        double start = starts[i], end = ends[i];
+        size_t first = 0, last = 0;
+        if (clipToGrid(grid, start, end, first, last))
+            addOverlaps(grid, start, end, first, last, scale, buckets);
+    }
+}
+
+#ifdef BUCKETS_X86
+// Vector paths handle Width buckets per step. A step may run past 'last' (those buckets
+// get a zero overlap), so the first step is pulled back to fit inside the grid and short
+// intervals take a single vector step. A step that would leave the grid goes scalar.
+
+static void accumulateSse2(const BucketGrid& grid, const double* starts, const double* ends,
+                           size_t intervalCount, double scale, double* buckets) {
+    const size_t width = 2;
+    size_t count = grid.count();
+    if (count < width) {
+        accumulateScalar(grid, starts, ends, intervalCount, scale, buckets);
+        return;
+    }
+    const double* edges = grid.edges.data();
+    __m128d zero = _mm_setzero_pd();
+    __m128d scaleV = _mm_set1_pd(scale);
+    for (size_t i = 0; i < intervalCount; i++) {
+        double start = starts[i], end = ends[i];
+        size_t first = 0, last = 0;
+        if (!clipToGrid(grid, start, end, first, last))
+            continue;
+        __m128d startV = _mm_set1_pd(start);
+        __m128d endV = _mm_set1_pd(end);
+        for (size_t k = std::min(first, count - width); k <= last; k += width) {
+            if (k + width > count) {
+                addOverlaps(grid, start, end, k, last, scale, buckets);
+                break;
+            }
+            __m128d lo = _mm_max_pd(startV, _mm_loadu_pd(edges + k));
+            __m128d hi = _mm_min_pd(endV, _mm_loadu_pd(edges + k + 1));
+            __m128d overlap = _mm_max_pd(_mm_sub_pd(hi, lo), zero);
+            _mm_storeu_pd(buckets + k, _mm_add_pd(_mm_loadu_pd(buckets + k), _mm_mul_pd(overlap, scaleV)));
+        }
+    }
+}
+
+BUCKETS_TARGET_AVX2
+static void accumulateAvx2(const BucketGrid& grid, const double* starts, const double* ends,
+                           size_t intervalCount, double scale, double* buckets) {
+    const size_t width = 4;
+    size_t count = grid.count();
+    if (count < width) {
+        accumulateScalar(grid, starts, ends, intervalCount, scale, buckets);
+        return;
+    }
+    const double* edges = grid.edges.data();
+    __m256d zero = _mm256_setzero_pd();
+    __m256d scaleV = _mm256_set1_pd(scale);
+    for (size_t i = 0; i < intervalCount; i++) {
+        double start = starts[i], end = ends[i];
+        size_t first = 0, last = 0;
+        if (!clipToGrid(grid, start, end, first, last))
+            continue;
+        __m256d startV = _mm256_set1_pd(start);
+        __m256d endV = _mm256_set1_pd(end);
+        size_t k = std::min(first, count - width);
+        for (; k <= last && k + width <= count; k += width) {
+            __m256d lo = _mm256_max_pd(startV, _mm256_loadu_pd(edges + k));
+            __m256d hi = _mm256_min_pd(endV, _mm256_loadu_pd(edges + k + 1));
+            __m256d overlap = _mm256_max_pd(_mm256_sub_pd(hi, lo), zero);
+            _mm256_storeu_pd(buckets + k, _mm256_add_pd(_mm256_loadu_pd(buckets + k), _mm256_mul_pd(overlap, scaleV)));
+        }
+        // clipToGrid and addOverlaps are not inlined into this AVX2 function; calling SSE
+        // code with dirty upper ymm halves costs a state transition per interval (10x slower).
+        _mm256_zeroupper();
+        if (k <= last)
+            addOverlaps(grid, start, end, k, last, scale, buckets);
+    }
+}
+
+static bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+using BucketKernel = void (*)(const BucketGrid&, const double*, const double*, size_t, double, double*);
+
+struct BucketKernelChoice {
+    BucketKernel kernel;
+    const char* name;
+};
+
+static const BucketKernelChoice& chooseBucketKernel() {
+    static const BucketKernelChoice choice = [] {
+#ifdef BUCKETS_X86
+        if (cpuHasAvx2())
+            return BucketKernelChoice{accumulateAvx2, "AVX2"};
+        // SSE2 is part of every x86-64 CPU and of every CPU Windows 8+ runs on.
+        return BucketKernelChoice{accumulateSse2, "SSE2"};
+#else
+        return BucketKernelChoice{accumulateScalar, "scalar"};
+#endif
+    }();
+    return choice;
+}
+
+void accumulateIntervals(const BucketGrid& grid, const double* starts, const double* ends,
+                         size_t intervalCount, double scale, double* buckets) {
+    chooseBucketKernel().kernel(grid, starts, ends, intervalCount, scale, buckets);
+}
+
+void accumulateIntervalsScalar(const BucketGrid& grid, const double* starts, const double* ends,
+                               size_t intervalCount, double scale, double* buckets) {
+    accumulateScalar(grid, starts, ends, intervalCount, scale, buckets);
+}
+
+const char* getBucketKernelName() {
+    return chooseBucketKernel().name;
+}
@@ -0,0 +1,40 @@
+#ifndef INTERVAL_BUCKETS_H
+#define INTERVAL_BUCKETS_H
+
+#include <cstddef>
+#include <vector>
+
+// Splits time intervals across fixed-width buckets (hours, quarter hours, 5 minutes, minutes of a day).
+// The kernel is vectorized with AVX2 or SSE2 where the CPU supports it, chosen at runtime,
+// and falls back to scalar code elsewhere.
+
+static const int kHourBuckets = 24;
+static const int kQuarterHourBuckets = 96;
+static const int kFiveMinuteBuckets = 288;
+static const int kMinuteBuckets = 1440;
+
+struct BucketGrid {
+    double start = 0.0;
+    double width = 0.0;
+    std::vector<double> edges;  // count() + 1 boundaries; bucket k is [edges[k], edges[k + 1]).
+
+    size_t count() const { return edges.empty() ? 0 : edges.size() - 1; }
+};
+
+BucketGrid makeBucketGrid(double start, double width, size_t count);
+// One day starting at dayStart (julian), split into bucketsPerDay buckets.
+BucketGrid makeDayBucketGrid(double dayStart, int bucketsPerDay);
+
+// Adds the overlap of each interval [starts[i], ends[i]) with each bucket, multiplied
+// by scale (86400 turns julian days into seconds), to buckets[0 .. grid.count()).
+void accumulateIntervals(const BucketGrid& grid, const double* starts, const double* ends,
+                         size_t intervalCount, double scale, double* buckets);
+
+// The scalar kernel on its own, as the reference the vector kernels are checked against.
+void accumulateIntervalsScalar(const BucketGrid& grid, const double* starts, const double* ends,
+                               size_t intervalCount, double scale, double* buckets);
+
+// "AVX2", "SSE2" or "scalar".
+const char* getBucketKernelName();
+
+#endif // INTERVAL_BUCKETS_H
@@ -0,0 +1,122 @@
+#include "length_histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+int LengthHistogram::bucketFor(double seconds) {
+    double ms = std::floor(seconds * 1000.0);
+    if (!(ms >= 0.0))
+        return 0;
+    if (ms >= 4294967295.0)
+        return kBucketCount - 1;
+    uint32_t value = static_cast<uint32_t>(ms);
+    if (value < kSubBuckets)
+        return static_cast<int>(value);
+    // value has 'octave' + 5 significant bits; keep the top five.
+    int octave = std::bit_width(value) - 5;
+    int sub = static_cast<int>(value >> octave) - kSubBuckets;
+    return kSubBuckets + octave * kSubBuckets + sub;
+}
+
+double LengthHistogram::bucketLower(int bucket) {
+    if (bucket < kSubBuckets)
+        return bucket / 1000.0;
+    int octave = (bucket - kSubBuckets) / kSubBuckets;
+    int sub = (bucket - kSubBuckets) % kSubBuckets;
+    return std::ldexp(static_cast<double>(kSubBuckets + sub), octave) / 1000.0;
+}
+
+double LengthHistogram::bucketUpper(int bucket) {
+    if (bucket < kSubBuckets)
+        return (bucket + 1) / 1000.0;
+    int octave = (bucket - kSubBuckets) / kSubBuckets;
+    return bucketLower(bucket) + std::ldexp(1.0, octave) / 1000.0;
+}
+
+void LengthHistogram::add(double seconds, uint32_t count) {
+    if (count == 0)
+        return;
+    uint16_t bucket = static_cast<uint16_t>(bucketFor(seconds));
+    auto it = std::lower_bound(buckets_.begin(), buckets_.end(), bucket,
+                               [](const std::pair<uint16_t, uint32_t>& entry, uint16_t b) { return entry.first < b; });
+    if (it != buckets_.end() && it->first == bucket)
+        it->second += count;
+    else
+        buckets_.insert(it, {bucket, count});
+    count_ += count;
+}
+
+void LengthHistogram::merge(const LengthHistogram& other) {
+    if (other.buckets_.empty())
+        return;
+    if (buckets_.empty()) {
+        *this = other;
+        return;
+    }
+    std::vector<std::pair<uint16_t, uint32_t>> merged;
+    merged.reserve(buckets_.size() + other.buckets_.size());
+    size_t i = 0, j = 0;
+    while (i < buckets_.size() || j < other.buckets_.size()) {
+        if (j == other.buckets_.size() || (i < buckets_.size() && buckets_[i].first < other.buckets_[j].first)) {
+            merged.push_back(buckets_[i++]);
+        } else if (i == buckets_.size() || other.buckets_[j].first < buckets_[i].first) {
+            merged.push_back(other.buckets_[j++]);
+        } else {
+            merged.push_back({buckets_[i].first, buckets_[i].second + other.buckets_[j].second});
+            i++;
+            j++;
+        }
+    }
+    buckets_ = std::move(merged);
+    count_ += other.count_;
+}
+
+double LengthHistogram::quantile(double q) const {
+    if (count_ == 0)
+        return 0.0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count_)));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (const auto& entry : buckets_) {
+        seen += entry.second;
+        if (seen >= rank)
+            return (bucketLower(entry.first) + bucketUpper(entry.first)) / 2.0;
+    }
+    return bucketUpper(buckets_.back().first);
+}
+
+// Six little-endian bytes per bucket: a 16-bit bucket and a 32-bit count.
+std::vector<uint8_t> LengthHistogram::encode() const {
+    std::vector<uint8_t> data;
+    data.reserve(buckets_.size() * 6);
+    for (const auto& entry : buckets_) {
+        for (int shift = 0; shift < 16; shift += 8)
+            data.push_back(static_cast<uint8_t>(entry.first >> shift));
+        for (int shift = 0; shift < 32; shift += 8)
+            data.push_back(static_cast<uint8_t>(entry.second >> shift));
+    }
+    return data;
+}
+
+bool LengthHistogram::decode(const void* data, size_t size) {
+    buckets_.clear();
+    count_ = 0;
+    if (size % 6 != 0 || (size > 0 && !data))
+        return false;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t offset = 0; offset < size; offset += 6) {
+        uint16_t bucket = static_cast<uint16_t>(bytes[offset] | (bytes[offset + 1] << 8));
+        uint32_t count = 0;
+        for (int k = 0; k < 4; k++)
+            count |= static_cast<uint32_t>(bytes[offset + 2 + k]) << (8 * k);
+        if (bucket >= kBucketCount || (!buckets_.empty() && bucket <= buckets_.back().first)) {
+            buckets_.clear();
+            count_ = 0;
+            return false;
+        }
+        buckets_.push_back({bucket, count});
+        count_ += count;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef LENGTH_HISTOGRAM_H
+#define LENGTH_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Durations in log-linear buckets, laid out like an HDR histogram: whole milliseconds
+// below 16 ms, then 16 buckets per power of two, so a bucket's width is at most 1/16 of
+// its lower bound. Histograms merge exactly by adding counts, and only the non-empty
+// buckets are stored, which keeps a process-day to a few dozen bytes.
+class LengthHistogram {
+public:
+    static const int kSubBuckets = 16;
+    static const int kBucketCount = kSubBuckets * 29;  // Up to 2^32 ms, about 50 days.
+
+    static int bucketFor(double seconds);
+    static double bucketLower(int bucket);  // Seconds.
+    static double bucketUpper(int bucket);
+
+    void add(double seconds, uint32_t count = 1);
+    void merge(const LengthHistogram& other);
+    uint64_t count() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    // Length below which a fraction q of the sessions fall, in seconds (bucket midpoint).
+    double quantile(double q) const;
+
+    // (bucket, count) pairs in bucket order.
+    const std::vector<std::pair<uint16_t, uint32_t>>& buckets() const { return buckets_; }
+    std::vector<uint8_t> encode() const;
+    // False, leaving the histogram empty, if the data is malformed.
+    bool decode(const void* data, size_t size);
+
+private:
+    std::vector<std::pair<uint16_t, uint32_t>> buckets_;
+    uint64_t count_ = 0;
+};
+
+#endif // LENGTH_HISTOGRAM_H
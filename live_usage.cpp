@@ -0,0 +1,352 @@
+#include "live_usage.h"
+
+#include "database.h"
+#include "parallel_scan.h"
+#include "tracker.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct LiveSession {
+    int sessionId;  // ActivitySession row id.
+    std::string processName;
+    double startTime;
+};
+
+// Totals read on a background connection, and the state they reflect.
+struct LiveSeed {
+    bool ok = false;
+    unsigned long long generation = 0;
+    int today = 0;
+    long long lastSessionId = 0;  // Sessions after this one were not seen by the seed.
+    UsageTotals allTime;
+    UsageTotals todayTotals;
+    std::vector<LiveSession> open;
+};
+
+struct PendingEvent {
+    bool opened;
+    SessionEvent event;
+};
+
+static std::unordered_map<std::string, double> g_allTimeClosed;
+static std::unordered_map<std::string, double> g_todayClosed;
+static double g_allTimeClosedTotal = 0.0;
+static double g_todayClosedTotal = 0.0;
+static std::vector<LiveSession> g_openSessions;
+static int g_today = 0;
+static bool g_seeded = false;
+// Write generation the totals reflect. Events advance it by exactly one write each;
+// any other change means someone else wrote and the totals must be reseeded.
+static unsigned long long g_seenGeneration = 0;
+// A reseed running in the background, and the events raised since it started.
+static std::future<LiveSeed> g_reseed;
+static std::vector<PendingEvent> g_eventsSinceReseed;
+// Writes the totals missed, first and last seen at these times; a reseed waits for them
+// to stop for kReseedQuiet, or for kReseedMaxDelay after the first, so a burst of
+// writes (bulk edit batches, merges, compaction) costs one reseed.
+static const std::chrono::seconds kReseedQuiet(2);
+static const std::chrono::seconds kReseedMaxDelay(10);
+static bool g_writesMissed = false;
+static unsigned long long g_missedGeneration = 0;
+static std::chrono::steady_clock::time_point g_firstMissedWrite;
+static std::chrono::steady_clock::time_point g_lastMissedWrite;
+
+// Closed totals sorted largest first, sorted again only after they change.
+struct SortedUsage {
+    unsigned long long version = 0;
+    std::vector<ApplicationData> apps;
+};
+static unsigned long long g_closedVersion = 1;
+static SortedUsage g_sortedAllTime;
+static SortedUsage g_sortedToday;
+
+static ApplicationData makeUsage(const std::string& processName, double seconds) {
+    ApplicationData app;
+    app.processName = processName;
+    app.totalTime = seconds;
+    return app;
+}
+
+static void addClosedSession(const std::string& processName, double startTime, double endTime) {
+    double seconds = (endTime - startTime) * 86400.0;
+    g_allTimeClosed[processName] += seconds;
+    g_allTimeClosedTotal += seconds;
+    if (julianToDayNumber(startTime) == g_today) {
+        g_todayClosed[processName] += seconds;
+        g_todayClosedTotal += seconds;
+    }
+    g_closedVersion++;
+}
+
+// Rollups are always closed, so open sessions only live in ActivitySession. Sessions
+// merged from other machines are never open here (see sync.cpp); older ones may be.
+static bool readOpenSessions(sqlite3* dbHandle, std::vector<LiveSession>& open) {
+    sqlite3_stmt* stmt = nullptr;
+    const char* openSql =
+        "SELECT id, processName, startTime FROM ActivitySession WHERE endTime IS NULL AND machineId IS NULL;";
+    if (sqlite3_prepare_v2(dbHandle, openSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare live usage open session query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 1);
+        open.push_back(LiveSession{sqlite3_column_int(stmt, 0),
+                                   procName ? reinterpret_cast<const char*>(procName) : "",
+                                   sqlite3_column_double(stmt, 2)});
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Synchronous seed for startup, with the closed totals summed on the scan pool.
+static bool seedLiveUsage() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return false;
+    }
+    g_allTimeClosed.clear();
+    g_todayClosed.clear();
+    g_allTimeClosedTotal = 0.0;
+    g_todayClosedTotal = 0.0;
+    g_openSessions.clear();
+    g_today = julianToDayNumber(getCurrentJulianDay());
+    g_seenGeneration = getWriteGeneration();
+
+    // Closed totals over the whole history are summed in partitions on the scan pool.
+    UsageTotals allTime, today;
+    double todayStart = dayNumberToJulian(g_today);
+    if (!aggregateUsage(0.0, 0.0, true, allTime) || !aggregateUsage(todayStart, todayStart + 1.0, true, today))
+        return false;
+    g_allTimeClosed = std::move(allTime.processSeconds);
+    g_allTimeClosedTotal = allTime.totalSeconds;
+    g_todayClosed = std::move(today.processSeconds);
+    g_todayClosedTotal = today.totalSeconds;
+    g_closedVersion++;
+
+    if (!readOpenSessions(dbHandle, g_openSessions))
+        return false;
+    g_seeded = true;
+    return true;
+}
+
+// Reads a seed in one read transaction on its own connection. Runs off the UI thread.
+static LiveSeed readSeed(unsigned long long generation, int today) {
+    LiveSeed seed;
+    seed.generation = generation;
+    seed.today = today;
+    sqlite3* reader = openReadConnection();
+    if (!reader)
+        return seed;
+    const char* closedSql = R"(
+        SELECT processName, SUM(endTime - startTime),
+               SUM(CASE WHEN startTime >= ?1 AND startTime < ?2 THEN endTime - startTime ELSE 0 END),
+               MAX(startTime >= ?1 AND startTime < ?2)
+        FROM SessionHistory WHERE endTime IS NOT NULL GROUP BY processName;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    sqlite3_exec(reader, "BEGIN;", nullptr, nullptr, nullptr);
+    if (sqlite3_prepare_v2(reader, closedSql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, dayNumberToJulian(today));
+        sqlite3_bind_double(stmt, 2, dayNumberToJulian(today + 1));
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            const unsigned char* procName = sqlite3_column_text(stmt, 0);
+            std::string processName = procName ? reinterpret_cast<const char*>(procName) : "";
+            double seconds = sqlite3_column_double(stmt, 1) * 86400.0;
+            seed.allTime.processSeconds[processName] = seconds;
+            seed.allTime.totalSeconds += seconds;
+            if (sqlite3_column_int(stmt, 3)) {
+                double todaySeconds = sqlite3_column_double(stmt, 2) * 86400.0;
+                seed.todayTotals.processSeconds[processName] = todaySeconds;
+                seed.todayTotals.totalSeconds += todaySeconds;
+            }
+        }
+        seed.ok = rc == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+    }
+    if (seed.ok && sqlite3_prepare_v2(reader, "SELECT MAX(id) FROM ActivitySession;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            seed.lastSessionId = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    seed.ok = seed.ok && readOpenSessions(reader, seed.open);
+    if (!seed.ok)
+        std::cerr << "Live usage reseed failed: " << sqlite3_errmsg(reader) << std::endl;
+    sqlite3_exec(reader, "COMMIT;", nullptr, nullptr, nullptr);
+    sqlite3_close(reader);
+    return seed;
+}
+
+static void startReseed() {
+    g_writesMissed = false;
+    g_eventsSinceReseed.clear();
+    g_reseed = std::async(std::launch::async, readSeed, getWriteGeneration(),
+                          julianToDayNumber(getCurrentJulianDay()));
+}
+
+static void closeLiveSession(const SessionEvent& event) {
+    auto it = std::find_if(g_openSessions.begin(), g_openSessions.end(),
+                           [&](const LiveSession& s) { return s.sessionId == event.sessionId; });
+    if (it == g_openSessions.end())
+        return;
+    addClosedSession(it->processName, it->startTime, std::max(event.time, it->startTime));
+    g_openSessions.erase(it);
+}
+
+// Installs a finished seed and replays the events raised while it was read. The seed's
+// read transaction may have started after some of them, so replay skips what it saw:
+// sessions up to lastSessionId, and closes of sessions it did not find open.
+static void installSeed(LiveSeed seed) {
+    unsigned long long generation = getWriteGeneration();
+    if (!seed.ok || seed.today != julianToDayNumber(getCurrentJulianDay())) {
+        g_seeded = false;
+        return;
+    }
+    // Any write that was not a tracker event may be missing from the seed. The current
+    // totals are kept, and the next reseed waits for those writes to settle.
+    if (generation != seed.generation + g_eventsSinceReseed.size()) {
+        g_eventsSinceReseed.clear();
+        return;
+    }
+    g_allTimeClosed = std::move(seed.allTime.processSeconds);
+    g_allTimeClosedTotal = seed.allTime.totalSeconds;
+    g_todayClosed = std::move(seed.todayTotals.processSeconds);
+    g_todayClosedTotal = seed.todayTotals.totalSeconds;
+    g_closedVersion++;
+    g_openSessions = std::move(seed.open);
+    g_today = seed.today;
+    for (const auto& pending : g_eventsSinceReseed) {
+        if (!pending.opened)
+            closeLiveSession(pending.event);
+        else if (pending.event.sessionId > seed.lastSessionId)
+            g_openSessions.push_back(LiveSession{pending.event.sessionId, pending.event.processName, pending.event.time});
+    }
+    g_eventsSinceReseed.clear();
+    g_seenGeneration = generation;
+    g_seeded = true;
+}
+
+// Reseeds in the background when history changed behind the aggregator's back or the day
+// rolled over. Until the new totals arrive the previous ones are served.
+static void ensureLiveUsageCurrent() {
+    if (g_reseed.valid()) {
+        if (g_reseed.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+        installSeed(g_reseed.get());
+    }
+    if (!g_seeded || julianToDayNumber(getCurrentJulianDay()) != g_today) {
+        startReseed();
+        return;
+    }
+    unsigned long long generation = getWriteGeneration();
+    if (generation == g_seenGeneration)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if (!g_writesMissed) {
+        g_writesMissed = true;
+        g_firstMissedWrite = now;
+    }
+    if (generation != g_missedGeneration) {
+        g_missedGeneration = generation;
+        g_lastMissedWrite = now;
+    }
+    if (now - g_lastMissedWrite >= kReseedQuiet || now - g_firstMissedWrite >= kReseedMaxDelay)
+        startReseed();
+}
+
+static const std::vector<ApplicationData>& sortedClosedUsage(bool todayOnly) {
+    SortedUsage& sorted = todayOnly ? g_sortedToday : g_sortedAllTime;
+    if (sorted.version != g_closedVersion) {
+        const auto& closed = todayOnly ? g_todayClosed : g_allTimeClosed;
+        sorted.apps.clear();
+        sorted.apps.reserve(closed.size());
+        for (const auto& entry : closed)
+            sorted.apps.push_back(makeUsage(entry.first, entry.second));
+        std::sort(sorted.apps.begin(), sorted.apps.end(),
+                  [](const ApplicationData& a, const ApplicationData& b) { return a.totalTime > b.totalTime; });
+        sorted.version = g_closedVersion;
+    }
+    return sorted.apps;
+}
+
+// True when the event's write is the only one since the totals were last brought up to date.
+static bool claimEventWrite() {
+    unsigned long long generation = getWriteGeneration();
+    if (!g_seeded || generation != g_seenGeneration + 1)
+        return false;
+    g_seenGeneration = generation;
+    return true;
+}
+
+static void onSessionOpened(const SessionEvent& event) {
+    if (g_reseed.valid())
+        g_eventsSinceReseed.push_back(PendingEvent{true, event});
+    if (!claimEventWrite())
+        return;
+    g_openSessions.push_back(LiveSession{event.sessionId, event.processName, event.time});
+}
+
+static void onSessionClosed(const SessionEvent& event) {
+    if (g_reseed.valid())
+        g_eventsSinceReseed.push_back(PendingEvent{false, event});
+    if (!claimEventWrite())
+        return;
+    auto it = std::find_if(g_openSessions.begin(), g_openSessions.end(),
+                           [&](const LiveSession& s) { return s.sessionId == event.sessionId; });
+    if (it == g_openSessions.end()) {
+        g_seeded = false;
+        return;
+    }
+    closeLiveSession(event);
+}
+
+void initLiveUsage() {
+    addSessionOpenListener(onSessionOpened);
+    addSessionCloseListener(onSessionClosed);
+    seedLiveUsage();
+}
+
+double getLiveTotalTime(bool todayOnly) {
+    ensureLiveUsageCurrent();
+    double total = todayOnly ? g_todayClosedTotal : g_allTimeClosedTotal;
+    double now = getCurrentJulianDay();
+    for (const auto& session : g_openSessions) {
+        if (!todayOnly || julianToDayNumber(session.startTime) == g_today)
+            total += std::max(0.0, now - session.startTime) * 86400.0;
+    }
+    return total;
+}
+
+std::vector<ApplicationData> getLiveProcessUsage(bool todayOnly, size_t limit) {
+    ensureLiveUsageCurrent();
+    std::vector<ApplicationData> results = sortedClosedUsage(todayOnly);
+
+    // Open sessions only add time, so each entry they touch moves towards the front.
+    double now = getCurrentJulianDay();
+    for (const auto& session : g_openSessions) {
+        if (todayOnly && julianToDayNumber(session.startTime) != g_today)
+            continue;
+        double seconds = std::max(0.0, now - session.startTime) * 86400.0;
+        auto it = std::find_if(results.begin(), results.end(),
+                               [&](const ApplicationData& app) { return app.processName == session.processName; });
+        if (it == results.end()) {
+            results.push_back(makeUsage(session.processName, 0.0));
+            it = results.end() - 1;
+        }
+        it->totalTime += seconds;
+        for (; it != results.begin() && (it - 1)->totalTime < it->totalTime; --it)
+            std::iter_swap(it, it - 1);
+    }
+
+    if (limit > 0 && limit < results.size())
+        results.resize(limit);
+    return results;
+}
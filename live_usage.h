@@ -0,0 +1,27 @@
+#ifndef LIVE_USAGE_H
+#define LIVE_USAGE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "functions.h"
+
+// In-memory per-process totals for today and for all time, kept current by the
+// tracker's session open/close events instead of by querying the database.
+// Totals are seeded from SessionHistory once; writes the aggregator did not see through
+// an event (merges, repairs, bulk edits) trigger a reseed once they have stopped for a
+// couple of seconds, so a burst of them costs one. Reseeds run on a background
+// connection, and the previous totals are served until the new ones arrive.
+// Days follow the usual convention: a session counts towards the day it started on.
+
+// Seeds the totals and subscribes to tracker events. Call after initDatabase.
+void initLiveUsage();
+
+// Total seconds tracked today or across all time, including the open sessions.
+double getLiveTotalTime(bool todayOnly = false);
+
+// Per-process totals, largest first. A non-zero limit returns only the top entries. The
+// closed totals are kept sorted, so a call only places the open sessions.
+std::vector<ApplicationData> getLiveProcessUsage(bool todayOnly = false, size_t limit = 0);
+
+#endif // LIVE_USAGE_H
@@ -1,5 +1,6 @@
 // Include core ImGui functionality.
 // including backends and gl3w (API functions et c)
+#include <algorithm>
 #include <chrono>
 #include <database.h>
 #include <imgui_internal.h>
@@ -15,12 +16,34 @@
 #include "pie_chart.h"
 #include "functions.h"
 #include "heatmap.h"
-
-#include <cstdio>   // for snprintf, sscanf
-#include <ctime>    // for std::tm, mktime
-
-static int mode = 0; // 0 = All-time, 1 = Daily average
+#include "retention.h"
+#include "integrity.h"
+#include "tags.h"
+#include "history_edit.h"
+#include "sync.h"
+#include "snapshot.h"
+#include "live_usage.h"
+#include "daily_usage.h"
+#include "civil_date.h"
+#include "minute_index.h"
+#include "timeline_pyramid.h"
+#include "parallel_scan.h"
+#include "distinct_counts.h"
+#include "session_lengths.h"
+#include "categories.h"
+#include "period_compare.h"
+#include "focus_blocks.h"
+#include "transitions.h"
+#include "query_planner.h"
+#include "session_filter.h"
+
+#include <climits>
+#include <cstdio>   // for snprintf
+
+static int mode = 0; // 0 = All-time, 1 = Day, 2 = Daily average, 3 = Week, 4 = Month, 5 = Custom range
 static char selectedDate[11];  // Default date in YYYY-MM-DD format
+static char rangeEndDate[11];  // Last day (inclusive) of the custom range
+static char filterText[256];   // Session filter expression (see session_filter.h)
 // Define an idle threshold (e.g., 5 minutes = 300000 ms)
 const DWORD idleThreshold = 300000;
 // Global or static variable to keep track of the current session ID.
@@ -62,22 +85,22 @@ static LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 }
 
 void initializeCurrentDate() {
-    std::time_t t = std::time(nullptr);
-    std::tm tm;
-    localtime_s(&tm, &t);
-    std::strftime(selectedDate, sizeof(selectedDate), "%Y-%m-%d", &tm);
+    CivilDate today = CivilDate::fromDayNumber(julianToDayNumber(getCurrentJulianDay()));
+    today.format(selectedDate);
+    today.format(rangeEndDate);
+}
+
+// The date typed into a date field, or today while the field does not hold a valid date.
+static CivilDate parseDateOrToday(const char* text) {
+    CivilDate date = CivilDate::fromDayNumber(julianToDayNumber(getCurrentJulianDay()));
+    CivilDate::parse(text, date);
+    return date;
 }
 
 // --- Calendar View Implementation ---
 // Helper: Get the number of days in a given month.
 int GetDaysInMonth(int year, int month) {
-    if (month == 2) {
-        bool leap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
-        return leap ? 29 : 28;
-    }
-    if (month == 4 || month == 6 || month == 9 || month == 11)
-        return 30;
-    return 31;
+    return CivilDate::daysInMonth(year, month);
 }
 
 // Draws a simple calendar view. When a day is clicked the global selectedDate is updated.
@@ -85,7 +108,10 @@ void DrawCalendar() {
     // Static calendar state; initialize from selectedDate on first run.
     static int calYear = 0, calMonth = 0, calDay = 0;
     if (calYear == 0) {
-        sscanf(selectedDate, "%d-%d-%d", &calYear, &calMonth, &calDay);
+        CivilDate selected = parseDateOrToday(selectedDate);
+        calYear = selected.year;
+        calMonth = selected.month;
+        calDay = selected.day;
     }
 
     // Month navigation buttons.
@@ -127,12 +153,7 @@ void DrawCalendar() {
     ImGui::Separator();
 
     // Determine first weekday of the month.
-    std::tm time_in = {};
-    time_in.tm_year = calYear - 1900;
-    time_in.tm_mon = calMonth - 1;
-    time_in.tm_mday = 1;
-    mktime(&time_in);
-    int firstWeekday = time_in.tm_wday; // Sunday = 0, Monday = 1, etc.
+    int firstWeekday = CivilDate{calYear, calMonth, 1}.weekday(); // Sunday = 0, Monday = 1, etc.
 
     int daysInMonth = GetDaysInMonth(calYear, calMonth);
     int cellWidth = 40;
@@ -159,7 +180,7 @@ void DrawCalendar() {
             calDay = day;
             mode = 1;
             // Update the global selectedDate in YYYY-MM-DD format.
-            snprintf(selectedDate, sizeof(selectedDate), "%04d-%02d-%02d", calYear, calMonth, calDay);
+            CivilDate{calYear, calMonth, calDay}.format(selectedDate);
         }
         if (push) {
             ImGui::PopStyleColor();
@@ -182,6 +203,33 @@ void DrawCalendar() {
 
 // --- End Calendar View Implementation ---
 
+// Day numbers covered by the Week, Month and custom range modes, with a label for the panes.
+static void getModeDayRange(int& firstDay, int& lastDay, std::string& label) {
+    CivilDate selected = parseDateOrToday(selectedDate);
+    int day = selected.dayNumber();
+    if (mode == 3) {
+        // Weeks start on Monday; day numbers divisible by 7 are Mondays.
+        firstDay = day - (day % 7);
+        lastDay = firstDay + 6;
+        label = std::string("in the week of ") + selectedDate;
+    } else if (mode == 4) {
+        CivilDate monthStart{selected.year, selected.month, 1};
+        char monthLabel[CivilDate::kFormattedSize];
+        monthStart.format(monthLabel);
+        firstDay = monthStart.dayNumber();
+        lastDay = firstDay + CivilDate::daysInMonth(selected.year, selected.month) - 1;
+        label = std::string("in ") + std::string(monthLabel, 7);
+    } else {
+        firstDay = day;
+        lastDay = parseDateOrToday(rangeEndDate).dayNumber();
+        label = std::string("from ") + selectedDate + " to " + rangeEndDate;
+        if (lastDay < firstDay) {
+            std::swap(firstDay, lastDay);
+            label = std::string("from ") + rangeEndDate + " to " + selectedDate;
+        }
+    }
+}
+
 void load_ImGui() {
     // --- Controls Pane ---
     ImGui::Begin("Controls");
@@ -194,52 +242,107 @@ void load_ImGui() {
     if (ImGui::Button("Day Total")) { mode = 1; }
     ImGui::SameLine();
     if (ImGui::Button("<")) {
-        std::string newDate = getPreviousDate(std::string(selectedDate));
-        strncpy(selectedDate, newDate.c_str(), sizeof(selectedDate));
-        selectedDate[sizeof(selectedDate)-1] = '\0';
+        parseDateOrToday(selectedDate).addDays(-1).format(selectedDate);
         mode = 1;
     }
     ImGui::SameLine();
     if (ImGui::Button(">")) {
-        std::string newDate = getNextDate(std::string(selectedDate));
-        strncpy(selectedDate, newDate.c_str(), sizeof(selectedDate));
-        selectedDate[sizeof(selectedDate)-1] = '\0';
+        parseDateOrToday(selectedDate).addDays(1).format(selectedDate);
         mode = 1;
     }
     ImGui::SameLine();
     if (ImGui::Button("Daily Average")) { mode = 2; }
+    if (ImGui::Button("Week")) { mode = 3; }
+    ImGui::SameLine();
+    if (ImGui::Button("Month")) { mode = 4; }
+    ImGui::SameLine();
+    if (ImGui::Button("Range")) { mode = 5; }
+    if (mode == 5)
+        ImGui::InputText("Range end (YYYY-MM-DD)", rangeEndDate, sizeof(rangeEndDate));
+    // e.g. category == "Productivity" && !title.contains("YouTube")
+    ImGui::InputText("Filter", filterText, sizeof(filterText));
+    std::string filterError;
+    if (!setSessionFilter(filterText, filterError))
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Filter: %s", filterError.c_str());
     ImGui::End();
 
+    // One pass over the history feeds every pane this frame.
+    CivilDate selected = parseDateOrToday(selectedDate);
+    char selectedText[CivilDate::kFormattedSize];
+    selected.format(selectedText);
+    UsageRange range;
+    range.timelineDate = selectedText;
+    if (mode == 1) {
+        char nextText[CivilDate::kFormattedSize];
+        selected.addDays(1).format(nextText);
+        range.startDate = selectedText;
+        range.endDate = nextText;
+    }
+    UsageSnapshot snapshot = computeSnapshot(range);
+    bool isRangeMode = mode >= 3;
+    std::string rangeLabel;
+    int firstDay = INT_MIN, lastDay = INT_MAX;
+    if (isRangeMode)
+        getModeDayRange(firstDay, lastDay, rangeLabel);
+    else if (mode == 1)
+        firstDay = lastDay = selected.dayNumber();
+    // The planner answers from the live aggregator, the per-day prefix sums, cached
+    // results or a session scan, whichever is cheapest for this range. A filter needs
+    // the sessions themselves, so it is applied during its own scan.
+    const FilteredUsage* filtered = nullptr;
+    UsageAnswer usage;
+    if (isSessionFilterActive()) {
+        filtered = &getFilteredUsage(firstDay, lastDay, selected.dayNumber());
+        usage.totalTime = filtered->totalTime;
+        usage.processes = filtered->processes;
+    } else {
+        usage = queryUsage(dayRangeQuery(firstDay, lastDay));
+    }
+    double rangeTotal = usage.totalTime;
+    // Panes built from the snapshot say so while the worker is refreshing it.
+    bool showingStale = snapshot.stale && mode == 2;
+
     // --- Total Time Tracked Pane ---
     ImGui::Begin("Total Time Tracked");
     double totalSeconds = 0.0;
     if (mode == 0) {
-        totalSeconds = getTotalTimeTrackedCurrentRun("");
+        totalSeconds = rangeTotal;
         ImGui::Text("All-Time Tracked: %s", formatTime(totalSeconds).c_str());
     } else if (mode == 1) {
-        std::string startDate(selectedDate);
-        std::string endDate = getNextDate(startDate);
-        totalSeconds = getTotalTimeTrackedCurrentRun(startDate, endDate);
+        totalSeconds = rangeTotal;
         ImGui::Text("Time Tracked on %s: %s", selectedDate, formatTime(totalSeconds).c_str());
     } else if (mode == 2) {
-        double daysTracked = getDaysTracked();
-        totalSeconds = (daysTracked > 0) ? (getTotalTimeTrackedCurrentRun("") / daysTracked) : 0.0;
+        double daysTracked = snapshot.daysTracked;
+        totalSeconds = (daysTracked > 0) ? (rangeTotal / daysTracked) : 0.0;
         ImGui::Text("Daily Average: %s", formatTime(totalSeconds).c_str());
+    } else if (isRangeMode) {
+        totalSeconds = rangeTotal;
+        ImGui::Text("Time Tracked %s: %s", rangeLabel.c_str(), formatTime(totalSeconds).c_str());
+    }
+    // Distinct counts are merged from per-day sketches, so they are estimates.
+    DistinctCounts distinct = getDistinctCounts(firstDay, lastDay);
+    ImGui::Text("Distinct windows: ~%.0f (+/-%.1f%%)", distinct.windows, distinct.windowError * 100.0);
+    ImGui::Text("Distinct apps: ~%.0f", distinct.apps);
+    if (mode != 3) {
+        int weekStart = selected.dayNumber() - (selected.dayNumber() % 7);
+        ImGui::Text("Distinct apps in the week of %s: ~%.0f", selectedText,
+                    getDistinctCounts(weekStart, weekStart + 6).apps);
     }
+    if (showingStale)
+        ImGui::TextDisabled("Updating...");
+    SnapshotCacheStats cacheStats = getSnapshotCacheStats();
+    ImGui::TextDisabled("Query cache: %lld hits, %lld misses, %lld stale (%zu ranges)",
+                        cacheStats.hits, cacheStats.misses, cacheStats.staleReads, cacheStats.entries);
     ImGui::End();
 
     // --- Top 10 Applications Pane (Table) ---
     ImGui::Begin("Top 10 Applications");
-    std::vector<ApplicationData> topApps;
-    if (mode == 0) {
-        topApps = getTopApplications("");
-    } else if (mode == 1) {
-        std::string startDate(selectedDate);
-        std::string endDate = getNextDate(startDate);
-        topApps = getTopApplications(startDate, endDate);
-    } else if (mode == 2) {
-        topApps = getTopApplications("");
-        double daysTracked = getDaysTracked();
+    if (showingStale)
+        ImGui::TextDisabled("Updating...");
+    size_t topCount = std::min<size_t>(10, usage.processes.size());
+    std::vector<ApplicationData> topApps(usage.processes.begin(), usage.processes.begin() + topCount);
+    if (mode == 2) {
+        double daysTracked = snapshot.daysTracked;
         for (auto &app : topApps) {
             if (daysTracked > 1)
                 app.totalTime = app.totalTime / daysTracked;
@@ -251,12 +354,19 @@ void load_ImGui() {
         ImGui::SetCursorPosX((availWidth - textWidth) * 0.5f);
         ImGui::Text("NO INFORMATION FOR THIS DATE");
     }
+    // A day or a range is compared with the previous period and the 4-week weekday average.
+    static const PeriodComparison kNoComparison;
+    // The baselines cover unfiltered history, so they are hidden while a filter is set.
+    const PeriodComparison& comparison = (mode == 1 || isRangeMode) && !filtered
+                                             ? getPeriodComparison(firstDay, lastDay) : kNoComparison;
     std::string hoveredTableProcess = "";
-    if (ImGui::BeginTable("AppsTable", 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    if (ImGui::BeginTable("AppsTable", comparison.available ? 4 : 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
         if (mode == 2)
             ImGui::TableSetupColumn("Process"), ImGui::TableSetupColumn("Daily Average");
         else
             ImGui::TableSetupColumn("Process"), ImGui::TableSetupColumn("Total Time");
+        if (comparison.available)
+            ImGui::TableSetupColumn("vs Previous"), ImGui::TableSetupColumn("vs 4-Week Avg");
         ImGui::TableHeadersRow();
         for (const auto &app : topApps) {
             ImGui::TableNextRow();
@@ -266,6 +376,15 @@ void load_ImGui() {
                 hoveredTableProcess = app.processName;
             ImGui::TableSetColumnIndex(1);
             ImGui::Text("%s", formatTime(app.totalTime).c_str());
+            if (comparison.available) {
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%s", formatTimeDelta(app.totalTime - getPreviousTime(comparison, app.processName)).c_str());
+                ImGui::TableSetColumnIndex(3);
+                if (comparison.baselineWeeks > 0)
+                    ImGui::Text("%s", formatTimeDelta(app.totalTime - getBaselineTime(comparison, app.processName)).c_str());
+                else
+                    ImGui::TextDisabled("-");
+            }
         }
         ImGui::EndTable();
     }
@@ -273,17 +392,33 @@ void load_ImGui() {
 
     // --- Usage Pie Chart Pane ---
     ImGui::Begin("Usage Pie Chart");
-    double overallTime = 0.0;
-    if (mode == 0) {
-        overallTime = getTotalTimeTrackedCurrentRun("");
-    } else if (mode == 1) {
-        std::string startDate(selectedDate);
-        std::string endDate = getNextDate(startDate);
-        overallTime = getTotalTimeTrackedCurrentRun(startDate, endDate);
-    } else if (mode == 2) {
-        double daysTracked = getDaysTracked();
-        overallTime = (daysTracked > 1) ? (getTotalTimeTrackedCurrentRun("") / daysTracked) : getTotalTimeTrackedCurrentRun("");
+    double overallTime = rangeTotal;
+    if (mode == 2 && snapshot.daysTracked > 1) {
+        overallTime = rangeTotal / snapshot.daysTracked;
+    }
+    // Category slices come from the grouped category totals rather than the app list.
+    static bool pieByCategory = false;
+    ImGui::Checkbox("By category", &pieByCategory);
+    std::vector<ApplicationData> pieApps;
+    std::vector<ImU32> pieColors;
+    if (pieByCategory) {
+        const std::vector<CategoryInfo>& categories = getCategories();
+        double categoryTotal = 0.0;
+        std::vector<CategoryUsage> categoryUsage = filtered ? filtered->categories : getCategoryUsage(firstDay, lastDay);
+        for (const CategoryUsage& usage : categoryUsage) {
+            ApplicationData slice;
+            slice.processName = categories[usage.category].name;
+            slice.totalTime = usage.totalTime;
+            if (mode == 2 && snapshot.daysTracked > 1)
+                slice.totalTime /= snapshot.daysTracked;
+            categoryTotal += slice.totalTime;
+            pieApps.push_back(slice);
+            pieColors.push_back(categories[usage.category].color);
+        }
+        overallTime = categoryTotal;
     }
+    const std::vector<ApplicationData>& pieSource = pieByCategory ? pieApps : topApps;
+    const std::vector<ImU32>* pieSourceColors = pieByCategory ? &pieColors : nullptr;
     if (overallTime <= 0.0) {
         float availWidth = ImGui::GetContentRegionAvail().x;
         float textWidth = ImGui::CalcTextSize("NO INFORMATION FOR THIS DATE").x;
@@ -300,9 +435,10 @@ void load_ImGui() {
         ImVec2 canvas_p1 = ImVec2(canvas_p0.x + canvas_sz.x, canvas_p0.y + canvas_sz.y);
         ImVec2 center = ImVec2((canvas_p0.x + canvas_p1.x) * 0.5f, (canvas_p0.y + canvas_p1.y) * 0.5f);
         float radius = (canvas_sz.x < canvas_sz.y ? canvas_sz.x : canvas_sz.y) * 0.4f;
-        std::string highlightProcess = hoveredTableProcess;
+        // The Top 10 table lists processes, which only match slices in the per-app pie.
+        std::string highlightProcess = pieByCategory ? "" : hoveredTableProcess;
         std::vector<std::pair<PieSlice, std::pair<float, float>>> sliceAngles;
-        DrawPieChart(topApps, overallTime, center, radius, highlightProcess, sliceAngles);
+        DrawPieChart(pieSource, overallTime, center, radius, highlightProcess, sliceAngles, pieSourceColors);
         if (highlightProcess.empty()) {
             ImVec2 mousePos = ImGui::GetIO().MousePos;
             float dx = mousePos.x - center.x;
@@ -329,16 +465,29 @@ void load_ImGui() {
                 break;
             }
         }
-        if (!hoveredTableProcess.empty() && !found) {
+        if (!pieByCategory && !hoveredTableProcess.empty() && !found) {
             highlightProcess = "Other";
         }
-        DrawPieChart(topApps, overallTime, center, radius, highlightProcess, sliceAngles);
+        DrawPieChart(pieSource, overallTime, center, radius, highlightProcess, sliceAngles, pieSourceColors);
         ImGui::Dummy(ImVec2(canvas_sz.x, 10));
         for (const auto &entry : sliceAngles) {
             if (entry.first.label == highlightProcess) {
                 char labelBuffer[256];
-                snprintf(labelBuffer, sizeof(labelBuffer), "Process: %s, Time: %s",
+                snprintf(labelBuffer, sizeof(labelBuffer), "%s: %s, Time: %s", pieByCategory ? "Category" : "Process",
                          entry.first.label.c_str(), formatTime(entry.first.value).c_str());
+                ImGui::SetCursorPosX((ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize(labelBuffer).x) * 0.5f);
+                ImGui::Text("%s", labelBuffer);
+                // The aggregated "Other" slice and categories have no per-process history.
+                if (!comparison.available || pieByCategory || entry.first.label == "Other")
+                    break;
+                std::string previous = formatTimeDelta(entry.first.value - getPreviousTime(comparison, entry.first.label));
+                if (comparison.baselineWeeks > 0) {
+                    std::string baseline = formatTimeDelta(entry.first.value - getBaselineTime(comparison, entry.first.label));
+                    snprintf(labelBuffer, sizeof(labelBuffer), "%s vs previous, %s vs 4-week average",
+                             previous.c_str(), baseline.c_str());
+                } else {
+                    snprintf(labelBuffer, sizeof(labelBuffer), "%s vs previous", previous.c_str());
+                }
                 float textWidth = ImGui::CalcTextSize(labelBuffer).x;
                 float availWidth = ImGui::GetContentRegionAvail().x;
                 ImGui::SetCursorPosX((availWidth - textWidth) * 0.5f);
@@ -346,6 +495,11 @@ void load_ImGui() {
                 break;
             }
         }
+        if (comparison.available) {
+            ImGui::Text("Total vs previous: %s", formatTimeDelta(overallTime - comparison.previousTotal).c_str());
+            if (comparison.baselineWeeks > 0)
+                ImGui::Text("Total vs 4-week average: %s", formatTimeDelta(overallTime - comparison.baselineTotal).c_str());
+        }
     }
     ImGui::End();
 
@@ -355,20 +509,56 @@ void load_ImGui() {
     ImGui::End();
 
     // --- Heatmap Pane ---
-    DrawHeatMap(selectedDate);
+    if (filtered)
+        DrawHeatMap(selectedDate, filtered->hourly);
+    else
+        DrawHeatMap(selectedDate, snapshot.hourly, snapshot.stale);
 
     // App Category Pane
-    DrawAppCategoryPane();
+    DrawAppCategoryPane(getLiveProcessUsage());
+
+    // --- Tags Pane ---
+    DrawTagPane(selectedDate);
+
+    // --- History Editor Pane ---
+    DrawHistoryEditPane();
+
+    // --- Sync Pane ---
+    DrawSyncPane();
+    DrawTimeWindowPane();
+    DrawTimelineExplorer();
+    DrawSessionLengthPane();
+    DrawContextSwitchPane(firstDay, lastDay, rangeTotal);
+    DrawQueryPlannerPane();
 }
 
 //-----------------------------------------------------------------------------
 // Main entry point of the application.
 //-----------------------------------------------------------------------------
-int main(int, char**)
+int main(int argc, char** argv)
 {
     if (!initDatabase("activity_log.db")) {
         return 1;
     }
+    // "tracker --merge <directory>" merges other machines' changesets and exits.
+    if (argc >= 3 && std::string(argv[1]) == "--merge") {
+        setSyncDirectory(argv[2]);
+        MergeResult result = mergeFromSyncDirectory();
+        printf("Merged %d changesets from %d machines.\n", result.changesets, result.machines);
+        closeDatabase();
+        return 0;
+    }
+    startChangeRecording();
+    initLiveUsage();
+    initDailyUsage();
+    initCategories();
+    initMinuteIndex();
+    initTimelinePyramid();
+    initDistinctCounts();
+    initSessionLengths();
+    initFocusBlocks();
+    initTransitions();
+    startSnapshotWorker();
     WNDCLASSEX wc = {
         sizeof(WNDCLASSEX),
         CS_CLASSDC,
@@ -453,6 +643,16 @@ int main(int, char**)
         ImGui::NewFrame();
         load_ImGui();
         checkActiveSessionIntegrity();
+        runRetentionMaintenance();
+        runIntegrityScanMaintenance();
+        runBulkEditStep();
+        runSyncMaintenance();
+        runDailyUsageMaintenance();
+        runMinuteIndexMaintenance();
+        runDistinctCountMaintenance();
+        runSessionLengthMaintenance();
+        runFocusBlockMaintenance();
+        runTransitionMaintenance();
         ImGui::Render();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
         glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
@@ -468,6 +668,9 @@ int main(int, char**)
     ::ReleaseDC(hwnd, hdc);
     ::DestroyWindow(hwnd);
     ::UnregisterClass(wc.lpszClassName, wc.hInstance);
+    stopSnapshotWorker();
     endActiveSessions();
+    stopChangeRecording();
+    stopParallelScan();
     return 0;
 }
@@ -0,0 +1,427 @@
+#include "minute_index.h"
+
+#include "civil_date.h"
+#include "database.h"
+#include "fenwick_tree.h"
+#include "functions.h"
+#include "integrity.h"
+#include "interval_buckets.h"
+#include "tracker.h"
+#include "imgui.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+static const int kMinutesPerDay = 1440;
+static const int kMaxWindowDays = 3660;  // Longest range the Time Window pane accepts.
+
+struct IndexedOpenSession {
+    int sessionId;  // ActivitySession row id.
+    std::string processName;
+    double startTime;
+};
+
+static MinuteIndexConfig g_config;
+static int g_baseDay = 0;          // Day number of the first minute slot.
+static double g_baseJD = 0.0;      // Julian timestamp of the first minute slot.
+static size_t g_minutes = 0;
+static FenwickTree g_allProcesses;
+static std::unordered_map<std::string, FenwickTree> g_processTrees;
+static std::vector<IndexedOpenSession> g_openSessions;
+static bool g_built = false;
+static bool g_dirty = true;
+static unsigned long long g_seenGeneration = 0;
+static std::chrono::steady_clock::time_point g_lastBuild;
+
+// Calls sink(minute, seconds) for every minute slot the interval overlaps inside the horizon.
+template <typename Sink>
+static void spreadInterval(double startJD, double endJD, Sink&& sink) {
+    double from = std::max(startJD, g_baseJD);
+    double to = std::min(endJD, g_baseJD + static_cast<double>(g_minutes) / kMinutesPerDay);
+    if (to <= from)
+        return;
+    double a = (from - g_baseJD) * kMinutesPerDay;
+    double b = (to - g_baseJD) * kMinutesPerDay;
+    size_t last = std::min(static_cast<size_t>(b), g_minutes - 1);
+    for (size_t m = static_cast<size_t>(a); m <= last; m++) {
+        double overlap = std::min(b, m + 1.0) - std::max(a, static_cast<double>(m));
+        if (overlap > 0.0)
+            sink(m, overlap * 60.0);
+    }
+}
+
+static bool buildMinuteIndex() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return false;
+    }
+    g_lastBuild = std::chrono::steady_clock::now();
+    g_seenGeneration = getWriteGeneration();
+    g_baseDay = julianToDayNumber(getCurrentJulianDay()) - g_config.horizonDays + 1;
+    g_baseJD = dayNumberToJulian(g_baseDay);
+    g_minutes = static_cast<size_t>(g_config.horizonDays) * kMinutesPerDay;
+    g_openSessions.clear();
+
+    struct Row {
+        std::string processName;
+        double startTime;
+        double endTime;
+    };
+    std::vector<Row> rows;
+    sqlite3_stmt* stmt = nullptr;
+    // No session outlasts kMaxSessionDays, so that much slack on startTime finds
+    // the ones that began before the horizon and end inside it.
+    const char* closedSql =
+        "SELECT processName, startTime, endTime FROM SessionHistory "
+        "WHERE startTime >= ? AND endTime IS NOT NULL AND endTime > ?;";
+    if (sqlite3_prepare_v2(dbHandle, closedSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare minute index query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, g_baseJD - kMaxSessionDays);
+    sqlite3_bind_double(stmt, 2, g_baseJD);
+    std::unordered_map<std::string, double> processTotals;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
+        Row row{procName ? reinterpret_cast<const char*>(procName) : "",
+                sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2)};
+        processTotals[row.processName] += row.endTime - std::max(row.startTime, g_baseJD);
+        rows.push_back(std::move(row));
+    }
+    sqlite3_finalize(stmt);
+
+    // Only this machine's sessions are open; merged rows end where their changeset was written.
+    const char* openSql =
+        "SELECT id, processName, startTime FROM ActivitySession WHERE endTime IS NULL AND machineId IS NULL;";
+    if (sqlite3_prepare_v2(dbHandle, openSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare minute index open session query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 1);
+        g_openSessions.push_back(IndexedOpenSession{sqlite3_column_int(stmt, 0),
+                                                    procName ? reinterpret_cast<const char*>(procName) : "",
+                                                    sqlite3_column_double(stmt, 2)});
+    }
+    sqlite3_finalize(stmt);
+
+    // The processes with the most time in the horizon get their own tree.
+    std::vector<std::pair<std::string, double>> ranked(processTotals.begin(), processTotals.end());
+    size_t keep = std::min(ranked.size(), static_cast<size_t>(std::max(0, g_config.topProcesses)));
+    std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+    struct Intervals {
+        std::vector<double> starts;
+        std::vector<double> ends;
+    };
+    std::unordered_map<std::string, Intervals> processIntervals;
+    for (size_t i = 0; i < keep; i++)
+        processIntervals[ranked[i].first];
+    Intervals allIntervals;
+    for (const auto& row : rows) {
+        allIntervals.starts.push_back(row.startTime);
+        allIntervals.ends.push_back(row.endTime);
+        auto it = processIntervals.find(row.processName);
+        if (it != processIntervals.end()) {
+            it->second.starts.push_back(row.startTime);
+            it->second.ends.push_back(row.endTime);
+        }
+    }
+
+    BucketGrid grid = makeBucketGrid(g_baseJD, 1.0 / kMinutesPerDay, g_minutes);
+    auto toMinutes = [&](const Intervals& intervals) {
+        std::vector<double> minutes(g_minutes, 0.0);
+        accumulateIntervals(grid, intervals.starts.data(), intervals.ends.data(), intervals.starts.size(),
+                            86400.0, minutes.data());
+        return minutes;
+    };
+    g_allProcesses = FenwickTree::fromValues(toMinutes(allIntervals));
+    g_processTrees.clear();
+    for (const auto& entry : processIntervals)
+        g_processTrees[entry.first] = FenwickTree::fromValues(toMinutes(entry.second));
+    g_built = true;
+    g_dirty = false;
+    return true;
+}
+
+// True when the event's write is the only one since the index was last brought up to date.
+static bool claimEventWrite() {
+    unsigned long long generation = getWriteGeneration();
+    if (!g_built || generation != g_seenGeneration + 1) {
+        g_dirty = true;
+        return false;
+    }
+    g_seenGeneration = generation;
+    return true;
+}
+
+static void onSessionOpened(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    g_openSessions.push_back(IndexedOpenSession{event.sessionId, event.processName, event.time});
+}
+
+static void onSessionClosed(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    auto it = std::find_if(g_openSessions.begin(), g_openSessions.end(),
+                           [&](const IndexedOpenSession& s) { return s.sessionId == event.sessionId; });
+    if (it == g_openSessions.end()) {
+        g_dirty = true;
+        return;
+    }
+    auto treeIt = g_processTrees.find(it->processName);
+    FenwickTree* processTree = treeIt != g_processTrees.end() ? &treeIt->second : nullptr;
+    spreadInterval(it->startTime, std::max(event.time, it->startTime), [&](size_t minute, double seconds) {
+        g_allProcesses.add(minute, seconds);
+        if (processTree)
+            processTree->add(minute, seconds);
+    });
+    g_openSessions.erase(it);
+}
+
+void initMinuteIndex(const MinuteIndexConfig& config) {
+    g_config = config;
+    if (g_config.horizonDays < 1)
+        g_config.horizonDays = 1;
+    addSessionOpenListener(onSessionOpened);
+    addSessionCloseListener(onSessionClosed);
+    buildMinuteIndex();
+}
+
+void runMinuteIndexMaintenance() {
+    if (!g_built)
+        return;
+    if (getWriteGeneration() != g_seenGeneration ||
+        julianToDayNumber(getCurrentJulianDay()) != g_baseDay + g_config.horizonDays - 1)
+        g_dirty = true;
+    // Imports and repairs arrive in bursts, so rebuild at most every few seconds.
+    if (g_dirty && std::chrono::steady_clock::now() - g_lastBuild >= std::chrono::seconds(5))
+        buildMinuteIndex();
+}
+
+// Seconds in minute coordinates [a, b); partial minutes are prorated.
+static double sumMinutes(const FenwickTree& tree, double a, double b) {
+    if (b <= a)
+        return 0.0;
+    size_t first = static_cast<size_t>(a);
+    size_t last = static_cast<size_t>(b);
+    if (first == last)
+        return tree.rangeSum(first, first + 1) * (b - a);
+    double sum = tree.rangeSum(first, first + 1) * (first + 1 - a);
+    sum += tree.rangeSum(first + 1, last);
+    if (last < g_minutes)
+        sum += tree.rangeSum(last, last + 1) * (b - last);
+    return sum;
+}
+
+// Clipped overlap of raw sessions with the window; open sessions run until now.
+static double scanTimeWindow(const std::string& processName, double startJD, double endJD) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return 0.0;
+    }
+    const char* sql =
+        "SELECT SUM(MIN(COALESCE(endTime, ?3), ?2) - MAX(startTime, ?1)) FROM SessionHistory "
+        "WHERE startTime < ?2 AND COALESCE(endTime, ?3) > ?1 AND (?4 = '' OR processName = ?4);";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare time window query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return 0.0;
+    }
+    sqlite3_bind_double(stmt, 1, startJD);
+    sqlite3_bind_double(stmt, 2, endJD);
+    sqlite3_bind_double(stmt, 3, getCurrentJulianDay());
+    sqlite3_bind_text(stmt, 4, processName.c_str(), -1, SQLITE_TRANSIENT);
+    double seconds = 0.0;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        seconds = std::max(0.0, sqlite3_column_double(stmt, 0)) * 86400.0;
+    sqlite3_finalize(stmt);
+    return seconds;
+}
+
+// The tree answering processName, or null when queries must go to SQL.
+static const FenwickTree* indexedTree(const std::string& processName) {
+    if (!g_built || g_dirty)
+        return nullptr;
+    if (processName.empty())
+        return &g_allProcesses;
+    auto it = g_processTrees.find(processName);
+    return it == g_processTrees.end() ? nullptr : &it->second;
+}
+
+TimeWindowResult queryTimeWindow(const std::string& processName, double startJD, double endJD) {
+    TimeWindowResult result;
+    if (endJD <= startJD)
+        return result;
+    const FenwickTree* tree = indexedTree(processName);
+    double horizonEnd = g_baseJD + static_cast<double>(g_minutes) / kMinutesPerDay;
+    if (!tree || startJD < g_baseJD || endJD > horizonEnd) {
+        result.seconds = scanTimeWindow(processName, startJD, endJD);
+        return result;
+    }
+
+    result.fromIndex = true;
+    result.seconds = sumMinutes(*tree, (startJD - g_baseJD) * kMinutesPerDay, (endJD - g_baseJD) * kMinutesPerDay);
+    double now = getCurrentJulianDay();
+    for (const auto& session : g_openSessions) {
+        if (!processName.empty() && session.processName != processName)
+            continue;
+        double overlap = std::min(endJD, now) - std::max(startJD, session.startTime);
+        if (overlap > 0.0)
+            result.seconds += overlap * 86400.0;
+    }
+    return result;
+}
+
+// The clock window of every day in [firstDay, lastDay], clipped from one range scan.
+// No session outlasts kMaxSessionDays, so that much slack on startTime finds the ones
+// reaching into the first day's window.
+static double scanDailyTimeWindow(const std::string& processName, int firstDay, int lastDay,
+                                  int startMinute, int endMinute) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return 0.0;
+    }
+    const char* sql =
+        "SELECT startTime, COALESCE(endTime, ?3) FROM SessionHistory "
+        "WHERE startTime >= ?1 AND startTime < ?2 AND (?4 = '' OR processName = ?4);";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare daily time window query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return 0.0;
+    }
+    sqlite3_bind_double(stmt, 1, dayNumberToJulian(firstDay) - kMaxSessionDays);
+    sqlite3_bind_double(stmt, 2, dayNumberToJulian(lastDay + 1));
+    sqlite3_bind_double(stmt, 3, getCurrentJulianDay());
+    sqlite3_bind_text(stmt, 4, processName.c_str(), -1, SQLITE_TRANSIENT);
+    double windowStart = static_cast<double>(startMinute) / kMinutesPerDay;
+    double windowEnd = static_cast<double>(endMinute) / kMinutesPerDay;
+    double days = 0.0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        double sessionStart = sqlite3_column_double(stmt, 0);
+        double sessionEnd = sqlite3_column_double(stmt, 1);
+        int day = std::max(julianToDayNumber(sessionStart), firstDay);
+        int endDay = std::min(julianToDayNumber(sessionEnd), lastDay);
+        for (; day <= endDay; day++) {
+            double midnight = dayNumberToJulian(day);
+            double overlap = std::min(sessionEnd, midnight + windowEnd) - std::max(sessionStart, midnight + windowStart);
+            if (overlap > 0.0)
+                days += overlap;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return days * 86400.0;
+}
+
+TimeWindowResult queryDailyTimeWindow(const std::string& processName, int firstDay, int lastDay,
+                                      int startMinute, int endMinute) {
+    TimeWindowResult result;
+    if (lastDay < firstDay)
+        return result;
+    // Days inside the horizon are read from the index one window at a time; the days
+    // before and after it each take a single scan.
+    int indexedFirst = lastDay + 1, indexedLast = lastDay;
+    if (indexedTree(processName)) {
+        indexedFirst = std::max(firstDay, g_baseDay);
+        indexedLast = std::min(lastDay, g_baseDay + static_cast<int>(g_minutes / kMinutesPerDay) - 1);
+    }
+    if (indexedLast < indexedFirst) {
+        result.seconds = scanDailyTimeWindow(processName, firstDay, lastDay, startMinute, endMinute);
+        return result;
+    }
+
+    result.fromIndex = true;
+    if (firstDay < indexedFirst) {
+        result.seconds += scanDailyTimeWindow(processName, firstDay, indexedFirst - 1, startMinute, endMinute);
+        result.fromIndex = false;
+    }
+    if (indexedLast < lastDay) {
+        result.seconds += scanDailyTimeWindow(processName, indexedLast + 1, lastDay, startMinute, endMinute);
+        result.fromIndex = false;
+    }
+    for (int day = indexedFirst; day <= indexedLast; day++) {
+        double midnight = dayNumberToJulian(day);
+        TimeWindowResult dayResult = queryTimeWindow(processName,
+                                                     midnight + static_cast<double>(startMinute) / kMinutesPerDay,
+                                                     midnight + static_cast<double>(endMinute) / kMinutesPerDay);
+        result.seconds += dayResult.seconds;
+        result.fromIndex = result.fromIndex && dayResult.fromIndex;
+    }
+    return result;
+}
+
+static bool parseClock(const char* text, int& minute) {
+    int hours = 0, minutes = 0;
+    if (std::sscanf(text, "%d:%d", &hours, &minutes) != 2 || hours < 0 || hours > 24 ||
+        minutes < 0 || minutes > 59 || hours * 60 + minutes > kMinutesPerDay)
+        return false;
+    minute = hours * 60 + minutes;
+    return true;
+}
+
+void DrawTimeWindowPane() {
+    ImGui::Begin("Time Window");
+
+    static char processName[256] = "";
+    static char fromDate[11] = "";
+    static char toDate[11] = "";
+    static char startClock[6] = "09:00";
+    static char endClock[6] = "17:00";
+    static std::string resultText;
+    if (fromDate[0] == '\0') {
+        std::string today = julianToCalendarString(getCurrentJulianDay()).substr(0, 10);
+        std::snprintf(fromDate, sizeof(fromDate), "%s", today.c_str());
+        std::snprintf(toDate, sizeof(toDate), "%s", today.c_str());
+    }
+
+    ImGui::InputTextWithHint("Process", "empty for all processes", processName, sizeof(processName));
+    ImGui::InputText("From (YYYY-MM-DD)", fromDate, sizeof(fromDate));
+    ImGui::InputText("To (YYYY-MM-DD)", toDate, sizeof(toDate));
+    ImGui::InputText("Start (HH:MM)", startClock, sizeof(startClock));
+    ImGui::InputText("End (HH:MM)", endClock, sizeof(endClock));
+
+    if (ImGui::Button("Query")) {
+        int startMinute = 0, endMinute = 0;
+        CivilDate from, to;
+        if (!CivilDate::parse(fromDate, from) || !CivilDate::parse(toDate, to)) {
+            resultText = "Enter both dates as YYYY-MM-DD.";
+        } else if (to.dayNumber() < from.dayNumber()) {
+            resultText = "The From date must not be after the To date.";
+        } else if (to.dayNumber() - from.dayNumber() >= kMaxWindowDays) {
+            char line[96];
+            std::snprintf(line, sizeof(line), "Choose a range of at most %d days.", kMaxWindowDays);
+            resultText = line;
+        } else if (!parseClock(startClock, startMinute) || !parseClock(endClock, endMinute) || endMinute <= startMinute) {
+            resultText = "Enter a start time before the end time, as HH:MM.";
+        } else {
+            int firstDay = from.dayNumber();
+            int lastDay = to.dayNumber();
+            auto started = std::chrono::steady_clock::now();
+            TimeWindowResult result = queryDailyTimeWindow(processName, firstDay, lastDay, startMinute, endMinute);
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            char line[256];
+            std::snprintf(line, sizeof(line), "%s: %s over %d days (%s, %.2f ms)",
+                          processName[0] ? processName : "All processes", formatTime(result.seconds).c_str(),
+                          lastDay - firstDay + 1, result.fromIndex ? "minute index" : "raw scan", elapsedMs);
+            resultText = line;
+        }
+    }
+    if (!resultText.empty())
+        ImGui::TextWrapped("%s", resultText.c_str());
+
+    ImGui::Separator();
+    ImGui::Text("Indexed: last %d days, %zu processes (%s bucket kernel)", g_config.horizonDays,
+                g_processTrees.size(), getBucketKernelName());
+    for (const auto& entry : g_processTrees)
+        ImGui::BulletText("%s", entry.first.c_str());
+    ImGui::End();
+}
@@ -0,0 +1,40 @@
+#ifndef MINUTE_INDEX_H
+#define MINUTE_INDEX_H
+
+#include <string>
+
+// Minute-resolution usage index over the most recent days of history.
+//
+// Each minute of the horizon is a slot in a Fenwick tree holding the seconds tracked in it,
+// once for all processes and once for each of the top processes in the horizon. Closed
+// sessions are added as point updates from tracker events; open sessions are added at
+// query time. Unlike day totals, window queries clip sessions to the window.
+// Windows outside the horizon, or for processes without their own tree, fall back to SQL.
+struct MinuteIndexConfig {
+    int horizonDays = 90;   // Days covered, ending with today.
+    int topProcesses = 8;   // Processes that get their own tree.
+};
+
+struct TimeWindowResult {
+    double seconds = 0.0;
+    bool fromIndex = false;  // False if any part had to be read from SessionHistory.
+};
+
+// Builds the index and subscribes to tracker events. Call after initDatabase.
+void initMinuteIndex(const MinuteIndexConfig& config = MinuteIndexConfig());
+
+// Seconds of processName (empty for all processes) inside [startJD, endJD).
+TimeWindowResult queryTimeWindow(const std::string& processName, double startJD, double endJD);
+
+// Seconds inside the clock window [startMinute, endMinute) (minutes after midnight)
+// of every day in [firstDay, lastDay], e.g. 09:15-11:40 across the last quarter.
+// Days outside the horizon are answered by one clipped range scan.
+TimeWindowResult queryDailyTimeWindow(const std::string& processName, int firstDay, int lastDay,
+                                      int startMinute, int endMinute);
+
+// Called once per frame from the main loop; rebuilds after day rollover or foreign writes.
+void runMinuteIndexMaintenance();
+
+void DrawTimeWindowPane();
+
+#endif // MINUTE_INDEX_H
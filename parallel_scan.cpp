@@ -0,0 +1,242 @@
+#include "parallel_scan.h"
+
+#include "database.h"
+#include "functions.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static const int kPartitionsPerThread = 4;
+static const double kMinParallelSpanDays = 30.0;  // Shorter ranges are summed on the caller.
+
+static const char* kScanSql =
+    "SELECT processName, SUM(COALESCE(endTime, ?3) - startTime) FROM SessionHistory "
+    "WHERE startTime >= ?1 AND startTime < ?2 GROUP BY processName;";
+static const char* kClosedScanSql =
+    "SELECT processName, SUM(endTime - startTime) FROM SessionHistory "
+    "WHERE startTime >= ?1 AND startTime < ?2 AND endTime IS NOT NULL GROUP BY processName;";
+
+// One aggregation split into partitions. Workers take partitions by bumping 'next'.
+struct ScanJob {
+    std::vector<std::pair<double, double>> partitions;
+    bool closedOnly = false;
+    double now = 0.0;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> completed{0};
+    std::vector<UsageTotals> partials;  // One per worker.
+};
+
+static int g_threadCount = 0;  // 0 until first use, then the configured count.
+static std::vector<std::thread> g_workers;
+static std::mutex g_poolMutex;
+static std::condition_variable g_workCv;
+static std::condition_variable g_doneCv;
+static ScanJob* g_job = nullptr;
+static unsigned long long g_jobId = 0;
+static int g_busyWorkers = 0;
+static bool g_stopping = false;
+
+// Sums one partition into totals. False if the query fails.
+static bool scanPartition(sqlite3* dbHandle, sqlite3_stmt* stmt, double from, double to, double now,
+                          UsageTotals& totals) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_double(stmt, 1, from);
+    sqlite3_bind_double(stmt, 2, to);
+    sqlite3_bind_double(stmt, 3, now);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
+        double seconds = sqlite3_column_double(stmt, 1) * 86400.0;
+        totals.processSeconds[procName ? reinterpret_cast<const char*>(procName) : ""] += seconds;
+        totals.totalSeconds += seconds;
+    }
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Usage scan failed: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// seenJob is the job id at spawn time; any later job is work for this worker.
+static void scanWorkerLoop(size_t index, unsigned long long seenJob) {
+    sqlite3* reader = openReadConnection();
+    sqlite3_stmt* scan = nullptr;
+    sqlite3_stmt* closedScan = nullptr;
+    if (reader && (sqlite3_prepare_v2(reader, kScanSql, -1, &scan, nullptr) != SQLITE_OK ||
+                   sqlite3_prepare_v2(reader, kClosedScanSql, -1, &closedScan, nullptr) != SQLITE_OK)) {
+        std::cerr << "Failed to prepare usage scan: " << sqlite3_errmsg(reader) << std::endl;
+        sqlite3_finalize(scan);
+        scan = closedScan = nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(g_poolMutex);
+    while (true) {
+        g_workCv.wait(lock, [&] { return g_stopping || g_jobId != seenJob; });
+        if (g_stopping)
+            break;
+        seenJob = g_jobId;
+        ScanJob* job = g_job;
+        lock.unlock();
+
+        // A worker without a connection takes no partitions; the caller notices the gap.
+        if (scan) {
+            sqlite3_stmt* stmt = job->closedOnly ? closedScan : scan;
+            // One read transaction per job keeps this worker's partitions on one snapshot. Other
+            // workers begin theirs separately, so a write landing in between can show in some
+            // partitions and not others.
+            sqlite3_exec(reader, "BEGIN;", nullptr, nullptr, nullptr);
+            size_t partition;
+            while ((partition = job->next.fetch_add(1)) < job->partitions.size()) {
+                const auto& range = job->partitions[partition];
+                if (scanPartition(reader, stmt, range.first, range.second, job->now, job->partials[index]))
+                    job->completed.fetch_add(1);
+            }
+            sqlite3_reset(stmt);
+            sqlite3_exec(reader, "COMMIT;", nullptr, nullptr, nullptr);
+        }
+
+        lock.lock();
+        if (--g_busyWorkers == 0)
+            g_doneCv.notify_all();
+    }
+    lock.unlock();
+    sqlite3_finalize(scan);
+    sqlite3_finalize(closedScan);
+    if (reader)
+        sqlite3_close(reader);
+}
+
+static void resolveThreadCount() {
+    if (g_threadCount == 0)
+        g_threadCount = static_cast<int>(std::clamp(std::thread::hardware_concurrency(), 1u, 8u));
+}
+
+static void startPool() {
+    resolveThreadCount();
+    if (g_threadCount < 2 || !g_workers.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(g_poolMutex);
+        g_stopping = false;
+    }
+    for (int i = 0; i < g_threadCount; i++)
+        g_workers.emplace_back(scanWorkerLoop, static_cast<size_t>(i), g_jobId);
+}
+
+void stopParallelScan() {
+    {
+        std::lock_guard<std::mutex> lock(g_poolMutex);
+        g_stopping = true;
+    }
+    g_workCv.notify_all();
+    for (auto& worker : g_workers)
+        worker.join();
+    g_workers.clear();
+}
+
+void setParallelScanThreads(int threads) {
+    stopParallelScan();
+    g_threadCount = std::max(1, threads);
+}
+
+int getParallelScanThreads() {
+    resolveThreadCount();
+    return g_threadCount;
+}
+
+// Bounds of every session start, read from the startTime indexes of both tables.
+static bool startTimeBounds(sqlite3* dbHandle, double& first, double& last) {
+    const char* sql = R"(
+        SELECT MIN(a), MAX(b) FROM (
+            SELECT MIN(startTime) AS a, MAX(startTime) AS b FROM ActivitySession
+            UNION ALL
+            SELECT MIN(startTime), MAX(startTime) FROM ActivityRollup
+        );
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare session bounds query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    bool found = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    if (found) {
+        first = sqlite3_column_double(stmt, 0);
+        last = sqlite3_column_double(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+static bool aggregateOnCaller(sqlite3* dbHandle, double from, double to, bool closedOnly, double now,
+                              UsageTotals& out) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, closedOnly ? kClosedScanSql : kScanSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare usage scan: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    bool ok = scanPartition(dbHandle, stmt, from, to, now, out);
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+bool aggregateUsage(double startJD, double endJD, bool closedOnly, UsageTotals& out) {
+    out = UsageTotals();
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return false;
+    }
+    double now = getCurrentJulianDay();
+
+    // Clamp the range to the sessions that exist so partitions are not wasted on empty time.
+    double first = 0.0, last = 0.0;
+    if (!startTimeBounds(dbHandle, first, last))
+        return true;
+    double from = std::max(startJD, first);
+    double to = endJD > 0.0 ? std::min(endJD, last + 1.0) : last + 1.0;
+    if (to <= from)
+        return true;
+
+    startPool();
+    if (g_workers.empty() || to - from < kMinParallelSpanDays)
+        return aggregateOnCaller(dbHandle, from, to, closedOnly, now, out);
+
+    ScanJob job;
+    job.closedOnly = closedOnly;
+    job.now = now;
+    job.partials.resize(g_workers.size());
+    size_t partitionCount = g_workers.size() * kPartitionsPerThread;
+    double width = (to - from) / partitionCount;
+    for (size_t i = 0; i < partitionCount; i++) {
+        double partitionEnd = i + 1 == partitionCount ? to : from + width * (i + 1);
+        job.partitions.emplace_back(from + width * i, partitionEnd);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(g_poolMutex);
+        g_job = &job;
+        g_jobId++;
+        g_busyWorkers = static_cast<int>(g_workers.size());
+        g_workCv.notify_all();
+        g_doneCv.wait(lock, [] { return g_busyWorkers == 0; });
+        g_job = nullptr;
+    }
+
+    if (job.completed.load() != job.partitions.size()) {
+        // Some worker could not read; fall back to one pass on the main connection.
+        out = UsageTotals();
+        return aggregateOnCaller(dbHandle, from, to, closedOnly, now, out);
+    }
+    for (const auto& partial : job.partials) {
+        for (const auto& entry : partial.processSeconds)
+            out.processSeconds[entry.first] += entry.second;
+        out.totalSeconds += partial.totalSeconds;
+    }
+    return true;
+}
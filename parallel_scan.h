@@ -0,0 +1,31 @@
+#ifndef PARALLEL_SCAN_H
+#define PARALLEL_SCAN_H
+
+#include <string>
+#include <unordered_map>
+
+// Per-process totals over long ranges of SessionHistory, computed on a pool of reader threads.
+//
+// The range is cut into startTime partitions, several per thread so uneven partitions even
+// out. Each worker sums the partitions it takes on its own read connection (see
+// openReadConnection), and the partial totals are merged once all partitions are done.
+// Short ranges are summed on the calling thread, where threads would not pay off.
+
+struct UsageTotals {
+    std::unordered_map<std::string, double> processSeconds;
+    double totalSeconds = 0.0;
+};
+
+// Sums (endTime - startTime) for sessions started in [startJD, endJD), per process.
+// Open sessions count up to now unless closedOnly is set. Pass 0 for endJD to include
+// everything from startJD onwards. Call from one thread at a time.
+bool aggregateUsage(double startJD, double endJD, bool closedOnly, UsageTotals& out);
+
+// Number of reader threads (default: hardware threads, at most 8). 1 disables the pool.
+void setParallelScanThreads(int threads);
+int getParallelScanThreads();
+
+// Joins the pool and closes its connections. Call before closeDatabase.
+void stopParallelScan();
+
+#endif // PARALLEL_SCAN_H
@@ -0,0 +1,75 @@
+#include "period_compare.h"
+
+#include "daily_usage.h"
+#include "database.h"
+#include "functions.h"
+#include <climits>
+#include <cmath>
+#include <vector>
+
+static const int kBaselineWeeks = 4;
+// Longer periods (and the all-time view) have no meaningful weekday baseline.
+static const int kMaxPeriodDays = 366;
+
+static PeriodComparison g_comparison;
+static unsigned long long g_revision = 0;
+static unsigned long long g_generation = 0;
+
+const PeriodComparison& getPeriodComparison(int firstDay, int lastDay) {
+    unsigned long long revision = getDailyUsageRevision();
+    unsigned long long generation = getWriteGeneration();
+    if (g_comparison.firstDay == firstDay && g_comparison.lastDay == lastDay &&
+        g_revision == revision && g_generation == generation)
+        return g_comparison;
+
+    g_comparison = PeriodComparison();
+    g_comparison.firstDay = firstDay;
+    g_comparison.lastDay = lastDay;
+    g_revision = revision;
+    g_generation = generation;
+    // Keep every shifted day number well inside int range.
+    if (lastDay < firstDay || firstDay < INT_MIN / 2 || lastDay > INT_MAX / 2 || lastDay - firstDay >= kMaxPeriodDays)
+        return g_comparison;
+
+    // Window 0 is the previous period, windows 1..4 the same days k weeks earlier.
+    int length = lastDay - firstDay + 1;
+    std::vector<DayRange> windows;
+    windows.push_back(DayRange{firstDay - length, firstDay - 1});
+    for (int week = 1; week <= kBaselineWeeks; week++)
+        windows.push_back(DayRange{firstDay - 7 * week, lastDay - 7 * week});
+    std::vector<RangeUsage> usage = getRangeUsages(windows);
+
+    g_comparison.available = true;
+    g_comparison.previousTotal = usage[0].totalTime;
+    for (const auto& app : usage[0].processes)
+        g_comparison.previous[app.processName] = app.totalTime;
+    for (size_t i = 1; i < usage.size(); i++) {
+        if (usage[i].totalTime <= 0.0)
+            continue;
+        g_comparison.baselineWeeks++;
+        g_comparison.baselineTotal += usage[i].totalTime;
+        for (const auto& app : usage[i].processes)
+            g_comparison.baseline[app.processName] += app.totalTime;
+    }
+    if (g_comparison.baselineWeeks > 1) {
+        double weeks = g_comparison.baselineWeeks;
+        g_comparison.baselineTotal /= weeks;
+        for (auto& entry : g_comparison.baseline)
+            entry.second /= weeks;
+    }
+    return g_comparison;
+}
+
+double getPreviousTime(const PeriodComparison& comparison, const std::string& processName) {
+    auto found = comparison.previous.find(processName);
+    return found != comparison.previous.end() ? found->second : 0.0;
+}
+
+double getBaselineTime(const PeriodComparison& comparison, const std::string& processName) {
+    auto found = comparison.baseline.find(processName);
+    return found != comparison.baseline.end() ? found->second : 0.0;
+}
+
+std::string formatTimeDelta(double seconds) {
+    return (seconds < 0.0 ? "-" : "+") + formatTime(std::fabs(seconds));
+}
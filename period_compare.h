@@ -0,0 +1,36 @@
+#ifndef PERIOD_COMPARE_H
+#define PERIOD_COMPARE_H
+
+#include <string>
+#include <unordered_map>
+
+// Reference totals for comparing a period of days against its history: the preceding
+// period of the same length, and the same days one to four weeks earlier (so every day
+// is compared with the same weekday), averaged over the weeks with any tracked time.
+//
+// All five reference windows are read from the DailyUsage prefix sums in one batched
+// getRangeUsages call. The result is cached until the index grows as days close, a day
+// is repaired, or session history is written, so redrawing the tables costs nothing.
+
+struct PeriodComparison {
+    bool available = false;  // False for unbounded or very long periods.
+    int firstDay = 0;
+    int lastDay = -1;
+    double previousTotal = 0.0;
+    double baselineTotal = 0.0;
+    int baselineWeeks = 0;                              // Weeks averaged into the baseline.
+    std::unordered_map<std::string, double> previous;  // Seconds per process.
+    std::unordered_map<std::string, double> baseline;
+};
+
+// Reference totals for days [firstDay, lastDay].
+const PeriodComparison& getPeriodComparison(int firstDay, int lastDay);
+
+// Seconds of process in the previous period / rolling baseline, 0 if it was not used.
+double getPreviousTime(const PeriodComparison& comparison, const std::string& processName);
+double getBaselineTime(const PeriodComparison& comparison, const std::string& processName);
+
+// "+0:12:30" / "-0:05:00".
+std::string formatTimeDelta(double seconds);
+
+#endif // PERIOD_COMPARE_H
@@ -7,7 +7,8 @@ void DrawPieChart(const std::vector<ApplicationData>& topApps,
                   const ImVec2& center,
                   float radius,
                   const std::string& highlightProcess,
-                  std::vector<std::pair<PieSlice, std::pair<float, float>>>& outSliceAngles)
+                  std::vector<std::pair<PieSlice, std::pair<float, float>>>& outSliceAngles,
+                  const std::vector<ImU32>* colors)
 {
     outSliceAngles.clear();
 
@@ -26,7 +27,9 @@ void DrawPieChart(const std::vector<ApplicationData>& topApps,
     for (size_t i = 0; i < topApps.size(); i++) {
         double percent = (overallTime > 0) ? (topApps[i].totalTime / overallTime * 100.0) : 0.0;
         // Choose a color (this simple formula can be customized).
-        ImU32 color = IM_COL32(50 + (i * 20) % 205, 100 + (i * 30) % 155, 150 + (i * 40) % 105, 255);
+        ImU32 color = (colors && i < colors->size())
+                      ? (*colors)[i]
+                      : IM_COL32(50 + (i * 20) % 205, 100 + (i * 30) % 155, 150 + (i * 40) % 105, 255);
         if (percent < thresholdPercent) {
             aggregatedSmall += topApps[i].totalTime;
         } else {
@@ -22,11 +22,13 @@ struct PieSlice {
 /// @param radius Radius of the pie chart.
 /// @param highlightProcess Process name to highlight (if any). If the hovered process is part of the aggregated group, pass "Other".
 /// @param outSliceAngles On return, each element contains a PieSlice and a pair (startAngle, endAngle).
+/// @param colors Optional color per entry of topApps (e.g. category colors); generated colors if null.
 void DrawPieChart(const std::vector<ApplicationData>& topApps,
                   double overallTime,
                   const ImVec2& center,
                   float radius,
                   const std::string& highlightProcess,
-                  std::vector<std::pair<PieSlice, std::pair<float, float>>>& outSliceAngles);
+                  std::vector<std::pair<PieSlice, std::pair<float, float>>>& outSliceAngles,
+                  const std::vector<ImU32>* colors = nullptr);
 
 #endif // PIE_CHART_H
@@ -0,0 +1,423 @@
+#include "query_planner.h"
+
+#include "daily_usage.h"
+#include "database.h"
+#include "history_edit.h"
+#include "integrity.h"
+#include "live_usage.h"
+#include "parallel_scan.h"
+#include "imgui.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+enum class UsageSource { Live, DailyIndex, Scan, Cache };
+static const int kSourceCount = 4;
+static const char* kSourceNames[kSourceCount] = {"Live", "Daily index", "Scan", "Cache"};
+
+// Estimated microseconds are baseUs + perUnitUs * units. Units are process arrays read
+// for the daily index, estimated session rows for a scan, processes copied for the cache,
+// and one per call for the live aggregator. perUnitUs follows the measured costs.
+struct SourceCost {
+    double baseUs;
+    double perUnitUs;
+    unsigned long long steps = 0;
+    double estimatedUs = 0.0;
+    double actualUs = 0.0;
+};
+static SourceCost g_costs[kSourceCount] = {
+    {0.0, 2.0},
+    {1.0, 0.1},
+    {100.0, 1.0},
+    {0.0, 0.05},
+};
+
+struct PlanStep {
+    UsageSource source = UsageSource::Scan;
+    double startTime = 0.0;  // Scan and cache: sessions started in [startTime, endTime).
+    double endTime = 0.0;
+    int firstDay = 0;        // Daily index: days [firstDay, lastDay].
+    int lastDay = -1;
+    bool todayOnly = false;  // Live: today instead of all history.
+    bool cacheable = false;  // Scan: the range ends before any session can still be open.
+    double units = 1.0;
+    double estimatedUs = 0.0;
+};
+
+struct PlanRecord {
+    std::string query;
+    std::string plan;
+    unsigned long long count = 0;
+    double estimatedUs = 0.0;  // Averages over count.
+    double actualUs = 0.0;
+};
+
+// Scan results over closed days, keyed by their bounds. The tracker only writes to today
+// and yesterday, so an entry stands until a repair reaches its days or the index changes.
+using ScanKey = std::tuple<double, double, bool>;
+static std::map<ScanKey, UsageTotals> g_scanCache;
+static unsigned long long g_cacheRevision = 0;
+static bool g_repairHandlerRegistered = false;
+
+// Row density for scan estimates, refreshed every few minutes and after repairs.
+static double g_historyStart = 0.0;
+static double g_rowsPerDay = 1.0;
+static bool g_statsValid = false;
+static std::chrono::steady_clock::time_point g_statsTime;
+
+static std::deque<PlanRecord> g_records;  // Most recent first.
+static const size_t kMaxRecords = 16;
+
+static void refreshHistoryStats(double now) {
+    auto clock = std::chrono::steady_clock::now();
+    if (g_statsValid && clock - g_statsTime < std::chrono::minutes(10))
+        return;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle)
+        return;
+    g_statsValid = true;
+    g_statsTime = clock;
+    g_historyStart = now;
+    // MIN over each table uses its startTime index.
+    const char* startQueries[] = {"SELECT MIN(startTime) FROM ActivitySession;", "SELECT MIN(startTime) FROM ActivityRollup;"};
+    for (const char* sql : startQueries) {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW &&
+            sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            g_historyStart = std::min(g_historyStart, sqlite3_column_double(stmt, 0));
+        sqlite3_finalize(stmt);
+    }
+    // The last week's session count stands in for the density of the whole history.
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT COUNT(*) FROM ActivitySession WHERE startTime >= ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, now - 7.0);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            g_rowsPerDay = std::max(1.0, sqlite3_column_int64(stmt, 0) / 7.0);
+    }
+    sqlite3_finalize(stmt);
+}
+
+// Repairs and merges can move the start of history, so the stats are read again, and
+// scans over the repaired days are dropped.
+static void onHistoryDaysChanged(int firstDay, int lastDay) {
+    g_statsValid = false;
+    double from = dayNumberToJulian(firstDay);
+    double to = dayNumberToJulian(lastDay + 1);
+    for (auto entry = g_scanCache.begin(); entry != g_scanCache.end();) {
+        if (std::get<0>(entry->first) < to && from < std::get<1>(entry->first))
+            entry = g_scanCache.erase(entry);
+        else
+            ++entry;
+    }
+}
+
+static void estimate(PlanStep& step) {
+    const SourceCost& cost = g_costs[static_cast<int>(step.source)];
+    step.estimatedUs = cost.baseUs + cost.perUnitUs * step.units;
+}
+
+// Adds a scan of [startTime, endTime), or its cached result.
+static void addScanStep(std::vector<PlanStep>& plan, double startTime, double endTime, bool perProcess, double now) {
+    PlanStep step;
+    step.startTime = std::max(startTime, g_historyStart);
+    step.endTime = std::min(endTime, now + 1.0);
+    // Open sessions keep growing, so scans reaching yesterday or today are not kept.
+    step.cacheable = step.endTime <= dayNumberToJulian(julianToDayNumber(now) - kMaxSessionDays);
+    auto cached = g_scanCache.find(ScanKey{step.startTime, step.endTime, perProcess});
+    if (cached != g_scanCache.end()) {
+        step.source = UsageSource::Cache;
+        step.units = static_cast<double>(cached->second.processSeconds.size()) + 1.0;
+    } else {
+        step.source = UsageSource::Scan;
+        step.units = std::max(0.0, std::min(step.endTime, now) - step.startTime) * g_rowsPerDay + 1.0;
+    }
+    estimate(step);
+    plan.push_back(step);
+}
+
+static double planCost(const std::vector<PlanStep>& plan) {
+    double total = 0.0;
+    for (const PlanStep& step : plan)
+        total += step.estimatedUs;
+    return total;
+}
+
+// Whole days from the index and the live aggregator, scans for everything else.
+static std::vector<PlanStep> splitPlan(const UsageQuery& query, double now, bool perProcess) {
+    std::vector<PlanStep> plan;
+    int today = julianToDayNumber(now);
+    bool openStart = query.startTime <= g_historyStart;
+    bool openEnd = query.endTime > now;
+
+    // First and last whole days; the partial days at either end are edges.
+    int firstWhole = openStart ? julianToDayNumber(g_historyStart) : julianToDayNumber(query.startTime);
+    if (!openStart && dayNumberToJulian(firstWhole) < query.startTime)
+        firstWhole++;
+    int lastWhole = openEnd ? today : julianToDayNumber(query.endTime) - 1;
+    if (firstWhole > lastWhole) {
+        addScanStep(plan, query.startTime, query.endTime, perProcess, now);
+        return plan;
+    }
+    if (!openStart && query.startTime < dayNumberToJulian(firstWhole))
+        addScanStep(plan, query.startTime, dayNumberToJulian(firstWhole), perProcess, now);
+    if (!openEnd && dayNumberToJulian(lastWhole + 1) < query.endTime)
+        addScanStep(plan, dayNumberToJulian(lastWhole + 1), query.endTime, perProcess, now);
+
+    int indexedLast = std::min(lastWhole, getIndexedThroughDay());
+    if (firstWhole <= indexedLast) {
+        PlanStep step;
+        step.source = UsageSource::DailyIndex;
+        step.firstDay = firstWhole;
+        step.lastDay = indexedLast;
+        step.units = perProcess ? static_cast<double>(getIndexedProcessCount()) + 1.0 : 1.0;
+        estimate(step);
+        plan.push_back(step);
+    }
+    int unindexedFirst = std::max(firstWhole, getIndexedThroughDay() + 1);
+    int unindexedLast = std::min(lastWhole, today - 1);
+    if (unindexedFirst <= unindexedLast)
+        addScanStep(plan, dayNumberToJulian(unindexedFirst), dayNumberToJulian(unindexedLast + 1), perProcess, now);
+    if (firstWhole <= today && today <= lastWhole) {
+        PlanStep step;
+        step.source = UsageSource::Live;
+        step.todayOnly = true;
+        estimate(step);
+        plan.push_back(step);
+    }
+    return plan;
+}
+
+static std::vector<PlanStep> choosePlan(const UsageQuery& query, double now) {
+    // All history up to now is exactly what the live aggregator keeps.
+    if (query.startTime <= g_historyStart && query.endTime > now) {
+        PlanStep step;
+        step.source = UsageSource::Live;
+        estimate(step);
+        return {step};
+    }
+    std::vector<PlanStep> split = splitPlan(query, now, query.perProcess);
+    std::vector<PlanStep> scan;
+    addScanStep(scan, query.startTime, query.endTime, query.perProcess, now);
+    return planCost(scan) < planCost(split) ? scan : split;
+}
+
+static void addTotals(std::unordered_map<std::string, double>& totals, const std::vector<ApplicationData>& processes) {
+    for (const auto& app : processes)
+        totals[app.processName] += app.totalTime;
+}
+
+static void addScanTotals(const UsageTotals& scanned, bool perProcess, UsageAnswer& answer,
+                          std::unordered_map<std::string, double>& totals) {
+    answer.totalTime += scanned.totalSeconds;
+    if (perProcess) {
+        for (const auto& entry : scanned.processSeconds)
+            totals[entry.first] += entry.second;
+    }
+}
+
+static void runStep(const PlanStep& step, bool perProcess, UsageAnswer& answer,
+                    std::unordered_map<std::string, double>& totals) {
+    switch (step.source) {
+    case UsageSource::Live:
+        answer.totalTime += getLiveTotalTime(step.todayOnly);
+        if (perProcess)
+            addTotals(totals, getLiveProcessUsage(step.todayOnly));
+        break;
+    case UsageSource::DailyIndex:
+        if (perProcess) {
+            RangeUsage usage = getRangeUsage(step.firstDay, step.lastDay);
+            answer.totalTime += usage.totalTime;
+            addTotals(totals, usage.processes);
+        } else {
+            answer.totalTime += getIndexedRangeTotal(step.firstDay, step.lastDay);
+        }
+        break;
+    case UsageSource::Scan:
+    case UsageSource::Cache: {
+        ScanKey key{step.startTime, step.endTime, perProcess};
+        auto cached = g_scanCache.find(key);
+        if (cached == g_scanCache.end()) {
+            UsageTotals scanned;
+            if (!aggregateUsage(step.startTime, step.endTime, false, scanned))
+                break;
+            if (!step.cacheable) {
+                addScanTotals(scanned, perProcess, answer, totals);
+                break;
+            }
+            cached = g_scanCache.emplace(key, std::move(scanned)).first;
+        }
+        addScanTotals(cached->second, perProcess, answer, totals);
+        break;
+    }
+    }
+}
+
+static std::string describeBound(double time, const char* open) {
+    if (std::isinf(time))
+        return open;
+    return julianToCalendarString(time).substr(0, 16);
+}
+
+static std::string describePlan(const std::vector<PlanStep>& plan) {
+    std::string text;
+    char buffer[96];
+    for (const PlanStep& step : plan) {
+        if (!text.empty())
+            text += " + ";
+        switch (step.source) {
+        case UsageSource::Live:
+            text += step.todayOnly ? "Live today" : "Live all";
+            break;
+        case UsageSource::DailyIndex:
+            std::snprintf(buffer, sizeof(buffer), "Index %d days", step.lastDay - step.firstDay + 1);
+            text += buffer;
+            break;
+        case UsageSource::Scan:
+        case UsageSource::Cache:
+            std::snprintf(buffer, sizeof(buffer), "%s %.2f days", kSourceNames[static_cast<int>(step.source)],
+                          step.endTime - step.startTime);
+            text += buffer;
+            break;
+        }
+    }
+    return text;
+}
+
+static void recordPlan(const UsageQuery& query, const std::vector<PlanStep>& plan, double estimatedUs, double actualUs) {
+    std::string queryText = describeBound(query.startTime, "start") + " .. " + describeBound(query.endTime, "now");
+    if (!query.perProcess)
+        queryText += " (total)";
+    std::string planText = describePlan(plan);
+    auto found = std::find_if(g_records.begin(), g_records.end(), [&](const PlanRecord& record) {
+        return record.query == queryText && record.plan == planText;
+    });
+    PlanRecord record;
+    if (found != g_records.end()) {
+        record = *found;
+        g_records.erase(found);
+    } else {
+        record.query = queryText;
+        record.plan = planText;
+    }
+    record.count++;
+    record.estimatedUs += (estimatedUs - record.estimatedUs) / static_cast<double>(record.count);
+    record.actualUs += (actualUs - record.actualUs) / static_cast<double>(record.count);
+    g_records.push_front(record);
+    if (g_records.size() > kMaxRecords)
+        g_records.pop_back();
+}
+
+UsageQuery dayRangeQuery(int firstDay, int lastDay, bool perProcess) {
+    UsageQuery query;
+    query.startTime = firstDay == INT_MIN ? -INFINITY : dayNumberToJulian(firstDay);
+    query.endTime = lastDay == INT_MAX ? INFINITY : dayNumberToJulian(lastDay + 1);
+    query.perProcess = perProcess;
+    return query;
+}
+
+UsageAnswer queryUsage(const UsageQuery& query) {
+    UsageAnswer answer;
+    if (!(query.startTime < query.endTime))
+        return answer;
+    double now = getCurrentJulianDay();
+    if (!g_repairHandlerRegistered) {
+        registerDayRepairHandler(onHistoryDaysChanged);
+        g_repairHandlerRegistered = true;
+    }
+    refreshHistoryStats(now);
+    if (g_cacheRevision != getDailyUsageRevision()) {
+        g_scanCache.clear();
+        g_cacheRevision = getDailyUsageRevision();
+    }
+
+    std::vector<PlanStep> plan = choosePlan(query, now);
+    std::unordered_map<std::string, double> totals;
+    double actualUs = 0.0;
+    for (const PlanStep& step : plan) {
+        auto started = std::chrono::steady_clock::now();
+        runStep(step, query.perProcess, answer, totals);
+        double stepUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+        actualUs += stepUs;
+
+        // Tune the per-unit cost towards what this step measured.
+        SourceCost& cost = g_costs[static_cast<int>(step.source)];
+        double measuredPerUnit = std::max(0.0, stepUs - cost.baseUs) / step.units;
+        cost.perUnitUs += 0.1 * (measuredPerUnit - cost.perUnitUs);
+        cost.steps++;
+        cost.estimatedUs += step.estimatedUs;
+        cost.actualUs += stepUs;
+    }
+    recordPlan(query, plan, planCost(plan), actualUs);
+
+    if (query.perProcess) {
+        answer.processes.reserve(totals.size());
+        for (const auto& entry : totals) {
+            ApplicationData app;
+            app.processName = entry.first;
+            app.totalTime = entry.second;
+            answer.processes.push_back(app);
+        }
+        std::sort(answer.processes.begin(), answer.processes.end(),
+                  [](const ApplicationData& a, const ApplicationData& b) { return a.totalTime > b.totalTime; });
+    }
+    return answer;
+}
+
+void DrawQueryPlannerPane() {
+    ImGui::Begin("Query Planner");
+    ImGui::TextDisabled("Scan estimates assume %.0f sessions per day.", g_rowsPerDay);
+    if (ImGui::BeginTable("PlannerSources", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Source", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Steps");
+        ImGui::TableSetupColumn("us per unit");
+        ImGui::TableSetupColumn("Estimated / actual");
+        ImGui::TableHeadersRow();
+        for (int source = 0; source < kSourceCount; source++) {
+            const SourceCost& cost = g_costs[source];
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(kSourceNames[source]);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%llu", cost.steps);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.3f", cost.perUnitUs);
+            ImGui::TableSetColumnIndex(3);
+            if (cost.actualUs > 0.0)
+                ImGui::Text("%.2f", cost.estimatedUs / cost.actualUs);
+            else
+                ImGui::TextDisabled("-");
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Text("Recent plans");
+    if (ImGui::BeginTable("PlannerRecords", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Range");
+        ImGui::TableSetupColumn("Plan", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Runs");
+        ImGui::TableSetupColumn("Est. us");
+        ImGui::TableSetupColumn("Actual us");
+        ImGui::TableHeadersRow();
+        for (const PlanRecord& record : g_records) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(record.query.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::TextUnformatted(record.plan.c_str());
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%llu", record.count);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.1f", record.estimatedUs);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%.1f", record.actualUs);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
@@ -0,0 +1,40 @@
+#ifndef QUERY_PLANNER_H
+#define QUERY_PLANNER_H
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "functions.h"
+
+// One entry point for "time per process over a range", routed to the cheapest source
+// that answers it exactly:
+//   - the live aggregator (all history, or today),
+//   - the DailyUsage prefix sums (whole indexed days),
+//   - a scan of SessionHistory (partial days at the range edges, days the index has not
+//     reached yet, or anything else), run on the parallel scan pool,
+//   - results of earlier scans over closed days, kept until a repair reaches them.
+// Every plan's estimated cost is compared with its measured cost. The per-source cost
+// model is tuned from those measurements, and recent decisions are kept for the planner pane.
+// Sessions count towards a range by their start time, like every other range total.
+
+struct UsageQuery {
+    double startTime = -INFINITY;  // Julian day (localtime); -INFINITY for all history.
+    double endTime = INFINITY;     // Exclusive; INFINITY for everything up to now.
+    bool perProcess = true;        // False when only the total is needed.
+};
+
+struct UsageAnswer {
+    double totalTime = 0.0;
+    std::vector<ApplicationData> processes;  // Largest first; empty unless perProcess.
+};
+
+// Sessions started in days [firstDay, lastDay]; INT_MIN / INT_MAX leave that end open.
+UsageQuery dayRangeQuery(int firstDay, int lastDay, bool perProcess = true);
+
+UsageAnswer queryUsage(const UsageQuery& query);
+
+void DrawQueryPlannerPane();
+
+#endif // QUERY_PLANNER_H
@@ -0,0 +1,94 @@
+#include "rcu.h"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Each reading thread owns one slot holding the epoch it entered its read section at (0 = not reading).
+// Slots are a cache line each, so readers entering and leaving don't invalidate each other's lines.
+static const size_t kCacheLineSize = 64;
+
+struct alignas(kCacheLineSize) ReaderSlot {
+    std::atomic<bool> inUse{false};
+    std::atomic<unsigned long long> epoch{0};
+};
+
+struct RetiredObject {
+    void* object;
+    void (*deleter)(void*);
+    unsigned long long epoch;  // Epoch the object was unpublished in.
+};
+
+static const int kMaxReaderThreads = 64;
+static ReaderSlot g_readerSlots[kMaxReaderThreads];
+static std::atomic<unsigned long long> g_epoch{1};
+static std::mutex g_retireMutex;
+static std::vector<RetiredObject> g_retired;
+
+// Releases the thread's slot when the thread exits.
+struct ThreadReaderState {
+    int slot = -1;
+    int depth = 0;
+    ~ThreadReaderState() {
+        if (slot >= 0) {
+            g_readerSlots[slot].epoch.store(0, std::memory_order_release);
+            g_readerSlots[slot].inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+static thread_local ThreadReaderState t_reader;
+
+static int claimReaderSlot() {
+    for (;;) {
+        for (int i = 0; i < kMaxReaderThreads; i++) {
+            bool expected = false;
+            if (g_readerSlots[i].inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                return i;
+        }
+        // Only reachable with more than kMaxReaderThreads live reader threads.
+        std::cerr << "RCU: all reader slots in use, waiting." << std::endl;
+        std::this_thread::yield();
+    }
+}
+
+void rcuReadLock() {
+    if (t_reader.depth++ > 0)
+        return;
+    if (t_reader.slot < 0)
+        t_reader.slot = claimReaderSlot();
+    // Must be visible before the reader loads any published pointer.
+    g_readerSlots[t_reader.slot].epoch.store(g_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+void rcuReadUnlock() {
+    if (--t_reader.depth > 0)
+        return;
+    g_readerSlots[t_reader.slot].epoch.store(0, std::memory_order_release);
+}
+
+// A retired object can be freed once every active reader entered after it was unpublished.
+static void reclaimLocked() {
+    unsigned long long oldestReader = ~0ULL;
+    for (const auto& slot : g_readerSlots) {
+        unsigned long long epoch = slot.epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0)
+            oldestReader = std::min(oldestReader, epoch);
+    }
+    auto firstKept = std::partition(g_retired.begin(), g_retired.end(),
+                                    [&](const RetiredObject& r) { return r.epoch >= oldestReader; });
+    for (auto it = firstKept; it != g_retired.end(); ++it)
+        it->deleter(it->object);
+    g_retired.erase(firstKept, g_retired.end());
+}
+
+void rcuRetire(void* object, void (*deleter)(void*)) {
+    std::lock_guard<std::mutex> lock(g_retireMutex);
+    g_retired.push_back(RetiredObject{object, deleter, g_epoch.fetch_add(1, std::memory_order_seq_cst)});
+    reclaimLocked();
+}
+
+void rcuReclaim() {
+    std::lock_guard<std::mutex> lock(g_retireMutex);
+    reclaimLocked();
+}
@@ -0,0 +1,69 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Epoch-based read-copy-update for immutable aggregate snapshots.
+//
+// Writers build a new object, swap it in with one atomic exchange and retire the old one.
+// Readers enter a read section (RcuReadGuard), load the pointer and use the object without
+// taking any lock. A retired object is freed only once every reader that was inside a
+// read section when it was retired has left, so readers never block and never see freed memory.
+
+// Marks the calling thread as reading. Sections may nest.
+void rcuReadLock();
+void rcuReadUnlock();
+
+// Hands an unpublished object to the reclaimer; it is deleted once no reader can still hold it.
+void rcuRetire(void* object, void (*deleter)(void*));
+
+// Frees whatever retired objects are no longer visible to any reader.
+void rcuReclaim();
+
+class RcuReadGuard {
+public:
+    RcuReadGuard() { rcuReadLock(); }
+    ~RcuReadGuard() { rcuReadUnlock(); }
+    RcuReadGuard(const RcuReadGuard&) = delete;
+    RcuReadGuard& operator=(const RcuReadGuard&) = delete;
+};
+
+// A published immutable T. Writers are serialized against each other; readers never wait.
+template <typename T>
+class RcuCell {
+public:
+    RcuCell() = default;
+    ~RcuCell() { delete current_.load(); }
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    // Only valid inside an RcuReadGuard; the object stays alive until the guard ends.
+    // Null until something has been published.
+    const T* read() const { return current_.load(std::memory_order_seq_cst); }
+
+    void publish(std::unique_ptr<T> next) {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        swapIn(std::move(next));
+    }
+
+    // Copy-on-write update: makeNext receives the current object (or null) and returns its successor.
+    template <typename MakeNext>
+    void update(MakeNext&& makeNext) {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        swapIn(makeNext(current_.load(std::memory_order_seq_cst)));
+    }
+
+private:
+    void swapIn(std::unique_ptr<T> next) {
+        const T* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+        if (old)
+            rcuRetire(const_cast<T*>(old), [](void* object) { delete static_cast<T*>(object); });
+    }
+
+    std::atomic<const T*> current_{nullptr};
+    std::mutex writeMutex_;
+};
+
+#endif // RCU_H
@@ -0,0 +1,328 @@
+#include "retention.h"
+
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include "sync.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+static RetentionPolicy g_policy;
+
+// Time of the next scheduled maintenance run.
+static std::chrono::steady_clock::time_point g_nextRun{};
+
+// Time a maintenance batch may take. Batches are halved while they run over it and
+// doubled back towards batchSize while they are well under it.
+static const double kMaintenanceBudgetMs = 8.0;
+static const int kMinStepRows = 25;
+static int g_stepRows = 0;
+
+// Accumulated seconds keyed by (processName, bucketKey).
+using BucketTotals = std::map<std::pair<std::string, long long>, double>;
+
+// Days whose rows a step rewrote. Time moves into the buckets of every day a session
+// touched, so a session spanning midnight changes both days.
+struct CompactedDays {
+    int firstDay = INT_MAX;
+    int lastDay = INT_MIN;
+
+    void add(double startTime, double endTime) {
+        firstDay = std::min(firstDay, julianToDayNumber(startTime));
+        lastDay = std::max(lastDay, julianToDayNumber(endTime));
+    }
+};
+
+static const char* kCompactedThroughKey = "retention.compactedThrough";
+static int g_compactedThrough = INT_MIN;
+static bool g_compactedLoaded = false;
+// Days rewritten by maintenance batches whose repair has not been sent yet.
+static CompactedDays g_pendingDays;
+
+void setRetentionPolicy(const RetentionPolicy& policy) {
+    g_policy = policy;
+    // Apply the new tiers on the next frame.
+    g_nextRun = {};
+}
+
+RetentionPolicy getRetentionPolicy() {
+    return g_policy;
+}
+
+// Splits [startJD, endJD) into fixed-width buckets and adds the overlap (in seconds)
+// of each bucket to 'out'. Bucket keys count bucketSeconds-sized steps since julian day 0,
+// so minute and hour buckets are aligned with local midnight.
+static void splitIntoBuckets(const std::string& processName, double startJD, double endJD,
+                             int bucketSeconds, BucketTotals& out) {
+    double s = startJD * 86400.0;
+    double e = endJD * 86400.0;
+    long long first = static_cast<long long>(std::floor(s / bucketSeconds));
+    long long last = static_cast<long long>(std::floor(e / bucketSeconds));
+    for (long long key = first; key <= last; key++) {
+        double lo = std::max(s, static_cast<double>(key) * bucketSeconds);
+        double hi = std::min(e, static_cast<double>(key + 1) * bucketSeconds);
+        if (hi > lo)
+            out[{processName, key}] += hi - lo;
+    }
+}
+
+// Adds every accumulated bucket into ActivityRollup.
+static bool writeBuckets(sqlite3* dbHandle, const BucketTotals& totals, int bucketSeconds) {
+    const char* sql = R"(
+        INSERT INTO ActivityRollup (processName, bucketSeconds, bucketKey, startTime, totalTime)
+        VALUES (?, ?, ?, ?, ?)
+        ON CONFLICT(processName, bucketSeconds, bucketKey)
+        DO UPDATE SET totalTime = totalTime + excluded.totalTime;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare rollup upsert: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    for (const auto& entry : totals) {
+        long long key = entry.first.second;
+        sqlite3_bind_text(stmt, 1, entry.first.first.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, bucketSeconds);
+        sqlite3_bind_int64(stmt, 3, key);
+        sqlite3_bind_double(stmt, 4, static_cast<double>(key) * bucketSeconds / 86400.0);
+        sqlite3_bind_double(stmt, 5, entry.second);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Failed to write rollup bucket: " << sqlite3_errmsg(dbHandle) << std::endl;
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Deletes the given rowids from 'table'.
+static bool deleteRows(sqlite3* dbHandle, const char* table, const std::vector<long long>& rowIds) {
+    std::string sql = std::string("DELETE FROM ") + table + " WHERE rowid = ?;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare retention delete: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    for (long long rowId : rowIds) {
+        sqlite3_bind_int64(stmt, 1, rowId);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Failed to delete compacted row: " << sqlite3_errmsg(dbHandle) << std::endl;
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Folds closed raw sessions that ended before rawCutoff into buckets.
+// Sessions that are already past hourCutoff go straight to hourly buckets.
+// Returns the number of sessions compacted, or -1 on error.
+static int compactRawSessions(sqlite3* dbHandle, double rawCutoff, double hourCutoff, int limit,
+                              CompactedDays& days) {
+    const char* sql = R"(
+        SELECT id, processName, startTime, endTime
+        FROM ActivitySession
+        WHERE endTime IS NOT NULL AND endTime < ? AND endTime >= startTime
+        ORDER BY id
+        LIMIT ?;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare raw session compaction query: "
+                  << sqlite3_errmsg(dbHandle) << std::endl;
+        return -1;
+    }
+    sqlite3_bind_double(stmt, 1, rawCutoff);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    BucketTotals minuteTotals;
+    BucketTotals hourTotals;
+    std::vector<long long> ids;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int64(stmt, 0));
+        const unsigned char* procName = sqlite3_column_text(stmt, 1);
+        std::string processName = procName ? reinterpret_cast<const char*>(procName) : "";
+        double startTime = sqlite3_column_double(stmt, 2);
+        double endTime = sqlite3_column_double(stmt, 3);
+        days.add(startTime, endTime);
+        if (endTime < hourCutoff)
+            splitIntoBuckets(processName, startTime, endTime, 3600, hourTotals);
+        else
+            splitIntoBuckets(processName, startTime, endTime, 60, minuteTotals);
+    }
+    sqlite3_finalize(stmt);
+
+    if (ids.empty())
+        return 0;
+    if (!writeBuckets(dbHandle, minuteTotals, 60) ||
+        !writeBuckets(dbHandle, hourTotals, 3600) ||
+        !deleteRows(dbHandle, "ActivitySession", ids))
+        return -1;
+    return static_cast<int>(ids.size());
+}
+
+// Folds minute buckets that start before hourCutoff into hourly buckets.
+// Returns the number of minute buckets compacted, or -1 on error.
+static int compactMinuteBuckets(sqlite3* dbHandle, double hourCutoff, int limit, CompactedDays& days) {
+    const char* sql = R"(
+        SELECT rowid, processName, bucketKey, totalTime, startTime
+        FROM ActivityRollup
+        WHERE bucketSeconds = 60 AND startTime < ?
+        ORDER BY startTime
+        LIMIT ?;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare minute bucket compaction query: "
+                  << sqlite3_errmsg(dbHandle) << std::endl;
+        return -1;
+    }
+    sqlite3_bind_double(stmt, 1, hourCutoff);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    BucketTotals hourTotals;
+    std::vector<long long> rowIds;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        rowIds.push_back(sqlite3_column_int64(stmt, 0));
+        const unsigned char* procName = sqlite3_column_text(stmt, 1);
+        std::string processName = procName ? reinterpret_cast<const char*>(procName) : "";
+        long long minuteKey = sqlite3_column_int64(stmt, 2);
+        days.add(sqlite3_column_double(stmt, 4), sqlite3_column_double(stmt, 4));
+        // Both tiers are aligned to julian day 0, so 60 minute buckets make one hour bucket.
+        hourTotals[{processName, minuteKey / 60}] += sqlite3_column_double(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+
+    if (rowIds.empty())
+        return 0;
+    if (!writeBuckets(dbHandle, hourTotals, 3600) ||
+        !deleteRows(dbHandle, "ActivityRollup", rowIds))
+        return -1;
+    return static_cast<int>(rowIds.size());
+}
+
+// Runs one compaction batch of at most limit rows in a single transaction and adds the
+// days it rewrote to rewritten. Returns the number of rows compacted.
+static int compactBatch(int limit, CompactedDays& rewritten) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return 0;
+    }
+    if (!g_policy.enabled || limit <= 0)
+        return 0;
+
+    double now = getCurrentJulianDay();
+    double rawCutoff = now - g_policy.rawDays;
+    double hourCutoff = now - std::max(g_policy.minuteDays, g_policy.rawDays);
+
+    // Every machine compacts its own copy of history; the deletes must not be synced.
+    pauseChangeRecording();
+    char* errMsg = nullptr;
+    if (sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Failed to begin retention step: " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        resumeChangeRecording();
+        return 0;
+    }
+
+    CompactedDays rawDays;
+    CompactedDays days;
+    int processed = compactRawSessions(dbHandle, rawCutoff, hourCutoff, limit, rawDays);
+    if (processed >= 0 && processed < limit) {
+        int minutes = compactMinuteBuckets(dbHandle, hourCutoff, limit - processed, days);
+        processed = (minutes < 0) ? -1 : processed + minutes;
+    }
+    // The floor moves in the same transaction as the rows it describes.
+    if (processed > 0 && rawDays.lastDay > getCompactedThroughDay() &&
+        !setMetaValue(kCompactedThroughKey, std::to_string(rawDays.lastDay)))
+        processed = -1;
+
+    if (processed < 0) {
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        resumeChangeRecording();
+        return 0;
+    }
+    if (sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Failed to commit retention step: " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        resumeChangeRecording();
+        return 0;
+    }
+    resumeChangeRecording();
+    if (processed > 0) {
+        g_compactedThrough = std::max(g_compactedThrough, rawDays.lastDay);
+        bumpWriteGeneration();
+        rewritten.firstDay = std::min({rewritten.firstDay, days.firstDay, rawDays.firstDay});
+        rewritten.lastDay = std::max({rewritten.lastDay, days.lastDay, rawDays.lastDay});
+    }
+    return processed;
+}
+
+int runRetentionStep() {
+    CompactedDays days;
+    int processed = compactBatch(g_policy.batchSize, days);
+    if (processed > 0)
+        notifyHistoryDaysChanged(days.firstDay, days.lastDay);
+    return processed;
+}
+
+int getCompactedThroughDay() {
+    if (!g_compactedLoaded) {
+        std::string stored = getMetaValue(kCompactedThroughKey);
+        int day = INT_MIN;
+        auto parsed = std::from_chars(stored.data(), stored.data() + stored.size(), day);
+        if (!stored.empty() && (parsed.ec != std::errc() || parsed.ptr != stored.data() + stored.size())) {
+            std::cerr << "Ignoring invalid " << kCompactedThroughKey << ": " << stored << std::endl;
+            day = INT_MIN;
+        }
+        g_compactedThrough = day;
+        g_compactedLoaded = true;
+    }
+    return g_compactedThrough;
+}
+
+bool isRawDerivedDayFrozen(int day) {
+    return day <= getCompactedThroughDay();
+}
+
+void runRetentionMaintenance() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < g_nextRun)
+        return;
+    if (g_stepRows <= 0 || g_stepRows > g_policy.batchSize)
+        g_stepRows = g_policy.batchSize;
+    int limit = g_stepRows;
+    int processed = compactBatch(limit, g_pendingDays);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - now).count();
+    if (ms > kMaintenanceBudgetMs)
+        g_stepRows = std::max(kMinStepRows, limit / 2);
+    else if (ms < kMaintenanceBudgetMs / 4)
+        g_stepRows = std::min(g_policy.batchSize, limit * 2);
+
+    // Keep draining a backlog one batch per frame, otherwise check again in a minute.
+    if (processed >= limit) {
+        g_nextRun = now;
+        return;
+    }
+    g_nextRun = now + std::chrono::minutes(1);
+    // The days of the whole run are repaired once, after the last batch.
+    if (g_pendingDays.lastDay >= g_pendingDays.firstDay)
+        notifyHistoryDaysChanged(g_pendingDays.firstDay, g_pendingDays.lastDay);
+    g_pendingDays = CompactedDays();
+}
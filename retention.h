@@ -0,0 +1,39 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+// Tiered retention policy for old history.
+// Raw sessions are kept for rawDays, then folded into per-minute per-process
+// buckets, and minute buckets older than minuteDays are folded into per-hour buckets.
+// Buckets live in the ActivityRollup table and are read back through the
+// SessionHistory view, so aggregate totals are unchanged by compaction.
+struct RetentionPolicy {
+    bool enabled = true;
+    int rawDays = 90;       // Days of full-resolution sessions to keep.
+    int minuteDays = 365;   // Days (from now) to keep per-minute buckets before hourly.
+    int batchSize = 500;    // Maximum rows compacted by a single incremental step.
+};
+
+void setRetentionPolicy(const RetentionPolicy& policy);
+RetentionPolicy getRetentionPolicy();
+
+// Runs one compaction step of up to batchSize rows inside a single transaction and
+// reports the days it rewrote. Returns the number of source rows folded into coarser
+// buckets (0 when caught up).
+int runRetentionStep();
+
+// Last day (see julianToDayNumber) that raw sessions have been folded out of, or INT_MIN
+// before the first compaction. Each step reports the days it rewrote through
+// notifyHistoryDaysChanged.
+int getCompactedThroughDay();
+
+// True for days whose raw sessions have been folded into rollups. Aggregates built from
+// raw sessions cannot rebuild these days; they keep their stored rows and apply bulk
+// edits to them through registerFrozenDayEditHandler instead.
+bool isRawDerivedDayFrozen(int day);
+
+// Called once per frame from the main loop. Runs a batch every frame while there is a
+// backlog, otherwise only once a minute. Batches are sized to stay within a few
+// milliseconds, and the rewritten days are reported once the backlog is drained.
+void runRetentionMaintenance();
+
+#endif // RETENTION_H
@@ -0,0 +1,126 @@
+#include "session_bitmap.h"
+
+#include <algorithm>
+
+void SessionBitmap::addRange(int64_t first, int64_t last) {
+    if (last < first)
+        return;
+    // Find the first run that could touch [first, last] (ends at or after first - 1).
+    auto it = std::lower_bound(runs_.begin(), runs_.end(), first,
+                               [](const Run& run, int64_t value) { return run.second + 1 < value; });
+    auto mergeEnd = it;
+    while (mergeEnd != runs_.end() && mergeEnd->first <= last + 1) {
+        first = std::min(first, mergeEnd->first);
+        last = std::max(last, mergeEnd->second);
+        ++mergeEnd;
+    }
+    it = runs_.erase(it, mergeEnd);
+    runs_.insert(it, Run{first, last});
+}
+
+void SessionBitmap::removeRange(int64_t first, int64_t last) {
+    if (last < first)
+        return;
+    std::vector<Run> result;
+    result.reserve(runs_.size() + 1);
+    for (const Run& run : runs_) {
+        if (run.second < first || run.first > last) {
+            result.push_back(run);
+            continue;
+        }
+        if (run.first < first)
+            result.push_back({run.first, first - 1});
+        if (run.second > last)
+            result.push_back({last + 1, run.second});
+    }
+    runs_.swap(result);
+}
+
+bool SessionBitmap::contains(int64_t id) const {
+    auto it = std::lower_bound(runs_.begin(), runs_.end(), id,
+                               [](const Run& run, int64_t value) { return run.second < value; });
+    return it != runs_.end() && it->first <= id;
+}
+
+int64_t SessionBitmap::cardinality() const {
+    int64_t count = 0;
+    for (const Run& run : runs_)
+        count += run.second - run.first + 1;
+    return count;
+}
+
+SessionBitmap SessionBitmap::intersect(const SessionBitmap& a, const SessionBitmap& b) {
+    SessionBitmap result;
+    size_t i = 0, j = 0;
+    while (i < a.runs_.size() && j < b.runs_.size()) {
+        int64_t lo = std::max(a.runs_[i].first, b.runs_[j].first);
+        int64_t hi = std::min(a.runs_[i].second, b.runs_[j].second);
+        if (lo <= hi)
+            result.runs_.push_back({lo, hi});
+        // Advance whichever run ends first.
+        if (a.runs_[i].second < b.runs_[j].second)
+            i++;
+        else
+            j++;
+    }
+    return result;
+}
+
+SessionBitmap SessionBitmap::unite(const SessionBitmap& a, const SessionBitmap& b) {
+    SessionBitmap result = a;
+    for (const Run& run : b.runs_)
+        result.addRange(run.first, run.second);
+    return result;
+}
+
+static void writeVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool readVarint(const unsigned char*& p, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Layout: run count, then per run the gap from the previous run's end and the run length.
+std::string SessionBitmap::serialize() const {
+    std::string out;
+    writeVarint(out, runs_.size());
+    int64_t prevEnd = 0;
+    for (const Run& run : runs_) {
+        writeVarint(out, static_cast<uint64_t>(run.first - prevEnd));
+        writeVarint(out, static_cast<uint64_t>(run.second - run.first));
+        prevEnd = run.second;
+    }
+    return out;
+}
+
+SessionBitmap SessionBitmap::deserialize(const void* data, size_t size) {
+    SessionBitmap bitmap;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t count = 0;
+    if (!data || !readVarint(p, end, count))
+        return bitmap;
+    int64_t prevEnd = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t gap = 0, length = 0;
+        if (!readVarint(p, end, gap) || !readVarint(p, end, length))
+            break;
+        int64_t first = prevEnd + static_cast<int64_t>(gap);
+        int64_t last = first + static_cast<int64_t>(length);
+        bitmap.runs_.push_back({first, last});
+        prevEnd = last;
+    }
+    return bitmap;
+}
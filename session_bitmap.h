@@ -0,0 +1,36 @@
+#ifndef SESSION_BITMAP_H
+#define SESSION_BITMAP_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compressed set of integers (session ids, or the seconds a tag covers) stored as sorted,
+// disjoint, non-adjacent runs [first, last]. Both are dense along time, so tagging a time
+// range or selecting a day produces a handful of runs regardless of how much it covers.
+class SessionBitmap {
+public:
+    using Run = std::pair<int64_t, int64_t>;
+
+    void add(int64_t id) { addRange(id, id); }
+    void addRange(int64_t first, int64_t last);
+    void removeRange(int64_t first, int64_t last);
+    bool contains(int64_t id) const;
+    bool empty() const { return runs_.empty(); }
+    int64_t cardinality() const;
+    const std::vector<Run>& runs() const { return runs_; }
+
+    // Run-wise set operations; cost is linear in the number of runs.
+    static SessionBitmap intersect(const SessionBitmap& a, const SessionBitmap& b);
+    static SessionBitmap unite(const SessionBitmap& a, const SessionBitmap& b);
+
+    // Varint delta encoding used for the TagTime BLOB column.
+    std::string serialize() const;
+    static SessionBitmap deserialize(const void* data, size_t size);
+
+private:
+    std::vector<Run> runs_;
+};
+
+#endif // SESSION_BITMAP_H
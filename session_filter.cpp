@@ -0,0 +1,576 @@
+#include "session_filter.h"
+
+#include "database.h"
+#include "history_edit.h"
+#include "integrity.h"
+#include "interval_buckets.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <unordered_map>
+
+static const int kMaxTerms = 64;
+
+// Recursive descent over the expression, emitting postfix instructions as it goes.
+struct FilterParser {
+    FilterParser(const std::string& text, SessionFilter& filter) : text(text), filter(filter) {}
+
+    const std::string& text;
+    SessionFilter& filter;
+    size_t pos = 0;
+    std::string error;
+
+    void skipSpace() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+            pos++;
+    }
+
+    bool accept(const char* token) {
+        skipSpace();
+        size_t length = std::strlen(token);
+        if (text.compare(pos, length, token) != 0)
+            return false;
+        pos += length;
+        return true;
+    }
+
+    bool fail(const std::string& message) {
+        if (error.empty())
+            error = message + " at column " + std::to_string(pos + 1);
+        return false;
+    }
+
+    void emit(SessionFilter::Op op, size_t term = 0) {
+        SessionFilter::Instruction instruction;
+        instruction.op = op;
+        instruction.term = static_cast<uint8_t>(term);
+        filter.program_.push_back(instruction);
+    }
+
+    bool parseOr() {
+        if (!parseAnd())
+            return false;
+        while (accept("||")) {
+            if (!parseAnd())
+                return false;
+            emit(SessionFilter::Op::Or);
+        }
+        return true;
+    }
+
+    bool parseAnd() {
+        if (!parseUnary())
+            return false;
+        while (accept("&&")) {
+            if (!parseUnary())
+                return false;
+            emit(SessionFilter::Op::And);
+        }
+        return true;
+    }
+
+    bool parseUnary() {
+        if (accept("!")) {
+            if (!parseUnary())
+                return false;
+            emit(SessionFilter::Op::Not);
+            return true;
+        }
+        if (accept("(")) {
+            if (!parseOr())
+                return false;
+            return accept(")") || fail("expected ')'");
+        }
+        return parseTerm();
+    }
+
+    bool parseString(std::string& value) {
+        if (!accept("\""))
+            return fail("expected a quoted string");
+        while (pos < text.size() && text[pos] != '"') {
+            if (text[pos] == '\\' && pos + 1 < text.size())
+                pos++;
+            value += text[pos++];
+        }
+        if (pos >= text.size())
+            return fail("unterminated string");
+        pos++;
+        return true;
+    }
+
+    bool parseTerm() {
+        SessionFilter::Term term;
+        if (accept("process"))
+            term.field = SessionFilter::Field::Process;
+        else if (accept("title"))
+            term.field = SessionFilter::Field::Title;
+        else if (accept("category"))
+            term.field = SessionFilter::Field::Category;
+        else
+            return fail("expected process, title or category");
+
+        bool negate = false;
+        bool call = false;
+        if (accept("==")) {
+            term.test = SessionFilter::Test::Equals;
+        } else if (accept("!=")) {
+            term.test = SessionFilter::Test::Equals;
+            negate = true;
+        } else if (accept(".contains(")) {
+            term.test = SessionFilter::Test::Contains;
+            call = true;
+        } else if (accept(".startsWith(")) {
+            term.test = SessionFilter::Test::StartsWith;
+            call = true;
+        } else {
+            return fail("expected ==, !=, .contains( or .startsWith(");
+        }
+        if (!parseString(term.value))
+            return false;
+        if (call && !accept(")"))
+            return fail("expected ')'");
+
+        if (term.field == SessionFilter::Field::Category) {
+            if (term.test != SessionFilter::Test::Equals)
+                return fail("categories can only be compared with == or !=");
+            const std::vector<CategoryInfo>& categories = getCategories();
+            for (size_t i = 0; i < categories.size(); i++) {
+                if (categories[i].name == term.value)
+                    term.category = static_cast<int>(i);
+            }
+            if (term.category < 0)
+                return fail("unknown category \"" + term.value + "\"");
+        }
+        if (filter.terms_.size() >= kMaxTerms)
+            return fail("too many terms (at most 64)");
+        if (term.test == SessionFilter::Test::Contains) {
+            // Horspool: on a mismatch, shift by the distance from the last occurrence of
+            // the window's final byte to the end of the needle.
+            size_t length = term.value.size();
+            term.skip.fill(static_cast<uint32_t>(std::max<size_t>(length, 1)));
+            for (size_t i = 0; i + 1 < length; i++)
+                term.skip[static_cast<unsigned char>(term.value[i])] = static_cast<uint32_t>(length - 1 - i);
+        }
+
+        size_t index = filter.terms_.size();
+        if (term.field == SessionFilter::Field::Title)
+            filter.titleTerms_ |= uint64_t{1} << index;
+        filter.terms_.push_back(std::move(term));
+        emit(SessionFilter::Op::Term, index);
+        if (negate)
+            emit(SessionFilter::Op::Not);
+        return true;
+    }
+};
+
+bool SessionFilter::compile(const std::string& text, std::string& error) {
+    terms_.clear();
+    program_.clear();
+    titleTerms_ = 0;
+    FilterParser parser(text, *this);
+    parser.skipSpace();
+    if (parser.pos == text.size())
+        return true;
+    bool ok = parser.parseOr();
+    parser.skipSpace();
+    if (ok && parser.pos != text.size())
+        ok = parser.fail("unexpected text");
+    if (!ok) {
+        terms_.clear();
+        program_.clear();
+        titleTerms_ = 0;
+        error = parser.error;
+    }
+    return ok;
+}
+
+bool SessionFilter::testTerm(const Term& term, const char* text, size_t length) {
+    const std::string& needle = term.value;
+    size_t needleLength = needle.size();
+    switch (term.test) {
+    case Test::Equals:
+        return length == needleLength && std::memcmp(text, needle.data(), needleLength) == 0;
+    case Test::StartsWith:
+        return length >= needleLength && std::memcmp(text, needle.data(), needleLength) == 0;
+    case Test::Contains: {
+        if (needleLength == 0)
+            return true;
+        size_t last = needleLength - 1;
+        for (size_t i = 0; i + needleLength <= length; i += term.skip[static_cast<unsigned char>(text[i + last])]) {
+            if (text[i + last] == needle[last] && std::memcmp(text + i, needle.data(), last) == 0)
+                return true;
+        }
+        return false;
+    }
+    }
+    return false;
+}
+
+uint64_t SessionFilter::processTerms(const std::string& processName, int category) const {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < terms_.size(); i++) {
+        const Term& term = terms_[i];
+        bool match = false;
+        if (term.field == Field::Process)
+            match = testTerm(term, processName.data(), processName.size());
+        else if (term.field == Field::Category)
+            match = term.category == category;
+        if (match)
+            bits |= uint64_t{1} << i;
+    }
+    return bits;
+}
+
+bool SessionFilter::matches(uint64_t processTerms, const char* title, size_t titleLength) const {
+    uint64_t bits = processTerms;
+    for (uint64_t rest = titleTerms_; rest != 0; rest &= rest - 1) {
+        int index = std::countr_zero(rest);
+        if (testTerm(terms_[index], title, titleLength))
+            bits |= uint64_t{1} << index;
+    }
+    // Every term pushes at most one value, so the stack never holds more than kMaxTerms.
+    bool stack[kMaxTerms];
+    size_t depth = 0;
+    for (const Instruction& instruction : program_) {
+        switch (instruction.op) {
+        case Op::Term:
+            stack[depth++] = (bits >> instruction.term) & 1;
+            break;
+        case Op::Not:
+            stack[depth - 1] = !stack[depth - 1];
+            break;
+        case Op::And:
+            depth--;
+            stack[depth - 1] = stack[depth - 1] && stack[depth];
+            break;
+        case Op::Or:
+            depth--;
+            stack[depth - 1] = stack[depth - 1] || stack[depth];
+            break;
+        }
+    }
+    return depth == 0 || stack[0];
+}
+
+static SessionFilter g_filter;
+static std::string g_filterText;
+static std::string g_filterError;
+static unsigned long long g_filterVersion = 0;
+// Text is compiled once it has been left alone for kCompileDelay, so typing an
+// expression does not start a scan per keystroke.
+static const std::chrono::milliseconds kCompileDelay(300);
+static std::string g_pendingText;
+static std::chrono::steady_clock::time_point g_pendingSince;
+
+bool setSessionFilter(const std::string& text, std::string& error) {
+    auto now = std::chrono::steady_clock::now();
+    if (text != g_pendingText) {
+        g_pendingText = text;
+        g_pendingSince = now;
+    }
+    // Clearing the filter takes effect at once.
+    if (g_pendingText != g_filterText && (g_pendingText.empty() || now - g_pendingSince >= kCompileDelay)) {
+        g_filterText = g_pendingText;
+        g_filterError.clear();
+        g_filter.compile(g_filterText, g_filterError);
+        g_filterVersion++;
+    }
+    error = g_filterError;
+    return g_filterError.empty();
+}
+
+bool isSessionFilterActive() {
+    return !g_filter.empty();
+}
+
+struct FilteredTotals {
+    double totalTime = 0.0;
+    std::unordered_map<std::string, double> processSeconds;
+    std::vector<double> categorySeconds;
+    HourProcessMatrix hours;
+};
+
+struct OpenMatch {
+    std::string processName;
+    int category = 0;
+    double startTime = 0.0;
+};
+
+// Closed matching sessions for one (range, timeline day, filter), plus the open ones.
+// Closed sessions that started before the floor day only change through a repair, so
+// 'base' is kept across writes while the floor and the repair revision hold, and a write
+// rescans only the sessions since the floor. The base is scanned in the background.
+struct FilterCache {
+    bool valid = false;
+    bool baseReady = false;  // base answers the key below; until then 'result' is the previous one.
+    int firstDay = 0;
+    int lastDay = 0;
+    int timelineDay = 0;
+    unsigned long long filterVersion = 0;
+    unsigned long long generation = 0;
+    unsigned long long assignmentVersion = 0;
+    unsigned long long repairRevision = 0;
+    int floorDay = 0;  // Yesterday when base was scanned.
+    std::chrono::steady_clock::time_point scannedAt;
+    double rangeStart = 0.0;
+    double rangeEnd = 0.0;
+    BucketGrid hours;
+    FilteredTotals base;    // Closed sessions that started before the floor.
+    FilteredTotals closed;  // base plus the closed sessions since the floor.
+    std::vector<OpenMatch> open;
+    FilteredUsage result;
+};
+static FilterCache g_cache;
+static unsigned long long g_repairRevision = 0;  // Repairs that reached days before the floor.
+static bool g_repairHandlerRegistered = false;
+
+// Matching closed sessions before the floor, read on a connection of their own.
+struct BaseScan {
+    bool ok = false;
+    FilteredTotals base;
+};
+static std::future<BaseScan> g_baseScan;
+// Bumped for every base scan started; a running scan stops once it is not the latest.
+static std::atomic<unsigned long long> g_baseRequest{0};
+
+static const char* kClosedSql =
+    "SELECT processName, windowTitle, startTime, endTime FROM SessionHistory "
+    "WHERE startTime >= ? AND startTime < ? AND endTime IS NOT NULL;";
+
+// Sessions are attributed to the range by their start time; the timeline clips them to each hour.
+static void addMatch(FilteredTotals& totals, const FilterCache& cache, const std::string& processName,
+                     int category, double sessionStart, double sessionEnd) {
+    if (sessionStart >= cache.rangeStart && sessionStart < cache.rangeEnd) {
+        double seconds = (sessionEnd - sessionStart) * 86400.0;
+        totals.processSeconds[processName] += seconds;
+        totals.categorySeconds[category] += seconds;
+        totals.totalTime += seconds;
+    }
+    if (sessionEnd > cache.hours.start && sessionStart < cache.hours.start + 1.0)
+        addSessionToHourMatrix(totals.hours, cache.hours, processName, sessionStart, sessionEnd);
+}
+
+// Adds the matching sessions 'stmt' returns (processName, windowTitle, startTime, endTime)
+// to totals; those with a NULL endTime go to open instead. With a base scan request, stops
+// and returns false once a newer scan has been requested.
+static bool addMatchingRows(sqlite3_stmt* stmt, const SessionFilter& filter, const FilterCache& cache,
+                            FilteredTotals& totals, std::vector<OpenMatch>* open, unsigned long long request) {
+    // Process names are interned for the scan, with their process and category terms.
+    struct ProcessEntry {
+        int category = 0;
+        uint64_t terms = 0;
+    };
+    std::unordered_map<std::string, ProcessEntry> processes;
+    std::string processName;
+    bool processOnly = filter.processOnly();
+    size_t rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (request != 0 && (++rows & 1023) == 0 && g_baseRequest.load(std::memory_order_relaxed) != request)
+            return false;
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
+        processName.assign(procName ? reinterpret_cast<const char*>(procName) : "");
+        auto entry = processes.find(processName);
+        if (entry == processes.end()) {
+            ProcessEntry created;
+            created.category = getProcessCategory(processName);
+            created.terms = filter.processTerms(processName, created.category);
+            entry = processes.emplace(processName, created).first;
+        }
+        bool match;
+        if (processOnly) {
+            match = filter.matches(entry->second.terms, "", 0);
+        } else {
+            const unsigned char* title = sqlite3_column_text(stmt, 1);
+            match = filter.matches(entry->second.terms, title ? reinterpret_cast<const char*>(title) : "",
+                                   static_cast<size_t>(sqlite3_column_bytes(stmt, 1)));
+        }
+        if (!match)
+            continue;
+
+        double sessionStart = sqlite3_column_double(stmt, 2);
+        if (sqlite3_column_type(stmt, 3) == SQLITE_NULL) {
+            if (open)
+                open->push_back(OpenMatch{processName, entry->second.category, sessionStart});
+            continue;
+        }
+        addMatch(totals, cache, processName, entry->second.category, sessionStart, sqlite3_column_double(stmt, 3));
+    }
+    return true;
+}
+
+// Runs sql over startTime in [from, to) and adds its matching rows.
+static bool scanRows(sqlite3* dbHandle, const char* sql, double from, double to, const SessionFilter& filter,
+                     const FilterCache& cache, FilteredTotals& totals, std::vector<OpenMatch>* open,
+                     unsigned long long request = 0) {
+    if (from >= to)
+        return true;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare filtered usage scan: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, from);
+    sqlite3_bind_double(stmt, 2, to);
+    bool ok = addMatchingRows(stmt, filter, cache, totals, open, request);
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// No session outlasts kMaxSessionDays, so that much slack on startTime finds the ones
+// that began before the timeline day and end inside it.
+static void scanBounds(const FilterCache& cache, double& from, double& to) {
+    double dayStart = cache.hours.start;
+    from = std::min(cache.rangeStart, dayStart - kMaxSessionDays);
+    to = std::max(cache.rangeEnd, dayStart + 1.0);
+}
+
+// Scans the closed sessions before the floor on its own read connection. Runs off the UI
+// thread, with copies of the filter and of the cache's range, timeline grid and floor.
+static BaseScan scanBase(unsigned long long request, SessionFilter filter, FilterCache geometry) {
+    BaseScan scan;
+    scan.base.categorySeconds.assign(getCategories().size(), 0.0);
+    sqlite3* reader = openReadConnection();
+    if (!reader)
+        return scan;
+    double from, to;
+    scanBounds(geometry, from, to);
+    scan.ok = scanRows(reader, kClosedSql, from, std::min(to, dayNumberToJulian(geometry.floorDay)), filter,
+                       geometry, scan.base, nullptr, request);
+    sqlite3_close(reader);
+    return scan;
+}
+
+static void startBaseScan(const FilterCache& cache) {
+    FilterCache geometry;
+    geometry.rangeStart = cache.rangeStart;
+    geometry.rangeEnd = cache.rangeEnd;
+    geometry.hours = cache.hours;
+    geometry.floorDay = cache.floorDay;
+    // Replacing the future waits for the previous scan, which stops at its next check.
+    unsigned long long request = ++g_baseRequest;
+    g_baseScan = std::async(std::launch::async, scanBase, request, g_filter, std::move(geometry));
+}
+
+// Rescans the closed sessions since the floor and the open ones, on top of base.
+static bool scanTail(FilterCache& cache) {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle)
+        return false;
+    double from, to;
+    scanBounds(cache, from, to);
+    double floor = dayNumberToJulian(cache.floorDay);
+    // Open rows merged from other machines are sessions that machine has not closed yet;
+    // only this machine's open session counts up to now. Like any session it started
+    // yesterday or today, so the startTime index keeps this to the tail.
+    const char* openSql =
+        "SELECT processName, windowTitle, startTime, NULL FROM ActivitySession "
+        "WHERE startTime >= ? AND startTime < ? AND endTime IS NULL AND machineId IS NULL;";
+    cache.closed = cache.base;
+    cache.open.clear();
+    return scanRows(dbHandle, kClosedSql, std::max(from, floor), to, g_filter, cache, cache.closed, nullptr) &&
+           scanRows(dbHandle, openSql, std::max(from, floor), to, g_filter, cache, cache.closed, &cache.open);
+}
+
+// Repairs are reported on the UI thread. One that reaches a day before the floor
+// invalidates every base; later ones are picked up by the tail rescan.
+static void onHistoryDaysChanged(int firstDay, int) {
+    if (firstDay < julianToDayNumber(getCurrentJulianDay()) - kMaxSessionDays)
+        g_repairRevision++;
+}
+
+static void buildResult(const FilteredTotals& totals, FilteredUsage& result) {
+    result = FilteredUsage();
+    result.totalTime = totals.totalTime;
+    for (const auto& entry : totals.processSeconds) {
+        ApplicationData app;
+        app.processName = entry.first;
+        app.totalTime = entry.second;
+        result.processes.push_back(app);
+    }
+    std::sort(result.processes.begin(), result.processes.end(),
+              [](const ApplicationData& a, const ApplicationData& b) { return a.totalTime > b.totalTime; });
+    for (size_t i = 0; i < totals.categorySeconds.size(); i++) {
+        if (totals.categorySeconds[i] > 0.0)
+            result.categories.push_back(CategoryUsage{static_cast<int>(i), totals.categorySeconds[i]});
+    }
+    std::sort(result.categories.begin(), result.categories.end(),
+              [](const CategoryUsage& a, const CategoryUsage& b) { return a.totalTime > b.totalTime; });
+    result.hourly = hourlyUsageFromMatrix(totals.hours);
+}
+
+const FilteredUsage& getFilteredUsage(int firstDay, int lastDay, int timelineDay) {
+    static const FilteredUsage kEmpty;
+    if (g_filter.empty())
+        return kEmpty;
+
+    if (!g_repairHandlerRegistered) {
+        registerDayRepairHandler(onHistoryDaysChanged);
+        g_repairHandlerRegistered = true;
+    }
+
+    FilterCache& cache = g_cache;
+    auto clock = std::chrono::steady_clock::now();
+    double now = getCurrentJulianDay();
+    int floorDay = julianToDayNumber(now) - kMaxSessionDays;
+    bool keyChanged = !cache.valid || cache.firstDay != firstDay || cache.lastDay != lastDay ||
+                      cache.timelineDay != timelineDay || cache.filterVersion != g_filterVersion;
+    bool baseChanged = keyChanged || cache.floorDay != floorDay || cache.repairRevision != g_repairRevision ||
+                       cache.assignmentVersion != getCategoryAssignmentVersion();
+    if (baseChanged) {
+        cache.valid = true;
+        cache.baseReady = false;
+        cache.firstDay = firstDay;
+        cache.lastDay = lastDay;
+        cache.timelineDay = timelineDay;
+        cache.filterVersion = g_filterVersion;
+        cache.assignmentVersion = getCategoryAssignmentVersion();
+        cache.repairRevision = g_repairRevision;
+        cache.floorDay = floorDay;
+        cache.rangeStart = firstDay == INT_MIN ? 0.0 : dayNumberToJulian(firstDay);
+        cache.rangeEnd = lastDay == INT_MAX ? now + 1.0 : dayNumberToJulian(lastDay + 1);
+        cache.hours = makeDayBucketGrid(dayNumberToJulian(timelineDay), kHourBuckets);
+        startBaseScan(cache);
+    }
+
+    // The previous result is served until the base scan is in.
+    bool baseArrived = false;
+    if (!cache.baseReady) {
+        if (g_baseScan.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return cache.result;
+        BaseScan scan = g_baseScan.get();
+        cache.valid = scan.ok;
+        if (!scan.ok)
+            return cache.result;
+        cache.base = std::move(scan.base);
+        cache.baseReady = true;
+        baseArrived = true;
+    }
+
+    bool rescanned = false;
+    if (baseArrived || (cache.generation != getWriteGeneration() && clock - cache.scannedAt >= std::chrono::seconds(5))) {
+        cache.generation = getWriteGeneration();
+        cache.scannedAt = clock;
+        cache.valid = scanTail(cache);
+        rescanned = true;
+    }
+    if (!rescanned && cache.open.empty())
+        return cache.result;
+
+    // Open sessions count up to now, on top of the cached closed totals.
+    if (cache.open.empty()) {
+        buildResult(cache.closed, cache.result);
+    } else {
+        FilteredTotals totals = cache.closed;
+        for (const OpenMatch& match : cache.open)
+            addMatch(totals, cache, match.processName, match.category, match.startTime, std::max(now, match.startTime));
+        buildResult(totals, cache.result);
+    }
+    return cache.result;
+}
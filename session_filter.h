@@ -0,0 +1,89 @@
+#ifndef SESSION_FILTER_H
+#define SESSION_FILTER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "categories.h"
+#include "functions.h"
+#include "heatmap.h"
+
+// Filter expressions over sessions, for example
+//     category == "Productivity" && !title.contains("YouTube")
+// A term is process, title or category compared with == or !=, or tested with
+// .contains("...") or .startsWith("..."). Terms combine with !, &&, || and parentheses.
+// Matching is case-sensitive.
+//
+// An expression is parsed once into a flat postfix program over at most 64 terms. Process
+// and category terms depend only on the process, so a scan evaluates them once per process
+// name and keeps them as a bitmask. Per session only the title terms run, using skip
+// tables built at compile time, and the program combines the bits.
+//
+// Retention rollups have no title: title terms test them as an empty title, so
+// title.contains("...") never matches a rollup and its negation always does.
+
+struct FilterParser;
+
+class SessionFilter {
+public:
+    // Replaces the program. On a parse error it returns false, sets error and leaves the filter empty.
+    bool compile(const std::string& text, std::string& error);
+    bool empty() const { return program_.empty(); }
+
+    // Bits of the terms that depend only on the process.
+    uint64_t processTerms(const std::string& processName, int category) const;
+    // True when the program has no title terms, so processTerms alone decides.
+    bool processOnly() const { return titleTerms_ == 0; }
+    bool matches(uint64_t processTerms, const char* title, size_t titleLength) const;
+
+private:
+    friend struct FilterParser;
+
+    enum class Field : uint8_t { Process, Title, Category };
+    enum class Test : uint8_t { Equals, Contains, StartsWith };
+    struct Term {
+        Field field = Field::Process;
+        Test test = Test::Equals;
+        std::string value;
+        int category = -1;                // Category terms: index into getCategories().
+        std::array<uint32_t, 256> skip{};  // Contains: Horspool shift per byte.
+    };
+    enum class Op : uint8_t { Term, Not, And, Or };
+    struct Instruction {
+        Op op = Op::Term;
+        uint8_t term = 0;
+    };
+
+    static bool testTerm(const Term& term, const char* text, size_t length);
+
+    std::vector<Term> terms_;
+    std::vector<Instruction> program_;
+    uint64_t titleTerms_ = 0;  // Bit per title term.
+};
+
+// The filter applied to the Top 10, the pie chart and the Activity Timeline. Call every
+// frame with the current text; a change is compiled once the text has been left alone for
+// 300 ms, and empty text clears the filter at once. On a parse error the previous filter is
+// dropped and error is set.
+bool setSessionFilter(const std::string& text, std::string& error);
+bool isSessionFilterActive();
+
+struct FilteredUsage {
+    double totalTime = 0.0;
+    std::vector<ApplicationData> processes;    // Largest first.
+    std::vector<CategoryUsage> categories;     // Largest first.
+    std::array<HourlyUsageData, 24> hourly{};  // timelineDay, clipped to each hour.
+};
+
+// Matching sessions started in days [firstDay, lastDay] (INT_MIN / INT_MAX leave an end
+// open), and the parts of matching sessions on timelineDay. When the range, filter or
+// categories change, the sessions before yesterday are scanned on a background read
+// connection and the previous result is returned until they are in. A write rescans only
+// the sessions since yesterday, at most every 5 seconds. This machine's open sessions are
+// added on top at the current time. Call from the UI thread.
+const FilteredUsage& getFilteredUsage(int firstDay, int lastDay, int timelineDay);
+
+#endif // SESSION_FILTER_H
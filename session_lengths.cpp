@@ -0,0 +1,414 @@
+#include "session_lengths.h"
+
+#include "civil_date.h"
+#include "daily_usage.h"
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include "retention.h"
+#include "tracker.h"
+#include "imgui.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+struct LengthOpenSession {
+    int sessionId;  // ActivitySession row id.
+    std::string processName;
+    double startTime;
+};
+
+using ProcessHistograms = std::unordered_map<std::string, LengthHistogram>;
+
+// Days up to g_storedThrough are in SessionLengthHistogram; later days are rebuilt from
+// SQL whenever a write other than a tracker event is seen.
+static std::map<int, ProcessHistograms> g_days;
+static int g_storedThrough = INT_MIN;
+static std::vector<LengthOpenSession> g_openSessions;
+static unsigned long long g_seenGeneration = 0;
+static bool g_initialized = false;
+static bool g_dirty = false;
+// Days rewritten since the last maintenance pass.
+static int g_repairFirstDay = 0;
+static int g_repairLastDay = -1;
+static std::chrono::steady_clock::time_point g_lastBuild;
+static std::chrono::steady_clock::time_point g_lastStoreCheck;
+
+static const char* kStoredThroughKey = "lengths.storedThrough";
+
+static void addSessionLength(const std::string& processName, double startTime, double endTime) {
+    g_days[julianToDayNumber(startTime)][processName].add(std::max(0.0, endTime - startTime) * 86400.0);
+}
+
+// Replaces days [firstDay, lastDay] in memory with the closed sessions started in them.
+static bool buildDays(sqlite3* dbHandle, int firstDay, int lastDay) {
+    g_days.erase(g_days.lower_bound(firstDay), g_days.upper_bound(lastDay));
+    const char* sql = R"(
+        SELECT COALESCE(processName, ''), startTime, endTime FROM ActivitySession
+        WHERE endTime IS NOT NULL AND startTime >= ? AND startTime < ?;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare session length query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, dayNumberToJulian(firstDay));
+    sqlite3_bind_double(stmt, 2, lastDay == INT_MAX ? getCurrentJulianDay() + 1.0 : dayNumberToJulian(lastDay + 1));
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        addSessionLength(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                         sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2));
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Rebuilds the days after g_storedThrough and the list of open sessions.
+static void rebuildRecentDays(sqlite3* dbHandle) {
+    g_seenGeneration = getWriteGeneration();
+    g_lastBuild = std::chrono::steady_clock::now();
+    g_openSessions.clear();
+    if (!buildDays(dbHandle, g_storedThrough + 1, INT_MAX))
+        return;
+
+    sqlite3_stmt* stmt = nullptr;
+    const char* openSql = "SELECT id, COALESCE(processName, ''), startTime FROM ActivitySession WHERE endTime IS NULL;";
+    if (sqlite3_prepare_v2(dbHandle, openSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare open session query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        g_openSessions.push_back(LengthOpenSession{sqlite3_column_int(stmt, 0),
+                                                   reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                                                   sqlite3_column_double(stmt, 2)});
+    }
+    sqlite3_finalize(stmt);
+    g_dirty = false;
+}
+
+// Writes days [firstDay, lastDay] from memory to SessionLengthHistogram.
+static bool storeDays(sqlite3* dbHandle, int firstDay, int lastDay) {
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* stmt = nullptr;
+    bool ok = sqlite3_prepare_v2(dbHandle, "DELETE FROM SessionLengthHistogram WHERE day BETWEEN ? AND ?;",
+                                 -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_int(stmt, 1, firstDay);
+        sqlite3_bind_int(stmt, 2, lastDay);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+
+    stmt = nullptr;
+    if (ok && sqlite3_prepare_v2(dbHandle, "INSERT INTO SessionLengthHistogram (day, processName, buckets) VALUES (?, ?, ?);",
+                                 -1, &stmt, nullptr) == SQLITE_OK) {
+        for (auto day = g_days.lower_bound(firstDay); ok && day != g_days.end() && day->first <= lastDay; ++day) {
+            for (const auto& entry : day->second) {
+                std::vector<uint8_t> buckets = entry.second.encode();
+                sqlite3_bind_int(stmt, 1, day->first);
+                sqlite3_bind_text(stmt, 2, entry.first.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_blob(stmt, 3, buckets.data(), static_cast<int>(buckets.size()), SQLITE_TRANSIENT);
+                ok = sqlite3_step(stmt) == SQLITE_DONE;
+                sqlite3_reset(stmt);
+                if (!ok)
+                    break;
+            }
+        }
+    } else {
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!ok) {
+        std::cerr << "Failed to store session lengths: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    return true;
+}
+
+// Stores the days DailyUsage has indexed since the last call; those days are closed.
+static void storeClosedDays(sqlite3* dbHandle) {
+    int through = getIndexedThroughDay();
+    if (g_dirty || through <= g_storedThrough)
+        return;
+    if (!storeDays(dbHandle, g_storedThrough + 1, through))
+        return;
+    g_storedThrough = through;
+    setMetaValue(kStoredThroughKey, std::to_string(g_storedThrough));
+}
+
+static void loadStoredDays(sqlite3* dbHandle) {
+    g_days.clear();
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT day, processName, buckets FROM SessionLengthHistogram WHERE day <= ?;",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read session lengths: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    sqlite3_bind_int(stmt, 1, g_storedThrough);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 1);
+        LengthHistogram histogram;
+        if (histogram.decode(sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2)))
+            g_days[sqlite3_column_int(stmt, 0)][procName ? reinterpret_cast<const char*>(procName) : ""] = std::move(histogram);
+    }
+    sqlite3_finalize(stmt);
+}
+
+// True when the event's write is the only one since the histograms were last brought up to date.
+static bool claimEventWrite() {
+    unsigned long long generation = getWriteGeneration();
+    if (!g_initialized || generation != g_seenGeneration + 1) {
+        g_dirty = true;
+        return false;
+    }
+    g_seenGeneration = generation;
+    return true;
+}
+
+static void onSessionOpened(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    g_openSessions.push_back(LengthOpenSession{event.sessionId, event.processName, event.time});
+}
+
+static void onSessionClosed(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    auto it = std::find_if(g_openSessions.begin(), g_openSessions.end(),
+                           [&](const LengthOpenSession& s) { return s.sessionId == event.sessionId; });
+    if (it == g_openSessions.end()) {
+        g_dirty = true;
+        return;
+    }
+    addSessionLength(it->processName, it->startTime, event.time);
+    g_openSessions.erase(it);
+}
+
+static void onHistoryDaysChanged(int firstDay, int lastDay) {
+    if (isRawDerivedDayFrozen(firstDay))
+        firstDay = getCompactedThroughDay() + 1;
+    if (lastDay < firstDay)
+        return;
+    if (g_repairLastDay < g_repairFirstDay) {
+        g_repairFirstDay = firstDay;
+        g_repairLastDay = lastDay;
+    } else {
+        g_repairFirstDay = std::min(g_repairFirstDay, firstDay);
+        g_repairLastDay = std::max(g_repairLastDay, lastDay);
+    }
+}
+
+// Applies a bulk edit to the stored histograms of frozen days, which cannot be rebuilt.
+static void onFrozenDaysEdited(const BulkEditRequest& request, int firstDay, int lastDay) {
+    sqlite3* dbHandle = getDatabase();
+    lastDay = std::min(lastDay, g_storedThrough);
+    if (!dbHandle || lastDay < firstDay)
+        return;
+    for (auto day = g_days.lower_bound(firstDay); day != g_days.end() && day->first <= lastDay; ++day) {
+        ProcessHistograms edited;
+        for (const auto& entry : day->second) {
+            if (!request.processName.empty() && entry.first != request.processName)
+                edited[entry.first].merge(entry.second);
+            else if (request.kind == BulkEditRequest::Reassign)
+                edited[request.newProcessName].merge(entry.second);
+        }
+        day->second.swap(edited);
+    }
+    storeDays(dbHandle, firstDay, lastDay);
+}
+
+void initSessionLengths() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    registerDayRepairHandler(onHistoryDaysChanged);
+    registerFrozenDayEditHandler(onFrozenDaysEdited);
+    addSessionOpenListener(onSessionOpened);
+    addSessionCloseListener(onSessionClosed);
+
+    // First run: every day is built from SQL, and the closed ones are stored.
+    std::string stored = getMetaValue(kStoredThroughKey);
+    if (!stored.empty()) {
+        g_storedThrough = std::stoi(stored);
+        loadStoredDays(dbHandle);
+    }
+    rebuildRecentDays(dbHandle);
+    storeClosedDays(dbHandle);
+    g_lastStoreCheck = std::chrono::steady_clock::now();
+    g_initialized = true;
+}
+
+void runSessionLengthMaintenance() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+
+    // Stored days are rebuilt and rewritten; later days are covered by the rebuild below,
+    // since a repair is always a write the tracker events did not account for.
+    if (g_repairLastDay >= g_repairFirstDay) {
+        int lastDay = std::min(g_repairLastDay, g_storedThrough);
+        if (g_repairFirstDay <= lastDay && buildDays(dbHandle, g_repairFirstDay, lastDay))
+            storeDays(dbHandle, g_repairFirstDay, lastDay);
+        g_repairFirstDay = 0;
+        g_repairLastDay = -1;
+    }
+
+    if (getWriteGeneration() != g_seenGeneration)
+        g_dirty = true;
+    auto now = std::chrono::steady_clock::now();
+    // Imports and repairs arrive in bursts, so rebuild at most every few seconds.
+    if (g_dirty && now - g_lastBuild >= std::chrono::seconds(5))
+        rebuildRecentDays(dbHandle);
+
+    if (now - g_lastStoreCheck < std::chrono::minutes(1))
+        return;
+    g_lastStoreCheck = now;
+    storeClosedDays(dbHandle);
+}
+
+LengthHistogram getSessionLengthHistogram(const std::string& processName, int firstDay, int lastDay) {
+    LengthHistogram merged;
+    for (auto day = g_days.lower_bound(firstDay); day != g_days.end() && day->first <= lastDay; ++day) {
+        if (processName.empty()) {
+            for (const auto& entry : day->second)
+                merged.merge(entry.second);
+        } else {
+            auto found = day->second.find(processName);
+            if (found != day->second.end())
+                merged.merge(found->second);
+        }
+    }
+    return merged;
+}
+
+std::vector<SessionLengthStats> getSessionLengthStats(int firstDay, int lastDay) {
+    ProcessHistograms merged;
+    for (auto day = g_days.lower_bound(firstDay); day != g_days.end() && day->first <= lastDay; ++day) {
+        for (const auto& entry : day->second)
+            merged[entry.first].merge(entry.second);
+    }
+    std::vector<SessionLengthStats> results;
+    results.reserve(merged.size());
+    for (const auto& entry : merged) {
+        SessionLengthStats stats;
+        stats.processName = entry.first;
+        stats.sessions = entry.second.count();
+        stats.median = entry.second.quantile(0.5);
+        stats.p90 = entry.second.quantile(0.9);
+        stats.p99 = entry.second.quantile(0.99);
+        results.push_back(stats);
+    }
+    std::sort(results.begin(), results.end(), [](const SessionLengthStats& a, const SessionLengthStats& b) {
+        return a.sessions > b.sessions;
+    });
+    return results;
+}
+
+// Sub-second lengths matter here, so formatTime's whole seconds are too coarse.
+static std::string formatLength(double seconds) {
+    char buffer[32];
+    if (seconds < 60.0)
+        std::snprintf(buffer, sizeof(buffer), "%.1f s", seconds);
+    else if (seconds < 3600.0)
+        std::snprintf(buffer, sizeof(buffer), "%.1f min", seconds / 60.0);
+    else
+        std::snprintf(buffer, sizeof(buffer), "%.1f h", seconds / 3600.0);
+    return buffer;
+}
+
+void DrawSessionLengthPane() {
+    ImGui::Begin("Session Lengths");
+
+    // Bars double in width: under 1 s, 1-2 s, 2-4 s, ... and 4.5 h or more.
+    static const int kBars = 16;
+    static char processName[256] = "";
+    static char fromDate[CivilDate::kFormattedSize] = "";
+    static char toDate[CivilDate::kFormattedSize] = "";
+    static LengthHistogram histogram;
+    static std::vector<SessionLengthStats> processStats;
+    static float bars[kBars] = {};
+    static double queryMs = 0.0;
+    static bool queried = false;
+    if (fromDate[0] == '\0') {
+        int today = julianToDayNumber(getCurrentJulianDay());
+        CivilDate::fromDayNumber(today - 6).format(fromDate);
+        CivilDate::fromDayNumber(today).format(toDate);
+    }
+
+    ImGui::InputTextWithHint("Process", "empty for all processes", processName, sizeof(processName));
+    ImGui::InputText("From (YYYY-MM-DD)", fromDate, sizeof(fromDate));
+    ImGui::InputText("To (YYYY-MM-DD)", toDate, sizeof(toDate));
+    // Nothing is queried until both dates parse; a typo used to read as julian day 0.
+    CivilDate from, to;
+    bool datesValid = CivilDate::parse(fromDate, from) && CivilDate::parse(toDate, to);
+    if (!datesValid)
+        ImGui::BeginDisabled();
+    bool query = ImGui::Button("Query");
+    if (!datesValid) {
+        ImGui::EndDisabled();
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Enter both dates as YYYY-MM-DD.");
+    }
+    if (query && datesValid) {
+        int firstDay = from.dayNumber();
+        int lastDay = to.dayNumber();
+        if (lastDay < firstDay)
+            std::swap(firstDay, lastDay);
+        auto started = std::chrono::steady_clock::now();
+        histogram = getSessionLengthHistogram(processName, firstDay, lastDay);
+        processStats = getSessionLengthStats(firstDay, lastDay);
+        queryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        std::fill(bars, bars + kBars, 0.0f);
+        for (const auto& entry : histogram.buckets()) {
+            double mid = (LengthHistogram::bucketLower(entry.first) + LengthHistogram::bucketUpper(entry.first)) / 2.0;
+            int bar = mid < 1.0 ? 0 : std::min(kBars - 1, static_cast<int>(std::log2(mid)) + 1);
+            bars[bar] += static_cast<float>(entry.second);
+        }
+        queried = true;
+    }
+
+    if (queried) {
+        ImGui::Text("%s: %llu sessions (%.2f ms)", processName[0] ? processName : "All processes",
+                    static_cast<unsigned long long>(histogram.count()), queryMs);
+        ImGui::Text("Median %s, p90 %s, p99 %s", formatLength(histogram.quantile(0.5)).c_str(),
+                    formatLength(histogram.quantile(0.9)).c_str(), formatLength(histogram.quantile(0.99)).c_str());
+        ImGui::PlotHistogram("##lengths", bars, kBars, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+        ImGui::TextDisabled("Under 1 s on the left; each bar doubles, up to 4.5 h and longer.");
+
+        if (ImGui::BeginTable("SessionLengthTable", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Application", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Sessions");
+            ImGui::TableSetupColumn("Median");
+            ImGui::TableSetupColumn("p90");
+            ImGui::TableSetupColumn("p99");
+            ImGui::TableHeadersRow();
+            for (size_t i = 0; i < processStats.size() && i < 15; i++) {
+                const auto& stats = processStats[i];
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted(stats.processName.c_str());
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%llu", static_cast<unsigned long long>(stats.sessions));
+                ImGui::TableSetColumnIndex(2);
+                ImGui::TextUnformatted(formatLength(stats.median).c_str());
+                ImGui::TableSetColumnIndex(3);
+                ImGui::TextUnformatted(formatLength(stats.p90).c_str());
+                ImGui::TableSetColumnIndex(4);
+                ImGui::TextUnformatted(formatLength(stats.p99).c_str());
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
@@ -0,0 +1,44 @@
+#ifndef SESSION_LENGTHS_H
+#define SESSION_LENGTHS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "length_histogram.h"
+
+// Session length distributions per process and day, as mergeable LengthHistograms.
+//
+// Closed days up to the DailyUsage index (getIndexedThroughDay) are stored in
+// SessionLengthHistogram; later days are kept in memory and built from SQL at startup.
+// Sessions are added as the tracker closes them. Percentiles over a range merge the
+// range's process-day histograms and never scan SessionHistory. Days rewritten through
+// registerDayRepairHandler are rebuilt. Retention rollups are not sessions, so only
+// ActivitySession rows are counted; histograms of days rolled up later are kept, and bulk
+// edits of those days delete or rename their stored histograms.
+// A day is the julianToDayNumber of a session's start, like every other day total.
+
+struct SessionLengthStats {
+    std::string processName;  // Empty for all processes together.
+    uint64_t sessions = 0;
+    double median = 0.0;      // Seconds.
+    double p90 = 0.0;
+    double p99 = 0.0;
+};
+
+// Loads the histograms, building the table on first run, and subscribes to tracker
+// events. Call after initDailyUsage.
+void initSessionLengths();
+
+// Merged histogram of processName (empty for all processes) over days [firstDay, lastDay].
+LengthHistogram getSessionLengthHistogram(const std::string& processName, int firstDay, int lastDay);
+
+// Per-process statistics over days [firstDay, lastDay], most sessions first.
+std::vector<SessionLengthStats> getSessionLengthStats(int firstDay, int lastDay);
+
+// Called once per frame from the main loop; stores newly closed days and applies repairs.
+void runSessionLengthMaintenance();
+
+void DrawSessionLengthPane();
+
+#endif // SESSION_LENGTHS_H
@@ -0,0 +1,513 @@
+#include "snapshot.h"
+
+#include "database.h"
+#include "history_edit.h"
+#include "integrity.h"
+#include "interval_buckets.h"
+#include "rcu.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Julian day bounds of a UsageRange. The all-time fields of every snapshot come from one
+// shared entry whose window has history set; range entries leave them out.
+struct SnapshotWindow {
+    bool history = false;  // Accumulate the all-time totals and nothing else.
+    bool allTime = true;   // The range is all of history, so its totals are the all-time ones.
+    double rangeStart = 0.0;
+    double rangeEnd = 0.0;
+    double dayStart = 0.0;
+    double dayEnd = 0.0;
+    BucketGrid hours;  // The timeline day split into hours.
+};
+
+// Running totals a snapshot is built from.
+struct SnapshotTotals {
+    std::unordered_map<std::string, double> rangeTotals;
+    std::unordered_map<std::string, double> allTimeTotals;
+    HourProcessMatrix hours;  // Timeline day only.
+    double totalTime = 0.0;
+    double allTimeTotal = 0.0;
+    double firstStart = 0.0;
+    double lastEnd = 0.0;
+    bool any = false;
+};
+
+struct OpenSession {
+    std::string processName;
+    double startTime;
+};
+
+// What a cached result was computed against.
+struct SnapshotStamp {
+    unsigned long long generation = 0;      // getWriteGeneration.
+    unsigned long long repairRevision = 0;  // Repairs that reached days before the floor.
+    int floorDay = 0;                       // Sessions from this day on are rescanned on every write.
+
+    bool operator==(const SnapshotStamp&) const = default;
+    bool olderThan(const SnapshotStamp& other) const {
+        return generation < other.generation || repairRevision < other.repairRevision || floorDay < other.floorDay;
+    }
+};
+
+// Totals for one range. Closed sessions that started before the floor day only change
+// through a repair, so 'closed' is kept across write generations while the floor and the
+// repair revision hold, and only the sessions since the floor are rescanned. Open sessions
+// are kept aside and added at the current time on every read.
+struct CachedSnapshot {
+    SnapshotStamp stamp;
+    SnapshotTotals closed;    // Closed sessions that started before the floor.
+    SnapshotTotals combined;  // closed plus the closed sessions since the floor.
+    std::vector<OpenSession> open;
+    mutable std::atomic<unsigned long long> lastUsed{0};  // For least-recently-used eviction.
+};
+
+// Cached results keyed by range, published through RCU: the table and its entries are
+// immutable once published (apart from lastUsed), so any thread can read them without
+// locking. Writers build a new table that shares the unchanged entries and swap it in.
+struct SnapshotTable {
+    std::map<std::string, std::shared_ptr<const CachedSnapshot>> entries;
+};
+
+static const size_t kMaxCachedSnapshots = 32;
+static const char* kHistoryKey = "snapshot|history";
+static RcuCell<SnapshotTable> g_snapshots;
+static SnapshotCacheStats g_cacheStats;  // UI thread only.
+static std::atomic<unsigned long long> g_useClock{0};
+static std::atomic<unsigned long long> g_repairRevision{0};
+static bool g_repairHandlerRegistered = false;
+
+// --- Background worker ---
+// The UI thread posts requests; the worker scans history on its own read connection
+// and publishes each result into g_snapshots.
+struct SnapshotRequest {
+    std::string key;
+    SnapshotWindow window;
+    SnapshotStamp stamp;
+    std::shared_ptr<const CachedSnapshot> base;  // Its closed part is still valid; null to rescan it.
+};
+
+static std::thread g_worker;
+static std::atomic<bool> g_workerRunning{false};
+static std::mutex g_requestMutex;
+static std::condition_variable g_requestCv;
+static std::deque<SnapshotRequest> g_requests;
+// UI thread only: stamp each key was last requested at, until its result arrives.
+static std::map<std::string, SnapshotStamp> g_pendingRequests;
+
+static std::string snapshotKey(const UsageRange& range) {
+    return "snapshot|" + range.startDate + "|" + range.endDate + "|" + range.timelineDate;
+}
+
+static void publishSnapshot(const std::string& key, std::shared_ptr<CachedSnapshot> entry) {
+    entry->lastUsed = ++g_useClock;
+    g_snapshots.update([&](const SnapshotTable* current) {
+        auto next = std::make_unique<SnapshotTable>();
+        if (current)
+            next->entries = current->entries;
+        auto existing = next->entries.find(key);
+        // Never replace a result with an older one that finished later.
+        if (existing == next->entries.end() || !entry->stamp.olderThan(existing->second->stamp))
+            next->entries[key] = entry;
+        while (next->entries.size() > kMaxCachedSnapshots) {
+            auto victim = next->entries.end();
+            for (auto it = next->entries.begin(); it != next->entries.end(); ++it) {
+                if (it->first != key && it->first != kHistoryKey &&
+                    (victim == next->entries.end() || it->second->lastUsed < victim->second->lastUsed))
+                    victim = it;
+            }
+            next->entries.erase(victim);
+        }
+        return next;
+    });
+}
+
+// Lock-free lookup; the returned entry stays valid after the read section ends.
+static std::shared_ptr<const CachedSnapshot> findSnapshot(const std::string& key, size_t* tableSize = nullptr) {
+    RcuReadGuard guard;
+    const SnapshotTable* table = g_snapshots.read();
+    if (tableSize)
+        *tableSize = table ? table->entries.size() : 0;
+    if (!table)
+        return nullptr;
+    auto it = table->entries.find(key);
+    if (it == table->entries.end())
+        return nullptr;
+    it->second->lastUsed = ++g_useClock;
+    return it->second;
+}
+
+static SnapshotWindow makeWindow(const UsageRange& range) {
+    SnapshotWindow window;
+    window.allTime = range.endDate.empty();
+    if (!window.allTime) {
+        window.rangeStart = getJulianDayFromDate(range.startDate);
+        window.rangeEnd = getJulianDayFromDate(range.endDate);
+    }
+    window.dayStart = getJulianDayFromDate(range.timelineDate);
+    window.dayEnd = window.dayStart + 1.0;
+    window.hours = makeDayBucketGrid(window.dayStart, kHourBuckets);
+    return window;
+}
+
+static SnapshotWindow makeHistoryWindow() {
+    SnapshotWindow window;
+    window.history = true;
+    return window;
+}
+
+// Sessions are attributed to the range by their start time, like getTopApplications;
+// the timeline clips them to each hour, like computeDetailedHourlyUsage.
+static void addSession(SnapshotTotals& totals, const SnapshotWindow& window,
+                       const std::string& processName, double sessionStart, double sessionEnd) {
+    double seconds = (sessionEnd - sessionStart) * 86400.0;
+    if (window.history) {
+        if (!totals.any) {
+            totals.firstStart = sessionStart;
+            totals.lastEnd = sessionEnd;
+            totals.any = true;
+        } else {
+            totals.firstStart = std::min(totals.firstStart, sessionStart);
+            totals.lastEnd = std::max(totals.lastEnd, sessionEnd);
+        }
+        totals.allTimeTotals[processName] += seconds;
+        totals.allTimeTotal += seconds;
+        return;
+    }
+
+    if (!window.allTime && sessionStart >= window.rangeStart && sessionStart < window.rangeEnd) {
+        totals.rangeTotals[processName] += seconds;
+        totals.totalTime += seconds;
+    }
+    // The timeline only needs the part of the session on the timeline day.
+    if (sessionEnd > window.dayStart && sessionStart < window.dayEnd)
+        addSessionToHourMatrix(totals.hours, window.hours, processName, sessionStart, sessionEnd);
+}
+
+static void addTotals(SnapshotTotals& into, const SnapshotTotals& from) {
+    for (const auto& entry : from.rangeTotals)
+        into.rangeTotals[entry.first] += entry.second;
+    for (const auto& entry : from.allTimeTotals)
+        into.allTimeTotals[entry.first] += entry.second;
+    for (size_t row = 0; row < from.hours.processes.size(); row++) {
+        const std::string& processName = from.hours.processes[row];
+        auto it = into.hours.rows.find(processName);
+        if (it == into.hours.rows.end()) {
+            it = into.hours.rows.emplace(processName, into.hours.processes.size()).first;
+            into.hours.processes.push_back(processName);
+            into.hours.seconds.resize(into.hours.processes.size() * 24, 0.0);
+            into.hours.slots.push_back(from.hours.slots[row]);
+        }
+        for (int hour = 0; hour < 24; hour++)
+            into.hours.seconds[it->second * 24 + hour] += from.hours.seconds[row * 24 + hour];
+    }
+    into.totalTime += from.totalTime;
+    into.allTimeTotal += from.allTimeTotal;
+    if (from.any) {
+        into.firstStart = into.any ? std::min(into.firstStart, from.firstStart) : from.firstStart;
+        into.lastEnd = into.any ? std::max(into.lastEnd, from.lastEnd) : from.lastEnd;
+        into.any = true;
+    }
+}
+
+// Converts a process -> seconds map into a vector sorted by time (largest first).
+static std::vector<ApplicationData> toSortedList(const std::unordered_map<std::string, double>& totals) {
+    std::vector<ApplicationData> results;
+    results.reserve(totals.size());
+    for (const auto& entry : totals) {
+        ApplicationData app;
+        app.processName = entry.first;
+        app.totalTime = entry.second;
+        results.push_back(app);
+    }
+    std::sort(results.begin(), results.end(), [](const ApplicationData& a, const ApplicationData& b) {
+        return a.totalTime > b.totalTime;
+    });
+    return results;
+}
+
+// 'history' holds the all-time totals, 'range' the range and timeline totals.
+static UsageSnapshot buildSnapshot(const UsageRange& range, const SnapshotWindow& window,
+                                   const SnapshotTotals& history, const SnapshotTotals& totals) {
+    UsageSnapshot snapshot;
+    snapshot.range = range;
+    snapshot.allTimeTotal = history.allTimeTotal;
+    snapshot.allTimeProcesses = toSortedList(history.allTimeTotals);
+    snapshot.daysTracked = history.any ? history.lastEnd - history.firstStart : 0.0;
+    if (window.allTime) {
+        snapshot.totalTime = snapshot.allTimeTotal;
+        snapshot.processes = snapshot.allTimeProcesses;
+    } else {
+        snapshot.totalTime = totals.totalTime;
+        snapshot.processes = toSortedList(totals.rangeTotals);
+    }
+    snapshot.hourly = hourlyUsageFromMatrix(totals.hours);
+    return snapshot;
+}
+
+// Scans the sessions the window counts, on one side of the floor: closed sessions that
+// started before it, or (tail) everything since it plus open sessions. Range windows
+// read only the range and the timeline day, with kMaxSessionDays of slack since no
+// session outlasts that.
+static bool scanHistory(sqlite3* dbHandle, const SnapshotWindow& window, double floor, bool tail,
+                        SnapshotTotals& totals, std::vector<OpenSession>* open) {
+    const char* closedSql = R"(
+        SELECT processName, startTime, endTime FROM SessionHistory
+        WHERE ((startTime >= ?1 AND startTime < ?2) OR (startTime >= ?3 AND startTime < ?4))
+          AND startTime < ?5 AND endTime IS NOT NULL;
+    )";
+    const char* tailSql = R"(
+        SELECT processName, startTime, endTime FROM SessionHistory
+        WHERE ((startTime >= ?1 AND startTime < ?2) OR (startTime >= ?3 AND startTime < ?4))
+          AND (startTime >= ?5 OR endTime IS NULL);
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, tail ? tailSql : closedSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare snapshot query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    double rangeStart = window.rangeStart, rangeEnd = window.rangeEnd;
+    double dayStart = window.dayStart - kMaxSessionDays, dayEnd = window.dayEnd;
+    if (window.history) {
+        rangeStart = dayStart = -1e300;
+        rangeEnd = dayEnd = 1e300;
+    } else if (window.allTime) {
+        rangeStart = rangeEnd = 0.0;
+    }
+    sqlite3_bind_double(stmt, 1, rangeStart);
+    sqlite3_bind_double(stmt, 2, rangeEnd);
+    sqlite3_bind_double(stmt, 3, dayStart);
+    sqlite3_bind_double(stmt, 4, dayEnd);
+    sqlite3_bind_double(stmt, 5, floor);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
+        std::string processName = procName ? reinterpret_cast<const char*>(procName) : "";
+        double sessionStart = sqlite3_column_double(stmt, 1);
+        if (sqlite3_column_type(stmt, 2) == SQLITE_NULL) {
+            if (open)
+                open->push_back(OpenSession{processName, sessionStart});
+        } else {
+            addSession(totals, window, processName, sessionStart, sqlite3_column_double(stmt, 2));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Scans the parts of an entry that 'base' cannot supply.
+static bool buildEntry(sqlite3* dbHandle, const SnapshotWindow& window, const SnapshotStamp& stamp,
+                       const CachedSnapshot* base, CachedSnapshot& entry) {
+    entry.stamp = stamp;
+    double floor = dayNumberToJulian(stamp.floorDay);
+    if (base)
+        entry.closed = base->closed;
+    else if (!scanHistory(dbHandle, window, floor, false, entry.closed, nullptr))
+        return false;
+    SnapshotTotals since;
+    if (!scanHistory(dbHandle, window, floor, true, since, &entry.open))
+        return false;
+    entry.combined = entry.closed;
+    addTotals(entry.combined, since);
+    return true;
+}
+
+static void snapshotWorkerLoop() {
+    sqlite3* reader = openReadConnection();
+    if (!reader) {
+        g_workerRunning = false;
+        return;
+    }
+    while (g_workerRunning) {
+        SnapshotRequest request;
+        {
+            std::unique_lock<std::mutex> lock(g_requestMutex);
+            g_requestCv.wait(lock, [] { return !g_requests.empty() || !g_workerRunning; });
+            if (!g_workerRunning)
+                break;
+            request = std::move(g_requests.front());
+            g_requests.pop_front();
+        }
+
+        auto entry = std::make_shared<CachedSnapshot>();
+        // Read before scanning so the result is never labelled newer than its data.
+        request.stamp.generation = getWriteGeneration();
+        if (!buildEntry(reader, request.window, request.stamp, request.base.get(), *entry))
+            continue;
+        publishSnapshot(request.key, std::move(entry));
+    }
+    sqlite3_close(reader);
+}
+
+void startSnapshotWorker() {
+    if (g_workerRunning)
+        return;
+    g_workerRunning = true;
+    g_worker = std::thread(snapshotWorkerLoop);
+}
+
+void stopSnapshotWorker() {
+    if (!g_worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(g_requestMutex);
+        g_workerRunning = false;
+    }
+    g_requestCv.notify_all();
+    g_worker.join();
+}
+
+// Repairs are reported on the UI thread. One that reaches a day before the floor
+// invalidates the closed part of every entry; later ones leave it alone.
+static void onHistoryDaysChanged(int firstDay, int) {
+    if (firstDay < julianToDayNumber(getCurrentJulianDay()) - kMaxSessionDays)
+        g_repairRevision++;
+}
+
+static SnapshotStamp currentStamp() {
+    if (!g_repairHandlerRegistered) {
+        registerDayRepairHandler(onHistoryDaysChanged);
+        g_repairHandlerRegistered = true;
+    }
+    SnapshotStamp stamp;
+    stamp.generation = getWriteGeneration();
+    stamp.repairRevision = g_repairRevision;
+    // Sessions that started before the floor have ended, as no session outlasts kMaxSessionDays.
+    stamp.floorDay = julianToDayNumber(getCurrentJulianDay()) - kMaxSessionDays;
+    return stamp;
+}
+
+// The cached entry, if its closed part can be reused under 'stamp'.
+static const CachedSnapshot* reusableBase(const std::shared_ptr<const CachedSnapshot>& cached,
+                                          const SnapshotStamp& stamp) {
+    if (!cached || cached->stamp.repairRevision != stamp.repairRevision || cached->stamp.floorDay != stamp.floorDay)
+        return nullptr;
+    return cached.get();
+}
+
+// Queues a scan for 'key' unless one at this stamp is already on its way.
+static void requestSnapshot(const std::string& key, const SnapshotWindow& window, const SnapshotStamp& stamp,
+                            const std::shared_ptr<const CachedSnapshot>& cached) {
+    auto pending = g_pendingRequests.find(key);
+    if (pending != g_pendingRequests.end() && pending->second == stamp)
+        return;
+    g_pendingRequests[key] = stamp;
+    g_cacheStats.misses++;
+    std::shared_ptr<const CachedSnapshot> base = reusableBase(cached, stamp) ? cached : nullptr;
+    {
+        std::lock_guard<std::mutex> lock(g_requestMutex);
+        // A newer request for the same range replaces one that has not started yet.
+        auto queued = std::find_if(g_requests.begin(), g_requests.end(),
+                                   [&](const SnapshotRequest& r) { return r.key == key; });
+        if (queued != g_requests.end()) {
+            queued->window = window;
+            queued->stamp = stamp;
+            queued->base = base;
+        } else {
+            g_requests.push_back(SnapshotRequest{key, window, stamp, base});
+        }
+    }
+    g_requestCv.notify_one();
+}
+
+// Adds the open sessions of an entry at the current time. Open sessions grow every frame,
+// so they are added arithmetically instead of re-querying.
+static const SnapshotTotals& withOpenSessions(const CachedSnapshot& cached, const SnapshotWindow& window,
+                                              double now, SnapshotTotals& scratch) {
+    if (cached.open.empty())
+        return cached.combined;
+    scratch = cached.combined;
+    for (const auto& session : cached.open)
+        addSession(scratch, window, session.processName, session.startTime, std::max(now, session.startTime));
+    return scratch;
+}
+
+static UsageSnapshot materializeSnapshot(const UsageRange& range, const SnapshotWindow& window,
+                                         const CachedSnapshot* history, const CachedSnapshot* cached, bool stale) {
+    static const SnapshotTotals kNoTotals;
+    double now = getCurrentJulianDay();
+    SnapshotTotals historyScratch, rangeScratch;
+    const SnapshotTotals& historyTotals =
+        history ? withOpenSessions(*history, makeHistoryWindow(), now, historyScratch) : kNoTotals;
+    const SnapshotTotals& rangeTotals = cached ? withOpenSessions(*cached, window, now, rangeScratch) : kNoTotals;
+    UsageSnapshot snapshot = buildSnapshot(range, window, historyTotals, rangeTotals);
+    snapshot.stale = stale;
+    return snapshot;
+}
+
+// Looks up one entry and, when it is missing or out of date, scans it now or queues a
+// scan. Returns the entry to show, possibly stale, and sets stale when it is.
+static std::shared_ptr<const CachedSnapshot> resolveEntry(sqlite3* dbHandle, const std::string& key,
+                                                          const SnapshotWindow& window, const SnapshotStamp& stamp,
+                                                          bool& stale, bool& failed) {
+    std::shared_ptr<const CachedSnapshot> cached = findSnapshot(key, &g_cacheStats.entries);
+    auto pending = g_pendingRequests.find(key);
+    if (cached && pending != g_pendingRequests.end() && !cached->stamp.olderThan(pending->second))
+        g_pendingRequests.erase(pending);
+
+    if (cached && cached->stamp == stamp) {
+        g_cacheStats.hits++;
+    } else if (g_workerRunning) {
+        // Stale-while-revalidate: show what we have and let the worker catch up.
+        requestSnapshot(key, window, stamp, cached);
+        g_cacheStats.staleReads++;
+        stale = true;
+    } else {
+        g_cacheStats.misses++;
+        auto entry = std::make_shared<CachedSnapshot>();
+        if (!buildEntry(dbHandle, window, stamp, reusableBase(cached, stamp), *entry)) {
+            failed = true;
+            return nullptr;
+        }
+        publishSnapshot(key, entry);
+        cached = std::move(entry);
+    }
+    return cached;
+}
+
+UsageSnapshot computeSnapshot(const UsageRange& range) {
+    UsageSnapshot empty;
+    empty.range = range;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return empty;
+    }
+
+    SnapshotWindow window = makeWindow(range);
+    SnapshotStamp stamp = currentStamp();
+    bool stale = false, failed = false;
+    auto history = resolveEntry(dbHandle, kHistoryKey, makeHistoryWindow(), stamp, stale, failed);
+    auto cached = resolveEntry(dbHandle, snapshotKey(range), window, stamp, stale, failed);
+    if (failed)
+        return empty;
+    if (!history || !cached) {
+        empty.stale = true;
+        return empty;
+    }
+    return materializeSnapshot(range, window, history.get(), cached.get(), stale);
+}
+
+bool peekSnapshot(const UsageRange& range, UsageSnapshot& snapshot) {
+    std::shared_ptr<const CachedSnapshot> history = findSnapshot(kHistoryKey);
+    std::shared_ptr<const CachedSnapshot> cached = findSnapshot(snapshotKey(range));
+    if (!history || !cached)
+        return false;
+    unsigned long long generation = getWriteGeneration();
+    bool stale = history->stamp.generation != generation || cached->stamp.generation != generation;
+    snapshot = materializeSnapshot(range, makeWindow(range), history.get(), cached.get(), stale);
+    return true;
+}
+
+SnapshotCacheStats getSnapshotCacheStats() {
+    return g_cacheStats;
+}
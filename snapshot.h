@@ -0,0 +1,58 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "functions.h"
+#include "heatmap.h"
+
+// The period a snapshot covers.
+struct UsageRange {
+    std::string startDate;    // "YYYY-MM-DD"; empty for all time.
+    std::string endDate;      // Exclusive end date; empty for all time.
+    std::string timelineDate; // Day broken down by hour for the Activity Timeline.
+};
+
+// Everything the panes need for one frame, computed in a single pass over SessionHistory.
+struct UsageSnapshot {
+    UsageRange range;
+    double totalTime = 0.0;                         // Seconds tracked in the range.
+    std::vector<ApplicationData> processes;         // Per-process time in the range, largest first (top 10 is a prefix).
+    double allTimeTotal = 0.0;
+    std::vector<ApplicationData> allTimeProcesses;  // Per-process time across all history, largest first.
+    double daysTracked = 0.0;                       // Span of all history in days (see getDaysTracked).
+    std::array<HourlyUsageData, 24> hourly{};       // Hourly breakdown of range.timelineDate.
+    bool stale = false;                             // Older than the latest write; a refresh is on its way.
+};
+
+// Computes a snapshot from cached totals. Each range caches the sessions of its own days
+// and of the timeline day; one shared entry holds the all-time totals. Closed sessions that
+// started before yesterday are kept until a repair reaches their days (see
+// registerDayRepairHandler); after a write only the sessions since yesterday are rescanned.
+// Open sessions are added on top at the current time, so repeated calls between writes run
+// no SQL. The 32 least recently used ranges are kept.
+// While the snapshot worker runs, misses are scanned in the background and the last
+// cached result for the range is returned with 'stale' set (empty if there is none yet).
+// Call from the UI thread.
+UsageSnapshot computeSnapshot(const UsageRange& range);
+
+// Returns the latest published result for the range without querying or queueing work.
+// Lock-free and safe from any thread; false if the range has never been computed.
+bool peekSnapshot(const UsageRange& range, UsageSnapshot& snapshot);
+
+// Starts and stops the background thread that scans history on its own read connection.
+void startSnapshotWorker();
+void stopSnapshotWorker();
+
+struct SnapshotCacheStats {
+    long long hits = 0;
+    long long misses = 0;
+    long long staleReads = 0;  // Reads answered with an older result while a scan was pending.
+    size_t entries = 0;
+};
+
+SnapshotCacheStats getSnapshotCacheStats();
+
+#endif // SNAPSHOT_H
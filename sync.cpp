@@ -0,0 +1,782 @@
+#include "sync.h"
+
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include <sqlite3.h>
+#include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ActivitySession column order, as recorded in changesets.
+enum SessionColumn { ColId = 0, ColProcessName, ColWindowTitle, ColStartTime, ColEndTime, ColMachineId, ColOriginId };
+
+// A collected changeset whose file has not been written yet.
+struct PendingChangeset {
+    long long sequence = 0;
+    std::string data;
+};
+
+// Work for the sync thread, captured on the UI thread.
+struct SyncJob {
+    std::string directory;
+    std::string machineId;
+    std::vector<PendingChangeset> exports;  // Written in sequence order before merging.
+    bool merge = false;
+    // Matching clock readings, to turn file times into local julian times.
+    double julianNow = 0.0;
+    fs::file_time_type fileNow{};
+};
+
+struct SyncOutcome {
+    std::vector<PendingChangeset> unwritten;  // Exports still to write, from the first failure on.
+    bool merged = false;
+    MergeResult result;
+    int firstDay = 0x7fffffff, lastDay = -1;
+};
+
+static sqlite3_session* g_session = nullptr;
+static int g_pauseDepth = 0;
+static std::string g_machineId;
+static std::chrono::steady_clock::time_point g_nextSync{};
+static MergeResult g_lastMerge;
+static std::vector<PendingChangeset> g_unwritten;  // UI thread; empty while a job runs.
+
+static std::thread g_syncThread;
+static std::mutex g_syncMutex;
+static std::condition_variable g_syncWake;
+static SyncJob g_syncJob;
+static SyncOutcome g_syncOutcome;
+static bool g_syncJobReady = false;
+static bool g_syncDone = false;
+static bool g_syncBusy = false;  // A job was handed over and its outcome not yet applied.
+static bool g_syncStopping = false;
+
+std::string getMachineId() {
+    if (!g_machineId.empty())
+        return g_machineId;
+    g_machineId = getMetaValue("machine.id");
+    if (g_machineId.empty()) {
+        std::random_device device;
+        std::mt19937_64 generator((static_cast<uint64_t>(device()) << 32) ^ device());
+        char buf[17];
+        std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(generator()));
+        g_machineId = buf;
+        setMetaValue("machine.id", g_machineId);
+    }
+    return g_machineId;
+}
+
+void setSyncDirectory(const std::string& directory) {
+    setMetaValue("sync.directory", directory);
+    g_nextSync = {};
+}
+
+std::string getSyncDirectory() {
+    return getMetaValue("sync.directory");
+}
+
+bool startChangeRecording() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return false;
+    }
+    if (g_session)
+        return true;
+    if (sqlite3session_create(dbHandle, "main", &g_session) != SQLITE_OK) {
+        std::cerr << "Failed to create change session: " << sqlite3_errmsg(dbHandle) << std::endl;
+        g_session = nullptr;
+        return false;
+    }
+    if (sqlite3session_attach(g_session, "ActivitySession") != SQLITE_OK) {
+        std::cerr << "Failed to attach change session: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3session_delete(g_session);
+        g_session = nullptr;
+        return false;
+    }
+    if (g_pauseDepth > 0)
+        sqlite3session_enable(g_session, 0);
+    return true;
+}
+
+void pauseChangeRecording() {
+    if (g_pauseDepth++ == 0 && g_session)
+        sqlite3session_enable(g_session, 0);
+}
+
+void resumeChangeRecording() {
+    if (g_pauseDepth > 0 && --g_pauseDepth == 0 && g_session)
+        sqlite3session_enable(g_session, 1);
+}
+
+// Updates name a row only by its id here. For every updated row this machine had merged
+// from elsewhere, a MergedRow insert of (id, machineId, originId) is added to the
+// changeset, so receivers can find their own copy of the row (see applyUpdate). Leaves
+// the changeset as it was if that fails.
+static void addMergedRowAliases(std::string& data) {
+    std::vector<long long> updated;
+    sqlite3_changeset_iter* iter = nullptr;
+    if (sqlite3changeset_start(&iter, static_cast<int>(data.size()), data.data()) != SQLITE_OK)
+        return;
+    while (sqlite3changeset_next(iter) == SQLITE_ROW) {
+        const char* table = nullptr;
+        int columns = 0, op = 0, indirect = 0;
+        sqlite3_value* id = nullptr;
+        sqlite3changeset_op(iter, &table, &columns, &op, &indirect);
+        if (op == SQLITE_UPDATE && table && std::string(table) == "ActivitySession" &&
+            sqlite3changeset_old(iter, ColId, &id) == SQLITE_OK && id)
+            updated.push_back(sqlite3_value_int64(id));
+    }
+    sqlite3changeset_finalize(iter);
+    if (updated.empty())
+        return;
+
+    // The aliases are recorded by a session on a scratch database, then appended.
+    sqlite3* dbHandle = getDatabase();
+    sqlite3* scratch = nullptr;
+    sqlite3_session* session = nullptr;
+    sqlite3_stmt* select = nullptr;
+    sqlite3_stmt* insert = nullptr;
+    bool ok = sqlite3_open(":memory:", &scratch) == SQLITE_OK &&
+              sqlite3_exec(scratch, "CREATE TABLE MergedRow (id INTEGER PRIMARY KEY, machineId TEXT, originId INTEGER);",
+                           nullptr, nullptr, nullptr) == SQLITE_OK &&
+              sqlite3session_create(scratch, "main", &session) == SQLITE_OK &&
+              sqlite3session_attach(session, "MergedRow") == SQLITE_OK &&
+              sqlite3_prepare_v2(dbHandle, "SELECT machineId, originId FROM ActivitySession WHERE id = ? AND machineId IS NOT NULL;",
+                                 -1, &select, nullptr) == SQLITE_OK &&
+              sqlite3_prepare_v2(scratch, "INSERT INTO MergedRow (id, machineId, originId) VALUES (?, ?, ?);",
+                                 -1, &insert, nullptr) == SQLITE_OK;
+    for (size_t i = 0; ok && i < updated.size(); i++) {
+        sqlite3_bind_int64(select, 1, updated[i]);
+        if (sqlite3_step(select) == SQLITE_ROW) {
+            sqlite3_bind_int64(insert, 1, updated[i]);
+            sqlite3_bind_value(insert, 2, sqlite3_column_value(select, 0));
+            sqlite3_bind_value(insert, 3, sqlite3_column_value(select, 1));
+            ok = sqlite3_step(insert) == SQLITE_DONE;
+            sqlite3_reset(insert);
+        }
+        sqlite3_reset(select);
+    }
+    sqlite3_finalize(select);
+    sqlite3_finalize(insert);
+
+    int size = 0;
+    void* aliases = nullptr;
+    ok = ok && sqlite3session_changeset(session, &size, &aliases) == SQLITE_OK;
+    if (ok && size > 0) {
+        int combinedSize = 0;
+        void* combined = nullptr;
+        ok = sqlite3changeset_concat(static_cast<int>(data.size()), data.data(), size, aliases,
+                                     &combinedSize, &combined) == SQLITE_OK;
+        if (ok)
+            data.assign(static_cast<const char*>(combined), static_cast<size_t>(combinedSize));
+        sqlite3_free(combined);
+    }
+    sqlite3_free(aliases);
+    if (session)
+        sqlite3session_delete(session);
+    sqlite3_close(scratch);
+    if (!ok)
+        std::cerr << "Failed to add merged row aliases to the changeset." << std::endl;
+}
+
+// Moves the changes recorded since the last export into 'out' and starts a new session.
+// The sequence number is reserved here so files keep the order the changes were recorded in.
+static bool takeChangeset(PendingChangeset& out) {
+    int size = 0;
+    void* data = nullptr;
+    if (sqlite3session_changeset(g_session, &size, &data) != SQLITE_OK) {
+        std::cerr << "Failed to collect changeset." << std::endl;
+        return false;
+    }
+    if (size == 0) {
+        sqlite3_free(data);
+        return true;
+    }
+    long long sequence = std::stoll(getMetaValue("sync.exportSeq", "0")) + 1;
+    if (!setMetaValue("sync.exportSeq", std::to_string(sequence))) {
+        sqlite3_free(data);
+        return false;
+    }
+    out.sequence = sequence;
+    out.data.assign(static_cast<const char*>(data), static_cast<size_t>(size));
+    sqlite3_free(data);
+    addMergedRowAliases(out.data);
+
+    // Start a fresh session so the next changeset holds only newer writes.
+    sqlite3session_delete(g_session);
+    g_session = nullptr;
+    return startChangeRecording();
+}
+
+// Writes changesets in order and removes the written ones. Stops at the first failure, so a
+// later sequence never appears before an earlier one and gets skipped by a reader's cursor.
+static bool writeChangesets(const std::string& directory, const std::string& machine,
+                            std::vector<PendingChangeset>& files) {
+    fs::path machineDir = fs::path(directory) / machine;
+    std::error_code ec;
+    fs::create_directories(machineDir, ec);
+    size_t written = 0;
+    for (; written < files.size(); written++) {
+        const PendingChangeset& file = files[written];
+        char fileName[32];
+        std::snprintf(fileName, sizeof(fileName), "%010lld.changeset", file.sequence);
+        fs::path target = machineDir / fileName;
+        fs::path temp = machineDir / (std::string(fileName) + ".tmp");
+        {
+            std::ofstream out(temp, std::ios::binary);
+            out.write(file.data.data(), static_cast<std::streamsize>(file.data.size()));
+            if (!out) {
+                std::cerr << "Failed to write changeset " << temp.string() << std::endl;
+                break;
+            }
+        }
+        // Readers only ever see complete files.
+        fs::rename(temp, target, ec);
+        if (ec) {
+            std::cerr << "Failed to publish changeset " << target.string() << ": " << ec.message() << std::endl;
+            break;
+        }
+    }
+    files.erase(files.begin(), files.begin() + static_cast<std::ptrdiff_t>(written));
+    return files.empty();
+}
+
+static void finishMerge(const MergeResult& result, int firstDay, int lastDay) {
+    if (result.changesets > 0) {
+        std::cout << "Merged " << result.changesets << " changesets (" << result.rowsInserted << " new, "
+                  << result.rowsUpdated << " updated, " << result.rowsDeleted << " deleted sessions) in "
+                  << result.elapsedMs << " ms." << std::endl;
+    }
+    notifyHistoryDaysChanged(firstDay, lastDay);
+    g_lastMerge = result;
+}
+
+// Applies the outcome of a finished sync job. With wait, blocks until a running job ends.
+static void collectSyncJob(bool wait) {
+    SyncOutcome outcome;
+    {
+        std::unique_lock<std::mutex> lock(g_syncMutex);
+        if (!g_syncBusy)
+            return;
+        if (wait)
+            g_syncWake.wait(lock, [] { return g_syncDone; });
+        else if (!g_syncDone)
+            return;
+        outcome = std::move(g_syncOutcome);
+        g_syncDone = false;
+        g_syncBusy = false;
+    }
+    // Nothing was collected while the job ran, so these are still the oldest.
+    g_unwritten = std::move(outcome.unwritten);
+    if (outcome.merged)
+        finishMerge(outcome.result, outcome.firstDay, outcome.lastDay);
+}
+
+static void stopSyncThread() {
+    collectSyncJob(true);
+    if (!g_syncThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(g_syncMutex);
+        g_syncStopping = true;
+    }
+    g_syncWake.notify_all();
+    g_syncThread.join();
+}
+
+bool exportChangeset() {
+    if (!g_session)
+        return false;
+    collectSyncJob(true);
+    std::string directory = getSyncDirectory();
+    // Without a directory keep recording; the changes are exported once one is set.
+    if (directory.empty())
+        return true;
+
+    PendingChangeset next;
+    bool ok = takeChangeset(next);
+    if (!next.data.empty())
+        g_unwritten.push_back(std::move(next));
+    return writeChangesets(directory, getMachineId(), g_unwritten) && ok;
+}
+
+void stopChangeRecording() {
+    stopSyncThread();
+    if (!g_session)
+        return;
+    exportChangeset();
+    if (g_session) {
+        sqlite3session_delete(g_session);
+        g_session = nullptr;
+    }
+}
+
+static void trackDay(double startTime, int& firstDay, int& lastDay) {
+    int day = julianToDayNumber(startTime);
+    firstDay = std::min(firstDay, day);
+    lastDay = std::max(lastDay, day);
+}
+
+// Runs a SyncAlias statement with 'machine' and the remote id as its first two parameters
+// and, if given, the owner and origin id as the next two.
+static bool runAliasStatement(sqlite3* dbHandle, const char* sql, const std::string& machine, sqlite3_value* remoteId,
+                              sqlite3_value* ownerId = nullptr, sqlite3_value* originId = nullptr) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare sync alias statement: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, machine.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_value(stmt, 2, remoteId);
+    if (ownerId && originId) {
+        sqlite3_bind_value(stmt, 3, ownerId);
+        sqlite3_bind_value(stmt, 4, originId);
+    }
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok)
+        std::cerr << "Failed to update sync aliases: " << sqlite3_errmsg(dbHandle) << std::endl;
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Records the identity of a row 'machine' had merged from elsewhere (see addMergedRowAliases).
+static bool applyAlias(sqlite3* dbHandle, sqlite3_changeset_iter* iter, int columns, const std::string& machine) {
+    sqlite3_value* values[3] = {};
+    for (int i = 0; i < std::min(columns, 3); i++)
+        sqlite3changeset_new(iter, i, &values[i]);
+    if (!values[0] || !values[1] || !values[2] || sqlite3_value_type(values[1]) == SQLITE_NULL)
+        return true;
+    return runAliasStatement(dbHandle,
+                             "INSERT OR REPLACE INTO SyncAlias (machineId, remoteId, ownerId, originId) VALUES (?, ?, ?, ?);",
+                             machine, values[0], values[1], values[2]);
+}
+
+// Inserts a session created on 'machine'. Sessions that were themselves merged from
+// another machine are skipped; that machine's own changesets carry them. A session still
+// open when the changeset was written ends at that time here, until a later changeset
+// carries its real end; left open it would run on to this machine's clock.
+static bool applyInsert(sqlite3* dbHandle, sqlite3_changeset_iter* iter, int columns, const std::string& machine,
+                        double changesetTime, MergeResult& result, int& firstDay, int& lastDay) {
+    sqlite3_value* values[ColMachineId + 1] = {};
+    int count = std::min(columns, static_cast<int>(ColMachineId) + 1);
+    for (int i = 0; i < count; i++)
+        sqlite3changeset_new(iter, i, &values[i]);
+    if (!values[ColId] || !values[ColStartTime])
+        return true;
+    if (values[ColMachineId] && sqlite3_value_type(values[ColMachineId]) != SQLITE_NULL)
+        return true;
+
+    const char* insertSql = R"(
+        INSERT OR IGNORE INTO ActivitySession (processName, windowTitle, startTime, endTime, machineId, originId)
+        VALUES (?, ?, ?, ?, ?, ?);
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, insertSql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare merge insert: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    for (int i = ColProcessName; i <= ColStartTime; i++) {
+        if (values[i])
+            sqlite3_bind_value(stmt, i, values[i]);
+    }
+    if (values[ColEndTime] && sqlite3_value_type(values[ColEndTime]) != SQLITE_NULL)
+        sqlite3_bind_value(stmt, ColEndTime, values[ColEndTime]);
+    else
+        sqlite3_bind_double(stmt, ColEndTime, std::max(sqlite3_value_double(values[ColStartTime]), changesetTime));
+    sqlite3_bind_text(stmt, 5, machine.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_value(stmt, 6, values[ColId]);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (ok && sqlite3_changes(dbHandle) > 0) {
+        result.rowsInserted++;
+        trackDay(sqlite3_value_double(values[ColStartTime]), firstDay, lastDay);
+    }
+    sqlite3_finalize(stmt);
+    if (!ok) {
+        std::cerr << "Failed to merge session: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+
+    // Rows merged before open sessions were clamped can still be open; a newer session
+    // from the same machine means they have ended.
+    const char* closeSql = R"(
+        UPDATE ActivitySession SET endTime = MAX(startTime, ?1)
+        WHERE machineId = ?2 AND originId < ?3 AND endTime IS NULL;
+    )";
+    if (sqlite3_prepare_v2(dbHandle, closeSql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_value(stmt, 1, values[ColStartTime]);
+        sqlite3_bind_text(stmt, 2, machine.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_value(stmt, 3, values[ColId]);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    return true;
+}
+
+// Applies changed columns of a session updated on 'machine'. An update names the row only
+// by its id there; like applyDelete, it is either one that machine recorded itself or one
+// it had merged from another machine, possibly this one. The latter are in SyncAlias.
+static bool applyUpdate(sqlite3* dbHandle, sqlite3_changeset_iter* iter, int columns, const std::string& machine,
+                        const std::string& self, MergeResult& result, int& firstDay, int& lastDay) {
+    static const char* columnNames[] = { "id", "processName", "windowTitle", "startTime", "endTime" };
+    sqlite3_value* remoteId = nullptr;
+    if (sqlite3changeset_old(iter, ColId, &remoteId) != SQLITE_OK || !remoteId)
+        return true;
+
+    std::string owner = machine;
+    long long originId = sqlite3_value_int64(remoteId);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT ownerId, originId FROM SyncAlias WHERE machineId = ? AND remoteId = ?;",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare sync alias lookup: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, machine.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_value(stmt, 2, remoteId);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        owner = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        originId = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    std::string sql = "UPDATE ActivitySession SET ";
+    std::vector<sqlite3_value*> changed;
+    int last = std::min(columns - 1, static_cast<int>(ColEndTime));
+    for (int i = ColProcessName; i <= last; i++) {
+        sqlite3_value* value = nullptr;
+        if (sqlite3changeset_new(iter, i, &value) == SQLITE_OK && value) {
+            if (!changed.empty())
+                sql += ", ";
+            sql += std::string(columnNames[i]) + " = ?";
+            changed.push_back(value);
+        }
+    }
+    if (changed.empty())
+        return true;
+    sql += (owner == self) ? " WHERE id = ? AND machineId IS NULL RETURNING startTime;"
+                           : " WHERE machineId = ? AND originId = ? RETURNING startTime;";
+
+    if (sqlite3_prepare_v2(dbHandle, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare merge update: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    int param = 1;
+    for (sqlite3_value* value : changed)
+        sqlite3_bind_value(stmt, param++, value);
+    if (owner != self)
+        sqlite3_bind_text(stmt, param++, owner.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, param, originId);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        result.rowsUpdated++;
+        trackDay(sqlite3_column_double(stmt, 0), firstDay, lastDay);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Failed to merge session update: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Removes a session deleted on 'machine'. The row is either one that machine recorded
+// itself or one it had merged from another machine, possibly this one.
+static bool applyDelete(sqlite3* dbHandle, sqlite3_changeset_iter* iter, int columns, const std::string& machine,
+                        const std::string& self, MergeResult& result, int& firstDay, int& lastDay) {
+    sqlite3_value* values[ColOriginId + 1] = {};
+    int count = std::min(columns, static_cast<int>(ColOriginId) + 1);
+    for (int i = 0; i < count; i++)
+        sqlite3changeset_old(iter, i, &values[i]);
+    bool merged = values[ColMachineId] && sqlite3_value_type(values[ColMachineId]) != SQLITE_NULL;
+    std::string owner = machine;
+    if (merged) {
+        const unsigned char* text = sqlite3_value_text(values[ColMachineId]);
+        owner = text ? reinterpret_cast<const char*>(text) : "";
+    }
+    sqlite3_value* originId = merged ? values[ColOriginId] : values[ColId];
+    if (!originId || sqlite3_value_type(originId) == SQLITE_NULL)
+        return true;
+    if (merged && values[ColId] &&
+        !runAliasStatement(dbHandle, "DELETE FROM SyncAlias WHERE machineId = ? AND remoteId = ?;", machine, values[ColId]))
+        return false;
+
+    const char* sql = (owner == self)
+        ? "DELETE FROM ActivitySession WHERE id = ?2 AND machineId IS NULL RETURNING startTime;"
+        : "DELETE FROM ActivitySession WHERE machineId = ?1 AND originId = ?2 RETURNING startTime;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare merge delete: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    if (owner != self)
+        sqlite3_bind_text(stmt, 1, owner.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_value(stmt, 2, originId);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        result.rowsDeleted++;
+        trackDay(sqlite3_column_double(stmt, 0), firstDay, lastDay);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Failed to merge session delete: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Applies one changeset from 'machine', written at local julian time changesetTime.
+// Retention deletes never reach a changeset (see pauseChangeRecording), so every delete
+// here is an edit to carry over. MergedRow aliases are read first, since the updates
+// they describe may come earlier in the changeset.
+static bool applyChangeset(sqlite3* dbHandle, const std::string& machine, const std::string& self,
+                           double changesetTime, std::string& data, MergeResult& result,
+                           int& firstDay, int& lastDay) {
+    bool ok = true;
+    for (int pass = 0; ok && pass < 2; pass++) {
+        sqlite3_changeset_iter* iter = nullptr;
+        if (sqlite3changeset_start(&iter, static_cast<int>(data.size()), data.data()) != SQLITE_OK) {
+            std::cerr << "Failed to read changeset from " << machine << std::endl;
+            return false;
+        }
+        while (ok && sqlite3changeset_next(iter) == SQLITE_ROW) {
+            const char* table = nullptr;
+            int columns = 0, op = 0, indirect = 0;
+            sqlite3changeset_op(iter, &table, &columns, &op, &indirect);
+            if (!table)
+                continue;
+            if (pass == 0) {
+                if (std::string(table) == "MergedRow" && op == SQLITE_INSERT)
+                    ok = applyAlias(dbHandle, iter, columns, machine);
+                continue;
+            }
+            if (std::string(table) != "ActivitySession" || columns <= ColEndTime)
+                continue;
+            if (op == SQLITE_INSERT)
+                ok = applyInsert(dbHandle, iter, columns, machine, changesetTime, result, firstDay, lastDay);
+            else if (op == SQLITE_UPDATE)
+                ok = applyUpdate(dbHandle, iter, columns, machine, self, result, firstDay, lastDay);
+            else if (op == SQLITE_DELETE)
+                ok = applyDelete(dbHandle, iter, columns, machine, self, result, firstDay, lastDay);
+        }
+        if (sqlite3changeset_finalize(iter) != SQLITE_OK)
+            ok = false;
+    }
+    return ok;
+}
+
+static bool readFile(const fs::path& path, std::string& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Applies new changesets from the other machines in 'directory' on 'dbHandle', which may be
+// the sync thread's own connection. julianNow and fileNow are matching clock readings.
+static MergeResult mergeDirectory(sqlite3* dbHandle, const std::string& directory, const std::string& self,
+                                  double julianNow, fs::file_time_type fileNow, int& firstDay, int& lastDay) {
+    MergeResult result;
+    std::error_code ec;
+    if (!fs::is_directory(directory, ec))
+        return result;
+
+    auto started = std::chrono::steady_clock::now();
+    for (const auto& machineEntry : fs::directory_iterator(directory, ec)) {
+        if (!machineEntry.is_directory())
+            continue;
+        std::string machine = machineEntry.path().filename().string();
+        if (machine == self)
+            continue;
+        result.machines++;
+
+        // Only changesets newer than the stored cursor are read.
+        std::string cursorKey = "sync.cursor." + machine;
+        long long cursor = std::stoll(getMetaValue(dbHandle, cursorKey, "0"));
+        std::vector<std::pair<long long, fs::path>> pending;
+        for (const auto& fileEntry : fs::directory_iterator(machineEntry.path(), ec)) {
+            if (fileEntry.path().extension() != ".changeset")
+                continue;
+            long long sequence = std::atoll(fileEntry.path().stem().string().c_str());
+            if (sequence > cursor)
+                pending.push_back({sequence, fileEntry.path()});
+        }
+        std::sort(pending.begin(), pending.end());
+
+        for (const auto& file : pending) {
+            std::string data;
+            if (!readFile(file.second, data)) {
+                std::cerr << "Failed to read " << file.second.string() << std::endl;
+                break;
+            }
+            double changesetTime = julianNow;
+            auto written = fs::last_write_time(file.second, ec);
+            if (!ec && written < fileNow)
+                changesetTime -= std::chrono::duration<double>(fileNow - written).count() / 86400.0;
+
+            sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+            if (!applyChangeset(dbHandle, machine, self, changesetTime, data, result, firstDay, lastDay) ||
+                !setMetaValue(dbHandle, cursorKey, std::to_string(file.first))) {
+                sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+                break;
+            }
+            sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+            bumpWriteGeneration();
+            result.changesets++;
+        }
+    }
+    result.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
+
+MergeResult mergeFromSyncDirectory() {
+    collectSyncJob(true);
+    sqlite3* dbHandle = getDatabase();
+    std::string directory = getSyncDirectory();
+    if (!dbHandle || directory.empty())
+        return MergeResult();
+
+    int firstDay = 0x7fffffff, lastDay = -1;
+    // Merged rows must not be recorded and exported again as this machine's own writes.
+    pauseChangeRecording();
+    MergeResult result = mergeDirectory(dbHandle, directory, getMachineId(), getCurrentJulianDay(),
+                                        fs::file_time_type::clock::now(), firstDay, lastDay);
+    resumeChangeRecording();
+    finishMerge(result, firstDay, lastDay);
+    return result;
+}
+
+// The sync thread writes exports and merges on its own connection, which has no change
+// session, so merged rows are never recorded as this machine's writes.
+static void syncThreadMain() {
+    sqlite3* connection = nullptr;
+    std::unique_lock<std::mutex> lock(g_syncMutex);
+    for (;;) {
+        g_syncWake.wait(lock, [] { return g_syncStopping || g_syncJobReady; });
+        if (!g_syncJobReady)
+            break;
+        SyncJob job = std::move(g_syncJob);
+        g_syncJobReady = false;
+        lock.unlock();
+
+        SyncOutcome outcome;
+        writeChangesets(job.directory, job.machineId, job.exports);
+        outcome.unwritten = std::move(job.exports);
+        if (job.merge) {
+            if (!connection)
+                connection = openWriteConnection();
+            if (connection) {
+                outcome.result = mergeDirectory(connection, job.directory, job.machineId, job.julianNow,
+                                                job.fileNow, outcome.firstDay, outcome.lastDay);
+                outcome.merged = true;
+            }
+        }
+
+        lock.lock();
+        g_syncOutcome = std::move(outcome);
+        g_syncDone = true;
+        g_syncWake.notify_all();
+    }
+    lock.unlock();
+    if (connection)
+        sqlite3_close(connection);
+}
+
+// Collects the pending changeset and hands it, with any earlier unwritten ones and
+// optionally a merge, to the sync thread. Skipped while the previous job is running.
+static void startSyncJob(bool merge) {
+    collectSyncJob(false);
+    if (g_syncBusy)
+        return;
+    std::string directory = getSyncDirectory();
+    if (directory.empty())
+        return;
+
+    SyncJob job;
+    job.directory = directory;
+    job.machineId = getMachineId();
+    job.merge = merge;
+    job.julianNow = getCurrentJulianDay();
+    job.fileNow = fs::file_time_type::clock::now();
+    if (g_session) {
+        PendingChangeset next;
+        takeChangeset(next);
+        if (!next.data.empty())
+            g_unwritten.push_back(std::move(next));
+    }
+    job.exports = std::move(g_unwritten);
+    g_unwritten.clear();
+    if (!job.merge && job.exports.empty())
+        return;
+
+    if (!g_syncThread.joinable()) {
+        g_syncStopping = false;
+        g_syncThread = std::thread(syncThreadMain);
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_syncMutex);
+        g_syncJob = std::move(job);
+        g_syncJobReady = true;
+        g_syncBusy = true;
+    }
+    g_syncWake.notify_all();
+}
+
+void runSyncMaintenance() {
+    collectSyncJob(false);
+    auto now = std::chrono::steady_clock::now();
+    if (now < g_nextSync)
+        return;
+    g_nextSync = now + std::chrono::minutes(5);
+    startSyncJob(true);
+}
+
+void DrawSyncPane() {
+    ImGui::Begin("Sync");
+
+    static char directory[512] = "";
+    static bool loaded = false;
+    if (!loaded) {
+        std::snprintf(directory, sizeof(directory), "%s", getSyncDirectory().c_str());
+        loaded = true;
+    }
+
+    ImGui::Text("Machine id: %s", getMachineId().c_str());
+    ImGui::InputTextWithHint("Shared directory", "e.g. a synced folder", directory, sizeof(directory));
+    if (ImGui::Button("Save"))
+        setSyncDirectory(directory);
+    ImGui::SameLine();
+    ImGui::BeginDisabled(g_syncBusy);
+    if (ImGui::Button("Export Now"))
+        startSyncJob(false);
+    ImGui::SameLine();
+    if (ImGui::Button("Merge Now"))
+        startSyncJob(true);
+    ImGui::EndDisabled();
+    if (g_syncBusy) {
+        ImGui::SameLine();
+        ImGui::TextUnformatted("Syncing...");
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Last merge: %d machines, %d changesets, %lld new / %lld updated / %lld deleted sessions (%.1f ms)",
+                g_lastMerge.machines, g_lastMerge.changesets, g_lastMerge.rowsInserted,
+                g_lastMerge.rowsUpdated, g_lastMerge.rowsDeleted, g_lastMerge.elapsedMs);
+    ImGui::End();
+}
@@ -0,0 +1,56 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <string>
+
+// Multi-machine history merge built on the SQLite session extension.
+//
+// Every tracker records a changeset of its own ActivitySession writes and periodically
+// exports it to <syncDirectory>/<machineId>/<sequence>.changeset. Merging reads the
+// changesets of every other machine in the directory, newer than the stored per-machine
+// cursor, and applies them as rows tagged with (machineId, originId). A unique index on
+// that pair deduplicates rows that are seen twice. Updates and deletes (bulk edits,
+// integrity repairs) propagate, also to rows the other machine had merged in itself; those
+// are tracked in SyncAlias. Retention compaction pauses recording, since every machine
+// compacts on its own.
+//
+// The periodic export and merge run on a background thread with its own connection. The
+// UI thread only collects the recorded changeset and applies the merge's day range.
+
+// Returns this database's machine id, generating and storing one on first use.
+std::string getMachineId();
+
+void setSyncDirectory(const std::string& directory);
+std::string getSyncDirectory();
+
+// Attaches a session to ActivitySession so local writes are recorded. Call after initDatabase.
+bool startChangeRecording();
+// Writes the changes recorded since the last export as a new changeset file and starts a new one.
+// Returns false on error; succeeds without writing anything if nothing changed. Waits for a
+// running background sync first.
+bool exportChangeset();
+// Ends change recording, exporting anything still pending, and stops the sync thread.
+void stopChangeRecording();
+// Suspend and resume recording around writes that stay on this machine. Calls nest.
+void pauseChangeRecording();
+void resumeChangeRecording();
+
+struct MergeResult {
+    int machines = 0;     // Other machines found in the sync directory.
+    int changesets = 0;   // Changeset files applied.
+    long long rowsInserted = 0;
+    long long rowsUpdated = 0;
+    long long rowsDeleted = 0;
+    double elapsedMs = 0.0;
+};
+
+// Applies every new changeset from other machines in the sync directory, on the calling thread.
+MergeResult mergeFromSyncDirectory();
+
+// Called once per frame from the main loop; every few minutes it hands an export and merge
+// to the sync thread, and applies the results of a finished one.
+void runSyncMaintenance();
+
+void DrawSyncPane();
+
+#endif // SYNC_H
@@ -0,0 +1,229 @@
+#include "tags.h"
+
+#include "database.h"
+#include "functions.h"
+#include "heatmap.h"
+#include "minute_index.h"
+#include "session_bitmap.h"
+#include <sqlite3.h>
+#include <imgui.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Tagged time is a SessionBitmap of seconds since julian day 0, so a tag is a handful of
+// runs however many sessions it covers, and it outlives the sessions themselves.
+static int64_t toSecond(double jd) {
+    return std::llround(jd * 86400.0);
+}
+
+static double toJulian(int64_t second) {
+    return static_cast<double>(second) / 86400.0;
+}
+
+struct TagEntry {
+    std::string name;
+    SessionBitmap seconds;
+};
+
+// All tags keyed by id, loaded lazily from Tag/TagTime.
+static std::map<int, TagEntry> g_tags;
+static bool g_tagsLoaded = false;
+
+static bool saveTagTime(sqlite3* dbHandle, int tagId, const SessionBitmap& seconds) {
+    const char* sql = "INSERT OR REPLACE INTO TagTime (tagId, spans) VALUES (?, ?);";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare tag time update: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    std::string blob = seconds.serialize();
+    sqlite3_bind_int(stmt, 1, tagId);
+    sqlite3_bind_blob(stmt, 2, blob.data(), static_cast<int>(blob.size()), SQLITE_TRANSIENT);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok)
+        std::cerr << "Failed to save tag time: " << sqlite3_errmsg(dbHandle) << std::endl;
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+static void loadTags() {
+    if (g_tagsLoaded)
+        return;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    const char* sql = "SELECT t.id, t.name, s.spans FROM Tag t LEFT JOIN TagTime s ON s.tagId = t.id;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare tag load query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        TagEntry entry;
+        int tagId = sqlite3_column_int(stmt, 0);
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        entry.name = name ? reinterpret_cast<const char*>(name) : "";
+        entry.seconds = SessionBitmap::deserialize(sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2));
+        g_tags[tagId] = std::move(entry);
+    }
+    sqlite3_finalize(stmt);
+    g_tagsLoaded = true;
+}
+
+// Id of the tag called name, or 0 if there is none.
+static int findTag(const std::string& name) {
+    loadTags();
+    for (const auto& entry : g_tags) {
+        if (entry.second.name == name)
+            return entry.first;
+    }
+    return 0;
+}
+
+int getOrCreateTag(const std::string& name) {
+    int tagId = findTag(name);
+    if (tagId != 0)
+        return tagId;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || name.empty())
+        return 0;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "INSERT INTO Tag (name) VALUES (?);", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare tag insert: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Failed to create tag " << name << ": " << sqlite3_errmsg(dbHandle) << std::endl;
+        return 0;
+    }
+    tagId = static_cast<int>(sqlite3_last_insert_rowid(dbHandle));
+    g_tags[tagId].name = name;
+    return tagId;
+}
+
+bool applyTagToRange(const std::string& tagName, double startJD, double endJD) {
+    int tagId = getOrCreateTag(tagName);
+    sqlite3* dbHandle = getDatabase();
+    if (tagId == 0 || !dbHandle || endJD <= startJD)
+        return false;
+    TagEntry& entry = g_tags[tagId];
+    entry.seconds.addRange(toSecond(startJD), toSecond(endJD) - 1);
+    return saveTagTime(dbHandle, tagId, entry.seconds);
+}
+
+bool removeTagFromRange(const std::string& tagName, double startJD, double endJD) {
+    int tagId = findTag(tagName);
+    // A tag that does not exist covers no time; it is not created just to stay empty.
+    if (tagId == 0)
+        return true;
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || endJD <= startJD)
+        return false;
+    TagEntry& entry = g_tags[tagId];
+    entry.seconds.removeRange(toSecond(startJD), toSecond(endJD) - 1);
+    return saveTagTime(dbHandle, tagId, entry.seconds);
+}
+
+std::vector<TagUsage> getTagTimeForRange(const std::string& startDate, const std::string& endDate) {
+    std::vector<TagUsage> results;
+    loadTags();
+    SessionBitmap period;
+    int64_t periodStart = toSecond(getJulianDayFromDate(startDate));
+    int64_t periodEnd = toSecond(getJulianDayFromDate(endDate));
+    if (periodEnd > periodStart)
+        period.addRange(periodStart, periodEnd - 1);
+
+    // Each tagged run inside the period is a clipped window query, answered by the minute
+    // index within its horizon and by SessionHistory (rollups included) before it.
+    for (const auto& tag : g_tags) {
+        TagUsage usage;
+        usage.tagId = tag.first;
+        usage.name = tag.second.name;
+        SessionBitmap tagged = SessionBitmap::intersect(tag.second.seconds, period);
+        for (const auto& run : tagged.runs())
+            usage.totalTime += queryTimeWindow("", toJulian(run.first), toJulian(run.second + 1)).seconds;
+        results.push_back(usage);
+    }
+    return results;
+}
+
+void DrawTagPane(const std::string& selectedDate) {
+    ImGui::Begin("Tags");
+
+    static char tagName[64] = "";
+    static std::vector<TagUsage> dayUsage;
+    static std::string usageDate;
+    static std::chrono::steady_clock::time_point nextRefresh{};
+    static std::string lastMessage;
+
+    int firstHour = -1, lastHour = -1;
+    bool hasSelection = getTimelineSelection(firstHour, lastHour);
+    if (hasSelection) {
+        ImGui::Text("Selection: %s %02d:00 - %02d:00", selectedDate.c_str(), firstHour, lastHour + 1);
+    } else {
+        ImGui::TextWrapped("Click an hour in the Activity Timeline (shift-click to extend) to select a range.");
+    }
+
+    ImGui::InputText("Tag", tagName, sizeof(tagName));
+    bool canApply = hasSelection && tagName[0] != '\0';
+    if (!canApply)
+        ImGui::BeginDisabled();
+    bool apply = ImGui::Button("Apply Tag");
+    ImGui::SameLine();
+    bool remove = ImGui::Button("Remove Tag");
+    if (!canApply)
+        ImGui::EndDisabled();
+    if (apply || remove) {
+        double dayStart = getJulianDayFromDate(selectedDate);
+        double rangeStart = dayStart + firstHour / 24.0;
+        double rangeEnd = dayStart + (lastHour + 1) / 24.0;
+        bool ok = apply ? applyTagToRange(tagName, rangeStart, rangeEnd)
+                        : removeTagFromRange(tagName, rangeStart, rangeEnd);
+        char message[128];
+        if (ok)
+            std::snprintf(message, sizeof(message), "%s '%s' %s %02d:00 - %02d:00", apply ? "Applied" : "Removed",
+                          tagName, apply ? "to" : "from", firstHour, lastHour + 1);
+        else
+            std::snprintf(message, sizeof(message), "Failed to update '%s'", tagName);
+        lastMessage = message;
+        nextRefresh = {};
+    }
+    if (!lastMessage.empty())
+        ImGui::Text("%s", lastMessage.c_str());
+
+    // Tag totals change slowly; refresh them once a second or when the date changes.
+    auto now = std::chrono::steady_clock::now();
+    if (usageDate != selectedDate || now >= nextRefresh) {
+        dayUsage = getTagTimeForRange(selectedDate, getNextDate(selectedDate));
+        usageDate = selectedDate;
+        nextRefresh = now + std::chrono::seconds(1);
+    }
+
+    ImGui::Separator();
+    if (ImGui::BeginTable("TagTable", 2, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Tag", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Time");
+        ImGui::TableHeadersRow();
+        for (const auto& usage : dayUsage) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            if (ImGui::Selectable(usage.name.c_str(), false, ImGuiSelectableFlags_SpanAllColumns))
+                std::snprintf(tagName, sizeof(tagName), "%s", usage.name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%s", formatTime(usage.totalTime).c_str());
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
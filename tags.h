@@ -0,0 +1,32 @@
+#ifndef TAGS_H
+#define TAGS_H
+
+#include <string>
+#include <vector>
+
+// Project labels applied to spans of time (e.g. for billing).
+// Each tag owns a compressed SessionBitmap of tagged seconds, persisted in TagTime.
+// Tagged time for a period is the tracked time inside the tag's runs within the period,
+// with sessions clipped to each run. Tags refer to time rather than session rows, so they
+// survive retention compaction and history merges.
+struct TagUsage {
+    int tagId = 0;
+    std::string name;
+    double totalTime = 0.0; // Tracked seconds inside the tag's spans in the queried period.
+};
+
+// Returns the id of the named tag, creating it if needed (0 on failure).
+int getOrCreateTag(const std::string& name);
+
+// Tags the time [startJD, endJD). False on error.
+bool applyTagToRange(const std::string& tagName, double startJD, double endJD);
+// Removes the tag from the time [startJD, endJD). An unknown tag is left uncreated.
+bool removeTagFromRange(const std::string& tagName, double startJD, double endJD);
+
+// Tagged time per tag inside [startDate, endDate) (endDate exclusive, "YYYY-MM-DD").
+std::vector<TagUsage> getTagTimeForRange(const std::string& startDate, const std::string& endDate);
+
+// Draws the pane used to tag the hours selected in the Activity Timeline.
+void DrawTagPane(const std::string& selectedDate);
+
+#endif // TAGS_H
@@ -0,0 +1,414 @@
+#include "timeline_pyramid.h"
+
+#include "daily_usage.h"
+#include "database.h"
+#include "functions.h"
+#include "heatmap.h"
+#include "history_edit.h"
+#include "integrity.h"
+#include "interval_buckets.h"
+#include "imgui.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const size_t kMaxTiles = 256;           // About 40 KB each for a busy day.
+static const double kTileLoadBudgetMs = 4.0;   // Per frame, so a 60 fps frame keeps most of its time.
+static const double kMinSpanDays = 1.0 / 48.0; // 30 minutes across the whole pane.
+static const double kMaxSpanDays = 3653.0;     // Ten years.
+
+struct TimelineSession {
+    std::string processName;
+    std::string windowTitle;
+    double startTime;
+    double endTime;
+};
+
+// Everything below day resolution for one day, clipped to that day.
+struct DayTile {
+    std::array<double, kFiveMinuteBuckets> fiveMinutes{};  // Seconds.
+    std::array<double, 24> hours{};                        // Sums of twelve 5-minute buckets.
+    double total = 0.0;
+    std::vector<TimelineSession> sessions;
+    bool hasOpen = false;
+    unsigned long long generation = 0;
+    std::chrono::steady_clock::time_point builtAt;
+};
+
+struct TileSlot {
+    DayTile tile;
+    std::list<int>::iterator order;
+};
+
+static std::unordered_map<int, TileSlot> g_tiles;
+static std::list<int> g_tileOrder;   // Most recently drawn first.
+static std::vector<int> g_wantedDays; // Missing or outdated tiles seen while drawing this frame.
+
+static double g_viewStart = 0.0;     // Julian timestamp at the left edge.
+static double g_viewSpan = 7.0;      // Days across the pane.
+
+static bool buildTile(sqlite3* dbHandle, int day, DayTile& tile) {
+    double dayStart = dayNumberToJulian(day);
+    double now = getCurrentJulianDay();
+    tile = DayTile();
+    tile.generation = getWriteGeneration();
+    tile.builtAt = std::chrono::steady_clock::now();
+
+    // No session outlasts kMaxSessionDays, so that much slack on startTime finds
+    // the ones that began the day before and end on this one.
+    const char* sql = R"(
+        SELECT processName, windowTitle, startTime, endTime
+        FROM SessionHistory
+        WHERE startTime >= ?4 AND startTime < ?2 AND COALESCE(endTime, ?3) > ?1
+        ORDER BY startTime;
+    )";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare timeline tile query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, dayStart);
+    sqlite3_bind_double(stmt, 2, dayStart + 1.0);
+    sqlite3_bind_double(stmt, 3, now);
+    sqlite3_bind_double(stmt, 4, dayStart - kMaxSessionDays);
+    std::vector<double> starts;
+    std::vector<double> ends;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* procName = sqlite3_column_text(stmt, 0);
+        const unsigned char* title = sqlite3_column_text(stmt, 1);
+        bool open = sqlite3_column_type(stmt, 3) == SQLITE_NULL;
+        double startTime = sqlite3_column_double(stmt, 2);
+        double endTime = open ? std::max(now, startTime) : sqlite3_column_double(stmt, 3);
+        tile.hasOpen = tile.hasOpen || open;
+        tile.sessions.push_back(TimelineSession{procName ? reinterpret_cast<const char*>(procName) : "",
+                                                title ? reinterpret_cast<const char*>(title) : "",
+                                                startTime, endTime});
+        starts.push_back(startTime);
+        ends.push_back(endTime);
+    }
+    sqlite3_finalize(stmt);
+
+    accumulateIntervals(makeDayBucketGrid(dayStart, kFiveMinuteBuckets), starts.data(), ends.data(),
+                        starts.size(), 86400.0, tile.fiveMinutes.data());
+    for (int bucket = 0; bucket < kFiveMinuteBuckets; bucket++) {
+        tile.hours[bucket / 12] += tile.fiveMinutes[bucket];
+        tile.total += tile.fiveMinutes[bucket];
+    }
+    return true;
+}
+
+// Today's tile and any tile with an open session keep growing, so they are rebuilt
+// after a write or every few seconds. Older days only change through day repairs.
+static bool tileOutdated(int day, const DayTile& tile) {
+    int today = julianToDayNumber(getCurrentJulianDay());
+    if (!tile.hasOpen && day < today)
+        return false;
+    return tile.generation != getWriteGeneration() ||
+           std::chrono::steady_clock::now() - tile.builtAt >= std::chrono::seconds(5);
+}
+
+// Returns the tile for a day if it is loaded (possibly outdated), and queues it for
+// loading or refreshing otherwise.
+static const DayTile* findTile(int day) {
+    auto it = g_tiles.find(day);
+    if (it == g_tiles.end()) {
+        g_wantedDays.push_back(day);
+        return nullptr;
+    }
+    g_tileOrder.splice(g_tileOrder.begin(), g_tileOrder, it->second.order);
+    if (tileOutdated(day, it->second.tile))
+        g_wantedDays.push_back(day);
+    return &it->second.tile;
+}
+
+// Loads the wanted tiles nearest the middle of the view first, until the frame budget runs out.
+static size_t loadWantedTiles(int centerDay) {
+    std::sort(g_wantedDays.begin(), g_wantedDays.end(), [&](int a, int b) {
+        int distanceA = std::abs(a - centerDay), distanceB = std::abs(b - centerDay);
+        return distanceA != distanceB ? distanceA < distanceB : a < b;
+    });
+    g_wantedDays.erase(std::unique(g_wantedDays.begin(), g_wantedDays.end()), g_wantedDays.end());
+    sqlite3* dbHandle = getDatabase();
+    auto started = std::chrono::steady_clock::now();
+    size_t loaded = 0;
+    for (int day : g_wantedDays) {
+        if (!dbHandle ||
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count() >= kTileLoadBudgetMs)
+            break;
+        DayTile tile;
+        if (!buildTile(dbHandle, day, tile))
+            break;
+        auto it = g_tiles.find(day);
+        if (it != g_tiles.end()) {
+            it->second.tile = std::move(tile);
+        } else {
+            g_tileOrder.push_front(day);
+            g_tiles.emplace(day, TileSlot{std::move(tile), g_tileOrder.begin()});
+        }
+        loaded++;
+    }
+    size_t waiting = g_wantedDays.size() - loaded;
+    g_wantedDays.clear();
+
+    while (g_tiles.size() > kMaxTiles) {
+        g_tiles.erase(g_tileOrder.back());
+        g_tileOrder.pop_back();
+    }
+    return waiting;
+}
+
+static void onHistoryDaysChanged(int firstDay, int lastDay) {
+    for (auto it = g_tiles.begin(); it != g_tiles.end();) {
+        if (it->first >= firstDay && it->first <= lastDay) {
+            g_tileOrder.erase(it->second.order);
+            it = g_tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void initTimelinePyramid() {
+    registerDayRepairHandler(onHistoryDaysChanged);
+    g_viewStart = getCurrentJulianDay() - g_viewSpan * 0.95;
+}
+
+// --- Drawing ---
+
+enum class TimelineLevel { Day, Hour, FiveMinute, Session };
+
+static const char* levelName(TimelineLevel level) {
+    switch (level) {
+        case TimelineLevel::Day: return "days";
+        case TimelineLevel::Hour: return "hours";
+        case TimelineLevel::FiveMinute: return "5 minutes";
+        default: return "sessions";
+    }
+}
+
+// The finest level whose buckets are still at least two pixels wide.
+static TimelineLevel chooseLevel(double secondsPerPixel) {
+    if (secondsPerPixel > 1800.0)
+        return TimelineLevel::Day;
+    if (secondsPerPixel > 150.0)
+        return TimelineLevel::Hour;
+    if (secondsPerPixel > 15.0)
+        return TimelineLevel::FiveMinute;
+    return TimelineLevel::Session;
+}
+
+struct TimelineBar {
+    double start;
+    double end;
+    double fraction;  // Share of the bar's time that was tracked.
+    bool loaded;
+};
+
+// Day bars. Several days share a bar when days are narrower than two pixels, and
+// bars are aligned to multiples of that width so they do not shimmer while panning.
+static void collectDayBars(double viewEnd, float width, std::vector<TimelineBar>& bars) {
+    int daysPerBar = std::max(1, static_cast<int>(std::ceil(2.0 * g_viewSpan / width)));
+    int firstDay = julianToDayNumber(g_viewStart);
+    firstDay -= ((firstDay % daysPerBar) + daysPerBar) % daysPerBar;
+    int lastDay = julianToDayNumber(viewEnd);
+    int indexedThrough = getIndexedThroughDay();
+    int today = julianToDayNumber(getCurrentJulianDay());
+    for (int day = firstDay; day <= lastDay; day += daysPerBar) {
+        int barLast = day + daysPerBar - 1;
+        TimelineBar bar{dayNumberToJulian(day), dayNumberToJulian(barLast + 1), 0.0, true};
+        double seconds = getIndexedRangeTotal(day, barLast);
+        // Days the index has not reached yet (today, mostly) come from their tiles.
+        for (int recent = std::max(day, indexedThrough + 1); recent <= std::min(barLast, today); recent++) {
+            const DayTile* tile = findTile(recent);
+            if (tile)
+                seconds += tile->total;
+            else
+                bar.loaded = false;
+        }
+        bar.fraction = seconds / (daysPerBar * 86400.0);
+        bars.push_back(bar);
+    }
+}
+
+static void collectBucketBars(TimelineLevel level, double viewEnd, std::vector<TimelineBar>& bars) {
+    int bucketsPerDay = level == TimelineLevel::Hour ? 24 : kFiveMinuteBuckets;
+    double bucketSeconds = 86400.0 / bucketsPerDay;
+    int lastDay = std::min(julianToDayNumber(viewEnd), julianToDayNumber(getCurrentJulianDay()));
+    for (int day = julianToDayNumber(g_viewStart); day <= lastDay; day++) {
+        const DayTile* tile = findTile(day);
+        double dayStart = dayNumberToJulian(day);
+        for (int bucket = 0; bucket < bucketsPerDay; bucket++) {
+            double start = dayStart + static_cast<double>(bucket) / bucketsPerDay;
+            double end = dayStart + static_cast<double>(bucket + 1) / bucketsPerDay;
+            if (end < g_viewStart || start > viewEnd)
+                continue;
+            double seconds = !tile ? 0.0
+                           : level == TimelineLevel::Hour ? tile->hours[bucket] : tile->fiveMinutes[bucket];
+            bars.push_back(TimelineBar{start, end, std::min(1.0, seconds / bucketSeconds), tile != nullptr});
+        }
+    }
+}
+
+// Tick spacing: the smallest step that leaves at least 90 pixels between labels.
+static double chooseTickStep(double daysPerPixel) {
+    static const double steps[] = {5.0 / 1440, 15.0 / 1440, 1.0 / 24, 3.0 / 24, 6.0 / 24,
+                                   1.0, 7.0, 28.0, 91.0, 364.0};
+    for (double step : steps) {
+        if (step / daysPerPixel >= 90.0)
+            return step;
+    }
+    return 364.0 * std::ceil(90.0 * daysPerPixel / 364.0);
+}
+
+static void drawTicks(ImDrawList* drawList, ImVec2 origin, float width, float height) {
+    double viewEnd = g_viewStart + g_viewSpan;
+    double daysPerPixel = g_viewSpan / width;
+    double step = chooseTickStep(daysPerPixel);
+    double first;
+    if (step >= 1.0) {
+        int stepDays = static_cast<int>(step);
+        int day = julianToDayNumber(g_viewStart);
+        day += (stepDays - ((day % stepDays) + stepDays) % stepDays) % stepDays;
+        first = dayNumberToJulian(day);
+    } else {
+        double dayStart = dayNumberToJulian(julianToDayNumber(g_viewStart));
+        first = dayStart + std::ceil((g_viewStart - dayStart) / step) * step;
+    }
+    for (double t = first; t <= viewEnd; t += step) {
+        float x = origin.x + static_cast<float>((t - g_viewStart) / daysPerPixel);
+        drawList->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + height), IM_COL32(200, 200, 200, 100));
+        // Round to the nearest second so 10:59:59.999 reads as 11:00.
+        std::string stamp = julianToCalendarString(t + 0.5 / 86400.0);
+        std::string label = step >= 1.0 ? stamp.substr(0, 10) : stamp.substr(11, 5);
+        drawList->AddText(ImVec2(x + 3, origin.y + height + 2), IM_COL32(120, 120, 120, 255), label.c_str());
+    }
+}
+
+static void handleViewInput(ImVec2 origin, float width) {
+    ImGuiIO& io = ImGui::GetIO();
+    if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+        // Zoom around the time under the cursor.
+        double anchor = (io.MousePos.x - origin.x) / width;
+        double cursorTime = g_viewStart + anchor * g_viewSpan;
+        g_viewSpan = std::clamp(g_viewSpan * std::pow(1.25, -io.MouseWheel), kMinSpanDays, kMaxSpanDays);
+        g_viewStart = cursorTime - anchor * g_viewSpan;
+    }
+    if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left, 0.0f))
+        g_viewStart -= io.MouseDelta.x / width * g_viewSpan;
+}
+
+void DrawTimelineExplorer() {
+    ImGui::Begin("Timeline Explorer");
+    auto frameStart = std::chrono::steady_clock::now();
+
+    struct Preset {
+        const char* label;
+        double span;
+    };
+    static const Preset presets[] = {{"5 Years", 1826.0}, {"Year", 365.0}, {"Month", 30.0},
+                                     {"Week", 7.0}, {"Day", 1.0}, {"Hour", 1.0 / 24}};
+    for (const auto& preset : presets) {
+        if (ImGui::Button(preset.label)) {
+            g_viewSpan = preset.span;
+            g_viewStart = getCurrentJulianDay() - g_viewSpan * 0.95;
+        }
+        ImGui::SameLine();
+    }
+    if (ImGui::Button("Now"))
+        g_viewStart = getCurrentJulianDay() - g_viewSpan * 0.95;
+
+    const float height = 140.0f;
+    float width = std::max(100.0f, ImGui::GetContentRegionAvail().x);
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("##timelineCanvas", ImVec2(width, height));
+    handleViewInput(origin, width);
+    bool hovered = ImGui::IsItemHovered();
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + height), IM_COL32(240, 240, 240, 255), 3.0f);
+    drawList->PushClipRect(origin, ImVec2(origin.x + width, origin.y + height), true);
+
+    double viewEnd = g_viewStart + g_viewSpan;
+    double daysPerPixel = g_viewSpan / width;
+    auto toX = [&](double t) { return origin.x + static_cast<float>((t - g_viewStart) / daysPerPixel); };
+    TimelineLevel level = chooseLevel(daysPerPixel * 86400.0);
+
+    const TimelineSession* hoveredSession = nullptr;
+    if (level == TimelineLevel::Session) {
+        int lastDay = std::min(julianToDayNumber(viewEnd), julianToDayNumber(getCurrentJulianDay()));
+        for (int day = julianToDayNumber(g_viewStart); day <= lastDay; day++) {
+            const DayTile* tile = findTile(day);
+            if (!tile)
+                continue;
+            double dayStart = dayNumberToJulian(day);
+            for (const auto& session : tile->sessions) {
+                // A session that crosses midnight is drawn by the day it started on.
+                if (session.startTime < dayStart && day != julianToDayNumber(g_viewStart))
+                    continue;
+                if (session.endTime < g_viewStart || session.startTime > viewEnd)
+                    continue;
+                float x0 = toX(session.startTime);
+                float x1 = std::max(x0 + 1.0f, toX(session.endTime));
+                drawList->AddRectFilled(ImVec2(x0, origin.y + 10), ImVec2(x1, origin.y + height - 10),
+                                        getAppColor(session.processName));
+                ImVec2 mouse = ImGui::GetMousePos();
+                if (hovered && mouse.x >= x0 && mouse.x <= x1)
+                    hoveredSession = &session;
+            }
+        }
+    } else {
+        std::vector<TimelineBar> bars;
+        if (level == TimelineLevel::Day)
+            collectDayBars(viewEnd, width, bars);
+        else
+            collectBucketBars(level, viewEnd, bars);
+        // Days are a small share of 24 hours, so day bars are scaled to the busiest one in view.
+        double scale = 1.0;
+        if (level == TimelineLevel::Day) {
+            double busiest = 0.0;
+            for (const auto& bar : bars)
+                busiest = std::max(busiest, bar.fraction);
+            scale = busiest > 0.0 ? 1.0 / busiest : 1.0;
+        }
+        for (const auto& bar : bars) {
+            float x0 = toX(bar.start);
+            float x1 = std::max(x0 + 1.0f, toX(bar.end) - 1.0f);
+            if (!bar.loaded) {
+                drawList->AddRectFilled(ImVec2(x0, origin.y), ImVec2(x1, origin.y + height), IM_COL32(225, 225, 225, 255));
+                continue;
+            }
+            float barHeight = static_cast<float>(std::min(1.0, bar.fraction * scale)) * (height - 10.0f);
+            drawList->AddRectFilled(ImVec2(x0, origin.y + height - barHeight), ImVec2(x1, origin.y + height),
+                                    IM_COL32(90, 200, 250, 255));
+        }
+    }
+    drawList->PopClipRect();
+    drawTicks(drawList, origin, width, height);
+    ImGui::Dummy(ImVec2(width, ImGui::GetTextLineHeight() + 4));
+
+    if (hoveredSession) {
+        ImGui::BeginTooltip();
+        ImGui::Text("%s", hoveredSession->processName.c_str());
+        ImGui::TextWrapped("%s", hoveredSession->windowTitle.c_str());
+        ImGui::Text("%s - %s (%s)", julianToCalendarString(hoveredSession->startTime).substr(11, 8).c_str(),
+                    julianToCalendarString(hoveredSession->endTime).substr(11, 8).c_str(),
+                    formatTime((hoveredSession->endTime - hoveredSession->startTime) * 86400.0).c_str());
+        ImGui::EndTooltip();
+    }
+
+    size_t waiting = loadWantedTiles(julianToDayNumber(g_viewStart + g_viewSpan * 0.5));
+    double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    ImGui::Text("%s to %s, by %s. %zu days cached%s (%.2f ms). Scroll to zoom, drag to pan.",
+                julianToCalendarString(g_viewStart).substr(0, 16).c_str(),
+                julianToCalendarString(viewEnd).substr(0, 16).c_str(), levelName(level), g_tiles.size(),
+                waiting > 0 ? ", loading" : "", frameMs);
+    ImGui::End();
+}
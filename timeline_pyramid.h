@@ -0,0 +1,17 @@
+#ifndef TIMELINE_PYRAMID_H
+#define TIMELINE_PYRAMID_H
+
+// Pan/zoom timeline from years down to single sessions, drawn from a pyramid of usage levels.
+//
+// Whole days come from the DailyUsage prefix sums, so any number of days per pixel costs
+// two lookups. Below a day, each visible day is a tile holding hour buckets, 5-minute
+// buckets and the raw sessions, built in one query the first time the day is shown.
+// Tiles stream in under a per-frame time budget and live in an LRU cache; days rewritten
+// through registerDayRepairHandler are dropped, and today's tile is refreshed as it grows.
+
+// Registers for day repairs. Call after initDailyUsage.
+void initTimelinePyramid();
+
+void DrawTimelineExplorer();
+
+#endif // TIMELINE_PYRAMID_H
@@ -1,9 +1,11 @@
 #include "tracker.h"
 #include "database.h"
+#include "functions.h"
 #include <windows.h>
 #include <psapi.h>
 #include <iostream>
 #include <string>
+#include <vector>
 // test
 // Global variables to store the last active window details and session id.
 static std::string lastProcessName = "";
@@ -13,6 +15,24 @@ static int currentSessionId = 0; // 0 indicates no active session.
 // Idle threshold in milliseconds (e.g., 5 minutes = 300000 ms).
 const DWORD idleThreshold = 300000;
 
+static std::vector<SessionEventListener> g_openListeners;
+static std::vector<SessionEventListener> g_closeListeners;
+
+void addSessionOpenListener(SessionEventListener listener) {
+    g_openListeners.push_back(std::move(listener));
+}
+
+void addSessionCloseListener(SessionEventListener listener) {
+    g_closeListeners.push_back(std::move(listener));
+}
+
+static void raiseSessionEvent(const std::vector<SessionEventListener>& listeners,
+                              int sessionId, const std::string& processName) {
+    SessionEvent event{sessionId, processName, getCurrentJulianDay()};
+    for (const auto& listener : listeners)
+        listener(event);
+}
+
 // Helper function to retrieve active window details.
 void getActiveWindowDetails(std::string & processName, std::string & windowTitle) {
     HWND foregroundWindow = GetForegroundWindow();
@@ -61,6 +81,7 @@ void trackActiveWindowSession() {
                 std::cerr << "Failed to end session due to idle state for "
                           << lastProcessName << " - " << lastWindowTitle << std::endl;
             } else {
+                raiseSessionEvent(g_closeListeners, currentSessionId, lastProcessName);
                 std::cout << "Session ended due to idle state." << std::endl;
             }
             currentSessionId = 0;
@@ -84,6 +105,8 @@ void trackActiveWindowSession() {
                 if (!endSession(currentSessionId)) {
                     std::cerr << "Failed to end session for "
                               << lastProcessName << " - " << lastWindowTitle << std::endl;
+                } else {
+                    raiseSessionEvent(g_closeListeners, currentSessionId, lastProcessName);
                 }
             }
         }
@@ -94,6 +117,7 @@ void trackActiveWindowSession() {
                 std::cerr << "Failed to start new session for "
                           << currentProcessName << " - " << currentWindowTitle << std::endl;
             } else {
+                raiseSessionEvent(g_openListeners, currentSessionId, currentProcessName);
                 std::cout << "New session started: " << currentProcessName
                           << " | " << currentWindowTitle << std::endl;
             }
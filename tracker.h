@@ -1,7 +1,22 @@
 #ifndef TRACKER_H
 #define TRACKER_H
 
+#include <functional>
+#include <string>
+
 // Checks the current active window and manages sessions accordingly.
 void trackActiveWindowSession();
 
+// Raised by the tracker after a session row has been written.
+struct SessionEvent {
+    int sessionId;
+    std::string processName;
+    double time;  // Julian day (localtime) the session opened or closed.
+};
+using SessionEventListener = std::function<void(const SessionEvent&)>;
+
+// Listeners are called on the tracking thread, after the database write succeeded.
+void addSessionOpenListener(SessionEventListener listener);
+void addSessionCloseListener(SessionEventListener listener);
+
 #endif
@@ -0,0 +1,441 @@
+#include "transitions.h"
+
+#include "daily_usage.h"
+#include "database.h"
+#include "functions.h"
+#include "history_edit.h"
+#include "retention.h"
+#include "tracker.h"
+#include "imgui.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+
+static const double kMaxSwitchGapSeconds = 5 * 60.0;
+
+// Process names are interned so the matrices are keyed by (from << 32 | to).
+struct DayTransitions {
+    std::unordered_map<uint64_t, uint32_t> pairs;
+    std::array<uint32_t, 24> hours{};
+};
+
+struct LastSession {
+    bool valid = false;
+    uint32_t process = 0;
+    double endTime = 0.0;
+};
+
+static std::vector<std::string> g_names;
+static std::unordered_map<std::string, uint32_t> g_nameIds;
+
+// Days up to g_storedThrough are in DayTransition/HourSwitch; later days are rebuilt from
+// SQL whenever a write other than a tracker event is seen.
+static std::map<int, DayTransitions> g_days;
+static int g_storedThrough = INT_MIN;
+static LastSession g_lastClosed;
+static unsigned long long g_seenGeneration = 0;
+static bool g_initialized = false;
+static bool g_dirty = false;
+// Days rewritten since the last maintenance pass.
+static int g_repairFirstDay = 0;
+static int g_repairLastDay = -1;
+static std::chrono::steady_clock::time_point g_lastBuild;
+static std::chrono::steady_clock::time_point g_lastStoreCheck;
+
+// Bumped whenever g_days changes, invalidating the cached range.
+static unsigned long long g_version = 1;
+static unsigned long long g_cachedVersion = 0;
+static int g_cachedFirstDay = 0;
+static int g_cachedLastDay = -1;
+static SwitchStats g_cachedStats;
+
+static const char* kStoredThroughKey = "transitions.storedThrough";
+
+static uint32_t internName(const std::string& processName) {
+    auto found = g_nameIds.find(processName);
+    if (found != g_nameIds.end())
+        return found->second;
+    uint32_t id = static_cast<uint32_t>(g_names.size());
+    g_names.push_back(processName);
+    g_nameIds.emplace(processName, id);
+    return id;
+}
+
+static void addSwitch(uint32_t from, uint32_t to, double time) {
+    int day = julianToDayNumber(time);
+    int hour = std::clamp(static_cast<int>((time - dayNumberToJulian(day)) * 24.0), 0, 23);
+    DayTransitions& transitions = g_days[day];
+    transitions.pairs[(static_cast<uint64_t>(from) << 32) | to]++;
+    transitions.hours[hour]++;
+    g_version++;
+}
+
+// Adds the switch from previous to a session of process starting at startTime, if it is one.
+static void considerSwitch(const LastSession& previous, uint32_t process, double startTime) {
+    if (previous.valid && previous.process != process &&
+        (startTime - previous.endTime) * 86400.0 <= kMaxSwitchGapSeconds)
+        addSwitch(previous.process, process, startTime);
+}
+
+// Replaces days [firstDay, lastDay] in memory with one ordered pass over their sessions,
+// starting from the session before firstDay. Returns the last closed session seen.
+static bool buildDays(sqlite3* dbHandle, int firstDay, int lastDay, LastSession& lastClosed) {
+    g_days.erase(g_days.lower_bound(firstDay), g_days.upper_bound(lastDay));
+    g_version++;
+    double from = dayNumberToJulian(firstDay);
+    double to = lastDay == INT_MAX ? getCurrentJulianDay() + 1.0 : dayNumberToJulian(lastDay + 1);
+
+    LastSession previous;
+    sqlite3_stmt* stmt = nullptr;
+    const char* previousSql = R"(
+        SELECT COALESCE(processName, ''), endTime FROM ActivitySession
+        WHERE machineId IS NULL AND startTime < ? ORDER BY startTime DESC LIMIT 1;
+    )";
+    if (sqlite3_prepare_v2(dbHandle, previousSql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, from);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 1) != SQLITE_NULL) {
+            previous.valid = true;
+            previous.process = internName(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            previous.endTime = sqlite3_column_double(stmt, 1);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    const char* sql = R"(
+        SELECT COALESCE(processName, ''), startTime, endTime FROM ActivitySession
+        WHERE machineId IS NULL AND startTime >= ? AND startTime < ?
+        ORDER BY startTime;
+    )";
+    stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to prepare transition query: " << sqlite3_errmsg(dbHandle) << std::endl;
+        return false;
+    }
+    sqlite3_bind_double(stmt, 1, from);
+    sqlite3_bind_double(stmt, 2, to);
+    lastClosed = previous;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        uint32_t process = internName(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        considerSwitch(previous, process, sqlite3_column_double(stmt, 1));
+        previous.process = process;
+        previous.valid = sqlite3_column_type(stmt, 2) != SQLITE_NULL;
+        previous.endTime = previous.valid ? sqlite3_column_double(stmt, 2) : 0.0;
+        if (previous.valid)
+            lastClosed = previous;
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// Rebuilds the days after g_storedThrough and the last closed session.
+static void rebuildRecentDays(sqlite3* dbHandle) {
+    g_seenGeneration = getWriteGeneration();
+    g_lastBuild = std::chrono::steady_clock::now();
+    LastSession lastClosed;
+    if (!buildDays(dbHandle, g_storedThrough + 1, INT_MAX, lastClosed))
+        return;
+    g_lastClosed = lastClosed;
+    g_dirty = false;
+}
+
+static bool runDayStatement(sqlite3* dbHandle, const char* sql, int firstDay, int lastDay) {
+    sqlite3_stmt* stmt = nullptr;
+    bool ok = sqlite3_prepare_v2(dbHandle, sql, -1, &stmt, nullptr) == SQLITE_OK;
+    if (ok) {
+        sqlite3_bind_int(stmt, 1, firstDay);
+        sqlite3_bind_int(stmt, 2, lastDay);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Writes days [firstDay, lastDay] from memory to DayTransition and HourSwitch.
+static bool storeDays(sqlite3* dbHandle, int firstDay, int lastDay) {
+    sqlite3_exec(dbHandle, "BEGIN;", nullptr, nullptr, nullptr);
+    bool ok = runDayStatement(dbHandle, "DELETE FROM DayTransition WHERE day BETWEEN ? AND ?;", firstDay, lastDay) &&
+              runDayStatement(dbHandle, "DELETE FROM HourSwitch WHERE day BETWEEN ? AND ?;", firstDay, lastDay);
+
+    sqlite3_stmt* pairStmt = nullptr;
+    sqlite3_stmt* hourStmt = nullptr;
+    ok = ok &&
+         sqlite3_prepare_v2(dbHandle, "INSERT INTO DayTransition (day, fromProcess, toProcess, count) VALUES (?, ?, ?, ?);",
+                            -1, &pairStmt, nullptr) == SQLITE_OK &&
+         sqlite3_prepare_v2(dbHandle, "INSERT INTO HourSwitch (day, hour, count) VALUES (?, ?, ?);",
+                            -1, &hourStmt, nullptr) == SQLITE_OK;
+    for (auto day = g_days.lower_bound(firstDay); ok && day != g_days.end() && day->first <= lastDay; ++day) {
+        for (const auto& entry : day->second.pairs) {
+            sqlite3_bind_int(pairStmt, 1, day->first);
+            sqlite3_bind_text(pairStmt, 2, g_names[entry.first >> 32].c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(pairStmt, 3, g_names[entry.first & 0xffffffffu].c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(pairStmt, 4, entry.second);
+            ok = sqlite3_step(pairStmt) == SQLITE_DONE;
+            sqlite3_reset(pairStmt);
+            if (!ok)
+                break;
+        }
+        for (int hour = 0; ok && hour < 24; hour++) {
+            if (day->second.hours[hour] == 0)
+                continue;
+            sqlite3_bind_int(hourStmt, 1, day->first);
+            sqlite3_bind_int(hourStmt, 2, hour);
+            sqlite3_bind_int64(hourStmt, 3, day->second.hours[hour]);
+            ok = sqlite3_step(hourStmt) == SQLITE_DONE;
+            sqlite3_reset(hourStmt);
+        }
+    }
+    sqlite3_finalize(pairStmt);
+    sqlite3_finalize(hourStmt);
+
+    if (!ok) {
+        std::cerr << "Failed to store transitions: " << sqlite3_errmsg(dbHandle) << std::endl;
+        sqlite3_exec(dbHandle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    sqlite3_exec(dbHandle, "COMMIT;", nullptr, nullptr, nullptr);
+    return true;
+}
+
+// Stores the days DailyUsage has indexed since the last call; those days are closed.
+static void storeClosedDays(sqlite3* dbHandle) {
+    int through = getIndexedThroughDay();
+    if (g_dirty || through <= g_storedThrough)
+        return;
+    if (!storeDays(dbHandle, g_storedThrough + 1, through))
+        return;
+    g_storedThrough = through;
+    setMetaValue(kStoredThroughKey, std::to_string(g_storedThrough));
+}
+
+static void loadStoredDays(sqlite3* dbHandle) {
+    g_days.clear();
+    g_version++;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT day, fromProcess, toProcess, count FROM DayTransition WHERE day <= ?;",
+                           -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, g_storedThrough);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            uint32_t from = internName(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+            uint32_t to = internName(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)));
+            g_days[sqlite3_column_int(stmt, 0)].pairs[(static_cast<uint64_t>(from) << 32) | to] =
+                static_cast<uint32_t>(sqlite3_column_int64(stmt, 3));
+        }
+    } else {
+        std::cerr << "Failed to read transitions: " << sqlite3_errmsg(dbHandle) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+
+    stmt = nullptr;
+    if (sqlite3_prepare_v2(dbHandle, "SELECT day, hour, count FROM HourSwitch WHERE day <= ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, g_storedThrough);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int hour = sqlite3_column_int(stmt, 1);
+            if (hour >= 0 && hour < 24)
+                g_days[sqlite3_column_int(stmt, 0)].hours[hour] = static_cast<uint32_t>(sqlite3_column_int64(stmt, 2));
+        }
+    } else {
+        std::cerr << "Failed to read switch counts: " << sqlite3_errmsg(dbHandle) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+}
+
+// True when the event's write is the only one since the matrices were last brought up to date.
+static bool claimEventWrite() {
+    unsigned long long generation = getWriteGeneration();
+    if (!g_initialized || generation != g_seenGeneration + 1) {
+        g_dirty = true;
+        return false;
+    }
+    g_seenGeneration = generation;
+    return true;
+}
+
+static void onSessionOpened(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    considerSwitch(g_lastClosed, internName(event.processName), event.time);
+}
+
+static void onSessionClosed(const SessionEvent& event) {
+    if (!claimEventWrite())
+        return;
+    g_lastClosed.valid = true;
+    g_lastClosed.process = internName(event.processName);
+    g_lastClosed.endTime = event.time;
+}
+
+static void onHistoryDaysChanged(int firstDay, int lastDay) {
+    if (isRawDerivedDayFrozen(firstDay))
+        firstDay = getCompactedThroughDay() + 1;
+    if (lastDay < firstDay)
+        return;
+    if (g_repairLastDay < g_repairFirstDay) {
+        g_repairFirstDay = firstDay;
+        g_repairLastDay = lastDay;
+    } else {
+        g_repairFirstDay = std::min(g_repairFirstDay, firstDay);
+        g_repairLastDay = std::max(g_repairLastDay, lastDay);
+    }
+}
+
+// Applies a bulk edit to the stored matrices of frozen days, which cannot be rebuilt.
+// Switches to or from a deleted process are dropped, and a rename that makes both ends
+// the same process drops the switch too. The hourly counts keep no process, so each
+// day's are scaled down by the share of its switches that were dropped.
+static void onFrozenDaysEdited(const BulkEditRequest& request, int firstDay, int lastDay) {
+    sqlite3* dbHandle = getDatabase();
+    lastDay = std::min(lastDay, g_storedThrough);
+    if (!dbHandle || lastDay < firstDay)
+        return;
+    bool reassign = request.kind == BulkEditRequest::Reassign;
+    uint32_t target = reassign ? internName(request.newProcessName) : 0;
+    auto edit = [&](uint32_t process, uint32_t& result) {
+        if (!request.processName.empty() && g_names[process] != request.processName) {
+            result = process;
+            return true;
+        }
+        result = target;
+        return reassign;
+    };
+    for (auto day = g_days.lower_bound(firstDay); day != g_days.end() && day->first <= lastDay; ++day) {
+        std::unordered_map<uint64_t, uint32_t> edited;
+        uint64_t before = 0;
+        uint64_t after = 0;
+        for (const auto& entry : day->second.pairs) {
+            before += entry.second;
+            uint32_t from = 0;
+            uint32_t to = 0;
+            if (!edit(static_cast<uint32_t>(entry.first >> 32), from) ||
+                !edit(static_cast<uint32_t>(entry.first & 0xffffffffu), to) || from == to)
+                continue;
+            edited[(static_cast<uint64_t>(from) << 32) | to] += entry.second;
+            after += entry.second;
+        }
+        day->second.pairs.swap(edited);
+        if (after == before)
+            continue;
+        for (uint32_t& count : day->second.hours)
+            count = static_cast<uint32_t>(std::llround(static_cast<double>(count) * after / before));
+    }
+    g_version++;
+    storeDays(dbHandle, firstDay, lastDay);
+}
+
+void initTransitions() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle) {
+        std::cerr << "Database not initialized.\n";
+        return;
+    }
+    registerDayRepairHandler(onHistoryDaysChanged);
+    registerFrozenDayEditHandler(onFrozenDaysEdited);
+    addSessionOpenListener(onSessionOpened);
+    addSessionCloseListener(onSessionClosed);
+
+    // First run: every day is built from SQL, and the closed ones are stored.
+    std::string stored = getMetaValue(kStoredThroughKey);
+    if (!stored.empty()) {
+        g_storedThrough = std::stoi(stored);
+        loadStoredDays(dbHandle);
+    }
+    rebuildRecentDays(dbHandle);
+    storeClosedDays(dbHandle);
+    g_lastStoreCheck = std::chrono::steady_clock::now();
+    g_initialized = true;
+}
+
+void runTransitionMaintenance() {
+    sqlite3* dbHandle = getDatabase();
+    if (!dbHandle || !g_initialized)
+        return;
+
+    // Stored days are rebuilt and rewritten; later days are covered by the rebuild below,
+    // since a repair is always a write the tracker events did not account for.
+    if (g_repairLastDay >= g_repairFirstDay) {
+        // The first switch of the next day starts from the last repaired session, so that
+        // day is rebuilt too when it is stored.
+        int lastDay = g_repairLastDay < g_storedThrough ? g_repairLastDay + 1 : g_storedThrough;
+        LastSession unused;
+        if (g_repairFirstDay <= lastDay && buildDays(dbHandle, g_repairFirstDay, lastDay, unused))
+            storeDays(dbHandle, g_repairFirstDay, lastDay);
+        g_repairFirstDay = 0;
+        g_repairLastDay = -1;
+    }
+
+    if (getWriteGeneration() != g_seenGeneration)
+        g_dirty = true;
+    auto now = std::chrono::steady_clock::now();
+    // Imports and repairs arrive in bursts, so rebuild at most every few seconds.
+    if (g_dirty && now - g_lastBuild >= std::chrono::seconds(5))
+        rebuildRecentDays(dbHandle);
+
+    if (now - g_lastStoreCheck < std::chrono::minutes(1))
+        return;
+    g_lastStoreCheck = now;
+    storeClosedDays(dbHandle);
+}
+
+const SwitchStats& getSwitchStats(int firstDay, int lastDay) {
+    if (g_cachedVersion == g_version && g_cachedFirstDay == firstDay && g_cachedLastDay == lastDay)
+        return g_cachedStats;
+    SwitchStats stats;
+    std::unordered_map<uint64_t, uint64_t> merged;
+    for (auto day = g_days.lower_bound(firstDay); day != g_days.end() && day->first <= lastDay; ++day) {
+        for (const auto& entry : day->second.pairs)
+            merged[entry.first] += entry.second;
+        for (int hour = 0; hour < 24; hour++) {
+            stats.byHour[hour] += day->second.hours[hour];
+            stats.switches += day->second.hours[hour];
+        }
+    }
+    stats.transitions.reserve(merged.size());
+    for (const auto& entry : merged)
+        stats.transitions.push_back(AppTransition{g_names[entry.first >> 32], g_names[entry.first & 0xffffffffu], entry.second});
+    std::sort(stats.transitions.begin(), stats.transitions.end(), [](const AppTransition& a, const AppTransition& b) {
+        return a.count > b.count;
+    });
+    g_cachedStats = std::move(stats);
+    g_cachedVersion = g_version;
+    g_cachedFirstDay = firstDay;
+    g_cachedLastDay = lastDay;
+    return g_cachedStats;
+}
+
+void DrawContextSwitchPane(int firstDay, int lastDay, double trackedSeconds) {
+    ImGui::Begin("Context Switches");
+    const SwitchStats& stats = getSwitchStats(firstDay, lastDay);
+    double trackedHours = trackedSeconds / 3600.0;
+    ImGui::Text("App switches: %llu (%.1f per tracked hour)", static_cast<unsigned long long>(stats.switches),
+                trackedHours > 0.0 ? static_cast<double>(stats.switches) / trackedHours : 0.0);
+
+    float bars[24];
+    for (int hour = 0; hour < 24; hour++)
+        bars[hour] = static_cast<float>(stats.byHour[hour]);
+    ImGui::PlotHistogram("##switches", bars, 24, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+    ImGui::TextDisabled("Switches by hour of the day, midnight on the left.");
+
+    if (ImGui::BeginTable("TransitionTable", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("From", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("To", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Switches");
+        ImGui::TableHeadersRow();
+        for (size_t i = 0; i < stats.transitions.size() && i < 15; i++) {
+            const AppTransition& transition = stats.transitions[i];
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(transition.from.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::TextUnformatted(transition.to.c_str());
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%llu", static_cast<unsigned long long>(transition.count));
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
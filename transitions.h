@@ -0,0 +1,46 @@
+#ifndef TRANSITIONS_H
+#define TRANSITIONS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// App switches between consecutive sessions on this machine, as per-day transition
+// matrices (from-process -> to-process counts) and per-hour switch counters.
+//
+// A switch is a session of a different process starting within five minutes of the end
+// of the previous one; returning after a longer idle gap is not counted. It is counted on
+// the day and hour the new session started. Tracker open events add switches with O(1)
+// work. Closed days up to the DailyUsage index are stored in DayTransition and HourSwitch;
+// later days are kept in memory and built from one ordered pass over ActivitySession.
+// A range merges its days' matrices. Days rewritten through registerDayRepairHandler
+// are rebuilt, except days retention has compacted (isRawDerivedDayFrozen), whose stored
+// matrices are kept and have bulk edits applied to them directly.
+
+struct AppTransition {
+    std::string from;
+    std::string to;
+    uint64_t count = 0;
+};
+
+struct SwitchStats {
+    uint64_t switches = 0;
+    std::array<uint64_t, 24> byHour{};  // Switches per hour of the day.
+    std::vector<AppTransition> transitions;  // Most frequent first.
+};
+
+// Loads the stored days, building them on first run, and subscribes to tracker events.
+// Call after initDailyUsage.
+void initTransitions();
+
+// Switches over days [firstDay, lastDay]. Cached until a switch is added or a day rebuilt.
+const SwitchStats& getSwitchStats(int firstDay, int lastDay);
+
+// Called once per frame from the main loop; stores newly closed days and applies repairs.
+void runTransitionMaintenance();
+
+// trackedSeconds is the time tracked over the same days, for the switch rate.
+void DrawContextSwitchPane(int firstDay, int lastDay, double trackedSeconds);
+
+#endif // TRANSITIONS_H